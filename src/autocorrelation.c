@@ -24,8 +24,11 @@ struct acr_s{
   precision *lagk;            /* Autocorrelations for k-lags. Contiguous per dimensionality */
   int outfreq;
   char outdir[FILENAME_MAX];
+  acr_method_enum_t method;   /* FFT or direct evaluation of the lags */
 };
 
+static const char *acr_method_names[ACR_METHOD_MAX] = {"fft", "direct"};
+
 static int acr_allocate_X(acr_t *acr);
 static int acr_allocate_mean(acr_t *acr);
 static int acr_allocate_variance(acr_t *acr);
@@ -35,6 +38,11 @@ static int acr_allocate_lagk(acr_t *acr);
 static int acr_load_X(ch_t *chain, int N, int dim, int idx, precision *X);
 static precision acr_compute_mean(precision *X, int N);
 static precision acr_compute_variance(precision *X, precision mean, int N);
+static int acr_method_from_name(const char *name, acr_method_enum_t *method);
+static int acr_compute_acf_fft(acr_t *acr, int ia, int ib, int nfft,
+                               double *re, double *im, double *wre, double *wim);
+static int acr_fft(int n, double *REST re, double *REST im,
+                   const double *REST wre, const double *REST wim, int inverse);
 
 /*****************************************************************************
  *
@@ -62,6 +70,7 @@ int acr_create(pe_t *pe, ch_t *chain, acr_t **pacr){
   acr_threshold_set(acr, THRESHOLD_AUTO_DEFAULT);
   acr_outfreq_set(acr, OUTFREQ_AUTO_DEFAULT);
   acr_outdir_set(acr, OUTDIR_DEFAULT);
+  acr_method_from_name(ACR_METHOD_DEFAULT, &acr->method);
 
   *pacr = acr;
 
@@ -101,6 +110,7 @@ int acr_init_rt(rt_t *rt, ch_t *chain, acr_t *acr){
   int i, dim, N, outfreq, maxlag;
   double threshold;
   char outdir[FILENAME_MAX];
+  char method[BUFSIZ];
 
   assert(rt);
   assert(chain);
@@ -132,6 +142,14 @@ int acr_init_rt(rt_t *rt, ch_t *chain, acr_t *acr){
     acr_outdir_set(acr, outdir);
   }
 
+  if(rt_string_parameter(rt, "acr_method", method, BUFSIZ))
+  {
+    if(acr_method_from_name(method, &acr->method) == 0)
+    {
+      pe_fatal(acr->pe, "Unrecognised acr_method \"%s\"\n", method);
+    }
+  }
+
   acr_allocate_X(acr);
   acr_allocate_mean(acr);
   acr_allocate_variance(acr);
@@ -154,25 +172,72 @@ int acr_compute(acr_t *acr){
 
   assert(acr);
   precision lagk;
-  int i, j, k, offset;
+  int i, j, k, offset, nfft;
   int N=acr->N, dim=acr->dim;
+  double *re = NULL, *im = NULL, *wre = NULL, *wim = NULL;
 
   TIMER_start(TIMER_AUTOCORRELATION);
   /* Create a contiguous block of data per dimension */
   for(i=0; i<dim; i++)
   {
-    lagk = 0.0;
     offset = acr->offset[i];
     acr_load_X(acr->chain, N, dim, i, &acr->X[offset]);
 
     acr->mean[i] = acr_compute_mean(&acr->X[offset], N);
     acr->variance[i] = acr_compute_variance(&acr->X[offset], acr->mean[i], N);
+  }
+
+  /* The FFT path leaves the raw autocorrelations in lagk, which the
+   * threshold truncation below then reads in place of acr_compute_lagk */
+  if(acr->method == ACR_METHOD_FFT)
+  {
+    /* Padding to N + maxlag keeps the wrapped-around products out of the
+     * lags we keep. */
+    for(nfft=2; nfft < N + acr->maxlag; nfft <<= 1);
+
+    re  = (double *) malloc(nfft*sizeof(double));
+    im  = (double *) malloc(nfft*sizeof(double));
+    wre = (double *) malloc(nfft/2*sizeof(double));
+    wim = (double *) malloc(nfft/2*sizeof(double));
+    if(re == NULL || im == NULL || wre == NULL || wim == NULL)
+      pe_fatal(acr->pe, "malloc(fft workspace) failed\n");
+
+    for(k=0; k<nfft/2; k++)
+    {
+      wre[k] = cos(8.0*atan(1.0)*k/nfft);
+      wim[k] = sin(8.0*atan(1.0)*k/nfft);
+    }
+
+    /* Two real dimensions share one complex transform */
+    for(i=0; i<dim; i+=2)
+    {
+      acr_compute_acf_fft(acr, i, (i+1 < dim) ? i+1 : -1, nfft, re, im, wre, wim);
+    }
+
+    free(re);
+    free(im);
+    free(wre);
+    free(wim);
+  }
+
+  for(i=0; i<dim; i++)
+  {
+    lagk = 0.0;
+    offset = acr->offset[i];
 
     acr->maxlag_act[i] = acr->maxlag;
     for(j=0; j<acr->maxlag; j++)
     {
-      lagk = acr_compute_lagk(&acr->X[offset], acr->mean[i], acr->variance[i],
-                              N, j, acr->threshold);
+      if(acr->method == ACR_METHOD_FFT)
+      {
+        lagk = (j < N) ? acr->lagk[i*acr->maxlag+j] : acr->threshold;
+        lagk = (lagk >= acr->threshold) ? lagk : acr->threshold;
+      }
+      else
+      {
+        lagk = acr_compute_lagk(&acr->X[offset], acr->mean[i], acr->variance[i],
+                                N, j, acr->threshold);
+      }
 
       if(fabs(lagk - acr->threshold) < PRECISION_TOLERANCE){
         acr->maxlag_act[i] = j-1;
@@ -190,6 +255,129 @@ int acr_compute(acr_t *acr){
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  acr_compute_acf_fft
+ *
+ *  Autocorrelations of dimensions ia and ib (ib < 0 for none) for lags
+ *  0..min(maxlag,N)-1, written unclamped to lagk.
+ *
+ *  The centred samples of ia and ib are the real and imaginary parts of a
+ *  single transform Z. The spectra of the two real series are recovered as
+ *  A_k = (Z_k + conj(Z_{n-k}))/2 and B_k = (Z_k - conj(Z_{n-k}))/2i, and
+ *  since |A|^2 and |B|^2 are real and even the inverse transform of
+ *  |A|^2 + i|B|^2 returns both autocovariances at once.
+ *
+ *****************************************************************************/
+
+static int acr_compute_acf_fft(acr_t *acr, int ia, int ib, int nfft,
+                               double *re, double *im, double *wre, double *wim){
+
+  int j, k, m, nlag;
+  int N = acr->N;
+  double ar, ai, br, bi;
+  precision *Xa = NULL, *Xb = NULL;
+
+  assert(acr);
+
+  nlag = (acr->maxlag < N) ? acr->maxlag : N;
+
+  Xa = &acr->X[acr->offset[ia]];
+  if(ib >= 0) Xb = &acr->X[acr->offset[ib]];
+
+  for(j=0; j<N; j++)
+  {
+    re[j] = Xa[j] - acr->mean[ia];
+    im[j] = (Xb) ? Xb[j] - acr->mean[ib] : 0.0;
+  }
+  for(j=N; j<nfft; j++)
+  {
+    re[j] = 0.0;
+    im[j] = 0.0;
+  }
+
+  acr_fft(nfft, re, im, wre, wim, 0);
+
+  for(k=0; k<=nfft/2; k++)
+  {
+    m = (nfft - k) & (nfft - 1);
+
+    ar = 0.5 * (re[k] + re[m]);
+    ai = 0.5 * (im[k] - im[m]);
+    br = 0.5 * (im[k] + im[m]);
+    bi = 0.5 * (re[m] - re[k]);
+
+    re[k] = re[m] = ar*ar + ai*ai;
+    im[k] = im[m] = br*br + bi*bi;
+  }
+
+  acr_fft(nfft, re, im, wre, wim, 1);
+
+  for(j=0; j<nlag; j++)
+  {
+    acr->lagk[ia*acr->maxlag+j] = re[j] / nfft / (N - j) / acr->variance[ia];
+    if(Xb) acr->lagk[ib*acr->maxlag+j] = im[j] / nfft / (N - j) / acr->variance[ib];
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  acr_fft
+ *
+ *  In-place iterative radix-2 complex transform of length n (a power of
+ *  two), unnormalised. wre/wim hold cos/sin(2 pi k/n) for k < n/2.
+ *
+ *****************************************************************************/
+
+static int acr_fft(int n, double *REST re, double *REST im,
+                   const double *REST wre, const double *REST wim, int inverse){
+
+  int i, j, k, l, len, half, step, bit;
+  double tr, ti, wr, wi;
+
+  /* Bit reversal permutation */
+  for(i=1, j=0; i<n; i++)
+  {
+    for(bit=n>>1; j & bit; bit>>=1) j ^= bit;
+    j ^= bit;
+
+    if(i < j)
+    {
+      tr = re[i]; re[i] = re[j]; re[j] = tr;
+      ti = im[i]; im[i] = im[j]; im[j] = ti;
+    }
+  }
+
+  for(len=2; len<=n; len<<=1)
+  {
+    half = len >> 1;
+    step = n / len;
+    for(i=0; i<n; i+=len)
+    {
+      for(k=0; k<half; k++)
+      {
+        wr = wre[k*step];
+        wi = (inverse) ? wim[k*step] : -wim[k*step];
+
+        j = i + k;
+        l = j + half;
+
+        tr = wr*re[l] - wi*im[l];
+        ti = wr*im[l] + wi*re[l];
+
+        re[l] = re[j] - tr;
+        im[l] = im[j] - ti;
+        re[j] += tr;
+        im[j] += ti;
+      }
+    }
+  }
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  acr_compute_lagk
@@ -287,6 +475,7 @@ int acr_info(pe_t *pe, acr_t *acr){
   pe_info(pe, "%30s\t\t%d\n", "Dimensionality of Samples:", dim);
   pe_info(pe, "%30s\t\t%d\n", "Max Lag:", maxlag);
   pe_info(pe, "%30s\t\t%f\n", "Autocorrelation Threshold:", threshold);
+  pe_info(pe, "%30s\t\t%s\n", "Method:", acr_method_names[acr->method]);
   pe_info(pe, "%30s\t\t%d %s\n", "Output Frequency:", outfreq, "iterations");
   pe_info(pe, "%30s\t\t%s\n", "Output directory:", outdir);
 
@@ -502,6 +691,37 @@ int acr_outdir(acr_t *acr, char *outdir){
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  acr_method_set
+ *
+ *****************************************************************************/
+
+int acr_method_set(acr_t *acr, acr_method_enum_t method){
+
+  assert(acr);
+  assert(method < ACR_METHOD_MAX);
+
+  acr->method = method;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  acr_method
+ *
+ *****************************************************************************/
+
+int acr_method(acr_t *acr, acr_method_enum_t *method){
+
+  assert(acr);
+
+  *method = acr->method;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  acr_X
@@ -693,13 +913,27 @@ static int acr_load_X(ch_t *chain, int N, int dim, int idx, precision *X){
 
   assert(chain);
 
-  int i;
+  int i, j, k, nstates;
   precision *samples = NULL;
+  int *weights = NULL;
 
   ch_samples(chain, &samples);
+  ch_weights(chain, &weights);
 
-  for(i=0; i<N; i++)
-    X[i] = samples[i*dim+idx];
+  if(weights == NULL)
+  {
+    for(i=0; i<N; i++)
+      X[i] = samples[i*dim+idx];
+    return 0;
+  }
+
+  /* Weighted chain: each state is repeated for the steps spent in it */
+  ch_nstates(chain, &nstates);
+  for(j=0, i=0; j<nstates && i<N; j++)
+  {
+    for(k=0; k<weights[j] && i<N; k++, i++)
+      X[i] = samples[j*dim+idx];
+  }
 
   return 0;
 }
@@ -739,3 +973,26 @@ static precision acr_compute_variance(precision *X, precision mean, int N){
 
   return (var / N);
 }
+
+/*****************************************************************************
+ *
+ *  acr_method_from_name
+ *  returns 1 if the name matches a method, 0 otherwise
+ *
+ *****************************************************************************/
+
+static int acr_method_from_name(const char *name, acr_method_enum_t *method){
+
+  int n;
+
+  for(n=0; n<ACR_METHOD_MAX; n++)
+  {
+    if(strcmp(name, acr_method_names[n]) == 0)
+    {
+      *method = (acr_method_enum_t) n;
+      return 1;
+    }
+  }
+
+  return 0;
+}
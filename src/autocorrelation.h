@@ -7,6 +7,12 @@
 
 typedef struct acr_s acr_t;
 
+/* How the autocorrelations are evaluated: from the autocovariance of a
+ * zero-padded FFT, O(N log N), or summed directly for every lag, O(N maxlag) */
+typedef enum {ACR_METHOD_FFT = 0,
+              ACR_METHOD_DIRECT,
+              ACR_METHOD_MAX} acr_method_enum_t;
+
 int acr_create(pe_t *pe, ch_t *chain, acr_t **pacr);
 int acr_free(acr_t *acr);
 int acr_init_rt(rt_t *rt, ch_t *chain, acr_t *acr);
@@ -30,6 +36,8 @@ int acr_outfreq_set(acr_t *acr, int outfreq);
 int acr_outfreq(acr_t *acr, int *outfreq);
 int acr_outdir_set(acr_t *acr, const char *outdir);
 int acr_outdir(acr_t *acr, char *outdir);
+int acr_method_set(acr_t *acr, acr_method_enum_t method);
+int acr_method(acr_t *acr, acr_method_enum_t *method);
 
 int acr_X(acr_t *acr, precision **pX);
 int acr_mean(acr_t *acr, precision **pmean);
@@ -3,22 +3,66 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "chain.h"
 #include "memory.h"
 #include "util.h"
 
+/* Ring of sample blocks drained to a file by a writer thread */
+typedef struct ch_stream_s{
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int fd;
+  char filename[FILENAME_MAX];
+  precision *ring;            /* ring_blocks blocks of block_size samples */
+  int *full;                  /* Samples of a slot waiting to be written, 0 if free */
+  int next;                   /* Next block the writer flushes */
+  int nsamples;               /* Samples appended so far */
+  int pending;                /* Samples of the current block not yet handed over */
+  int done;                   /* No more blocks will be handed over */
+  int closed;                 /* Writer joined and the file mapped */
+  int error;                  /* errno of a failed write */
+  size_t size;                /* Bytes of the file */
+} ch_stream_t;
+
 struct ch_s{
+  pe_t *pe;
   int dim;
   int N;
   precision *samples;
   precision *probability;
   precision *ratio;
   int *accepted;
+  int *depth;                 /* Tree depth and gradients of each step, if any */
+  int *grads;
   int outfreq;
   char outdir[FILENAME_MAX];
+  ch_storage_enum_t storage;  /* Samples in memory or streamed to a file */
+  int storage_set;            /* Storage chosen by the caller, not by the input */
+  int block_size;             /* Samples per block of the ring */
+  int ring_blocks;            /* Blocks in the ring */
+  ch_stream_t *stream;
+  int *weights;               /* Steps spent in each distinct state (weighted) */
+  int nstates;                /* Distinct states held (weighted) */
+  int capacity;               /* States allocated (weighted) */
+  int id;                     /* Chain of an ensemble, 0 for the first */
 };
 
+static const char *ch_storage_names[CH_STORAGE_MAX] = {"memory", "stream",
+                                                       "weighted"};
+
+static int ch_init_storage_rt(rt_t *rt, ch_t *chain, const char *chain_type);
+static int ch_storage_from_name(const char *name, ch_storage_enum_t *storage);
+static int ch_stream_open(ch_t *chain, const char *chain_type);
+static int ch_stream_submit(ch_stream_t *stream, int slot, int rows);
+static void *ch_stream_writer(void *arg);
+static int ch_grow_states(ch_t *chain);
 static int ch_allocate_samples(ch_t *chain);
 static int ch_allocate_probability(ch_t *chain);
 static int ch_allocate_ratio(ch_t *chain);
@@ -40,10 +84,15 @@ int ch_create(pe_t *pe, ch_t **pchain){
   assert(chain);
   if(chain == NULL) pe_fatal(pe, "calloc(ch_t) failed\n");
 
+  chain->pe = pe;
+
   ch_dim_set(chain, DIMX_DEFAULT);
   ch_N_set(chain, N_CHAIN_DEFAULT);
   ch_outfreq_set(chain, OUTFREQ_CHAIN_DEFAULT);
   ch_outdir_set(chain, OUTDIR_DEFAULT);
+  ch_storage_from_name(CHAIN_STORAGE_DEFAULT, &chain->storage);
+  ch_block_size_set(chain, CHAIN_BLOCK_DEFAULT);
+  ch_ring_blocks_set(chain, CHAIN_RING_DEFAULT);
 
   *pchain = chain;
 
@@ -60,10 +109,25 @@ int ch_free(ch_t *chain){
 
   assert(chain);
 
+  if(chain->stream)
+  {
+    ch_flush(chain);
+    if(chain->samples) munmap(chain->samples, chain->stream->size);
+    chain->samples = NULL;
+    pthread_mutex_destroy(&chain->stream->lock);
+    pthread_cond_destroy(&chain->stream->cond);
+    mem_free((void**)&chain->stream->ring);
+    mem_free((void**)&chain->stream->full);
+    mem_free((void**)&chain->stream);
+  }
+
   mem_free((void**)&chain->samples);
+  mem_free((void**)&chain->weights);
   mem_free((void**)&chain->probability);
   mem_free((void**)&chain->ratio);
   mem_free((void**)&chain->accepted);
+  mem_free((void**)&chain->depth);
+  mem_free((void**)&chain->grads);
   mem_free((void**)&chain);
 
   return 0;
@@ -103,6 +167,8 @@ int ch_init_burn_rt(rt_t *rt, ch_t *burn){
     ch_outdir_set(burn, outdir);
   }
 
+  ch_init_storage_rt(rt, burn, "burn");
+
   ch_allocate_samples(burn);
   ch_allocate_probability(burn);
   ch_allocate_ratio(burn);
@@ -145,6 +211,8 @@ int ch_init_chain_rt(rt_t *rt, ch_t *chain){
     ch_outdir_set(chain, outdir);
   }
 
+  ch_init_storage_rt(rt, chain, "postburn");
+
   ch_allocate_samples(chain);
   ch_allocate_probability(chain);
   ch_allocate_ratio(chain);
@@ -179,6 +247,12 @@ int ch_burn_info(pe_t *pe, ch_t *burn){
   pe_info(pe, "%30s\t\t%d\n", "Dimensionality of Samples:", dim);
   pe_info(pe, "%30s\t\t%d %s\n", "Output Frequency:", outfreq, "iterations");
   pe_info(pe, "%30s\t\t%s\n", "Output directory:", outdir);
+  pe_info(pe, "%30s\t\t%s\n", "Storage:", ch_storage_names[burn->storage]);
+  if(burn->storage == CH_STORAGE_STREAM)
+  {
+    pe_info(pe, "%30s\t\t%d x %d %s\n", "Ring:", burn->ring_blocks,
+            burn->block_size, "samples");
+  }
 
   return 0;
 }
@@ -209,20 +283,46 @@ int ch_chain_info(pe_t *pe, ch_t *chain){
   pe_info(pe, "%30s\t\t%d\n", "Dimensionality of Samples:", dim);
   pe_info(pe, "%30s\t\t%d %s\n", "Output Frequency:", outfreq, "iterations");
   pe_info(pe, "%30s\t\t%s\n", "Output directory:", outdir);
+  pe_info(pe, "%30s\t\t%s\n", "Storage:", ch_storage_names[chain->storage]);
+  if(chain->storage == CH_STORAGE_STREAM)
+  {
+    pe_info(pe, "%30s\t\t%d x %d %s\n", "Ring:", chain->ring_blocks,
+            chain->block_size, "samples");
+  }
 
   return 0;
 }
 
 int ch_write_files(ch_t *chain, const char *chain_type){
 
+  int n, nrows, *weights = NULL;
+
   assert(chain);
 
   printf("%30s\t%50s", "Creating output directory:", chain->outdir);
   rw_create_dir(chain->outdir);
   printf("\tDone\n");
 
-  util_write_array_precision(chain->samples, chain->N, chain->dim,
-                             chain->outdir, chain_type, "samples");
+  if(chain->storage == CH_STORAGE_WEIGHTED)
+  {
+    /* The states covering the same N steps as the full chain */
+    mem_malloc_integers(&weights, chain->nstates);
+    for(n=0, nrows=0; n<chain->nstates && nrows<chain->N; nrows+=weights[n++])
+    {
+      weights[n] = chain->weights[n];
+      if(weights[n] > chain->N - nrows) weights[n] = chain->N - nrows;
+    }
+
+    util_write_array_precision(chain->samples, n, chain->dim,
+                               chain->outdir, chain_type, "samples");
+    util_write_array_int(weights, n, 1, chain->outdir, chain_type, "weights");
+    mem_free((void**)&weights);
+  }
+  else
+  {
+    util_write_array_precision(chain->samples, chain->N, chain->dim,
+                               chain->outdir, chain_type, "samples");
+  }
 
   util_write_array_precision(chain->probability, chain->N, 1,
                              chain->outdir, chain_type, "probability");
@@ -233,6 +333,64 @@ int ch_write_files(ch_t *chain, const char *chain_type){
   util_write_array_int(chain->accepted, chain->N, 1,
                        chain->outdir, chain_type, "accepted");
 
+  if(chain->depth)
+  {
+    util_write_array_int(chain->depth, chain->N, 1,
+                         chain->outdir, chain_type, "depth");
+    util_write_array_int(chain->grads, chain->N, 1,
+                         chain->outdir, chain_type, "gradients");
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_flush
+ *
+ *  Hands the last partial block to the writer, waits for the ring to
+ *  drain and maps the file in place of the samples, so that the chain is
+ *  read back from disk by whoever needs it after sampling.
+ *  Nothing to do when the samples are held in memory.
+ *
+ *****************************************************************************/
+
+int ch_flush(ch_t *chain){
+
+  ch_stream_t *stream = NULL;
+  void *map = NULL;
+
+  assert(chain);
+
+  stream = chain->stream;
+  if(stream == NULL || stream->closed) return 0;
+
+  if(stream->pending > 0)
+  {
+    ch_stream_submit(stream, ((stream->nsamples-1) / chain->block_size) % chain->ring_blocks,
+                     stream->pending);
+  }
+
+  pthread_mutex_lock(&stream->lock);
+  stream->done = 1;
+  pthread_cond_broadcast(&stream->cond);
+  pthread_mutex_unlock(&stream->lock);
+
+  pthread_join(stream->writer, NULL);
+  stream->closed = 1;
+
+  if(stream->error)
+  {
+    pe_fatal(chain->pe, "Writing %s failed (%s)\n", stream->filename,
+             strerror(stream->error));
+  }
+
+  map = mmap(NULL, stream->size, PROT_READ, MAP_SHARED, stream->fd, 0);
+  if(map == MAP_FAILED) pe_fatal(chain->pe, "mmap(%s) failed\n", stream->filename);
+  close(stream->fd);
+
+  chain->samples = (precision *) map;
+
   return 0;
 }
 
@@ -281,6 +439,24 @@ int ch_outfreq_set(ch_t *chain, int outfreq){
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  ch_id_set
+ *
+ *  Position of the chain in an ensemble; set before ch_init_*_rt so that
+ *  streamed chains get files of their own.
+ *
+ *****************************************************************************/
+
+int ch_id_set(ch_t *chain, int id){
+
+  assert(chain);
+
+  chain->id = id;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  ch_outdir_set
@@ -296,6 +472,57 @@ int ch_outdir_set(ch_t *chain, const char *outdir){
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  ch_storage_set
+ *
+ *  Takes precedence over the chain_storage key of a later ch_init_*_rt.
+ *
+ *****************************************************************************/
+
+int ch_storage_set(ch_t *chain, ch_storage_enum_t storage){
+
+  assert(chain);
+  assert(storage < CH_STORAGE_MAX);
+
+  chain->storage = storage;
+  chain->storage_set = 1;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_block_size_set
+ *
+ *****************************************************************************/
+
+int ch_block_size_set(ch_t *chain, int block_size){
+
+  assert(chain);
+  assert(block_size > 0);
+
+  chain->block_size = block_size;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_ring_blocks_set
+ *
+ *****************************************************************************/
+
+int ch_ring_blocks_set(ch_t *chain, int ring_blocks){
+
+  assert(chain);
+  assert(ring_blocks > 1);
+
+  chain->ring_blocks = ring_blocks;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  ch_dim
@@ -356,6 +583,51 @@ int ch_outdir(ch_t *chain, char *outdir){
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  ch_storage
+ *
+ *****************************************************************************/
+
+int ch_storage(ch_t *chain, ch_storage_enum_t *storage){
+
+  assert(chain);
+
+  *storage = chain->storage;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_block_size
+ *
+ *****************************************************************************/
+
+int ch_block_size(ch_t *chain, int *block_size){
+
+  assert(chain);
+
+  *block_size = chain->block_size;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_ring_blocks
+ *
+ *****************************************************************************/
+
+int ch_ring_blocks(ch_t *chain, int *ring_blocks){
+
+  assert(chain);
+
+  *ring_blocks = chain->ring_blocks;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  ch_samples
@@ -386,6 +658,116 @@ int ch_probability(ch_t *chain, precision **pprobability){
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  ch_split_rhat
+ *
+ *  Split R-hat of each dimension over nchains chains of the same length
+ *  (Gelman et al., Bayesian Data Analysis, 3rd ed., 2013). The first N
+ *  steps of every chain are cut into two halves of n = N/2 steps, and
+ *  with W the mean within-half variance and B/n the variance of the
+ *  half means,
+ *
+ *    rhat = sqrt(((n-1)/n W + B/n) / W).
+ *
+ *****************************************************************************/
+
+int ch_split_rhat(ch_t **chains, int nchains, precision *rhat){
+
+  int c, d, h, j, r, s, m, n, N, dim, count, half;
+  int *weights = NULL;
+  double *mean = NULL, *m2 = NULL;
+  double delta, W, B, grand;
+  precision *x = NULL;
+
+  assert(chains);
+  assert(rhat);
+
+  N = chains[0]->N;
+  dim = chains[0]->dim;
+  n = N/2;
+  m = 2*nchains;
+
+  mean = (double *) calloc(m*dim, sizeof(double));
+  m2 = (double *) calloc(m*dim, sizeof(double));
+  assert(mean);
+  assert(m2);
+
+  for(c=0; c<nchains; c++)
+  {
+    weights = chains[c]->weights;
+
+    /* Steps in order; a weighted chain repeats each state */
+    for(j=0, s=0; s<N; j++)
+    {
+      count = (weights) ? weights[j] : 1;
+      x = &chains[c]->samples[j*dim];
+
+      for(r=0; r<count && s<N; r++, s++)
+      {
+        if(s < n)
+          half = 2*c;
+        else if(s >= N-n)
+          half = 2*c+1;
+        else
+          continue;
+
+        h = (s < n) ? s : s - (N-n);
+
+        for(d=0; d<dim; d++)
+        {
+          delta = x[d] - mean[half*dim+d];
+          mean[half*dim+d] += delta / (h+1);
+          m2[half*dim+d] += delta * (x[d] - mean[half*dim+d]);
+        }
+      }
+    }
+  }
+
+  for(d=0; d<dim; d++)
+  {
+    W = 0.0;
+    grand = 0.0;
+    for(h=0; h<m; h++)
+    {
+      W += m2[h*dim+d] / (n-1);
+      grand += mean[h*dim+d];
+    }
+    W /= m;
+    grand /= m;
+
+    B = 0.0;
+    for(h=0; h<m; h++)
+      B += (mean[h*dim+d] - grand) * (mean[h*dim+d] - grand);
+    B *= (double) n / (m-1);
+
+    rhat[d] = sqrt(((n-1.0)/n * W + B/n) / W);
+  }
+
+  free(mean);
+  free(m2);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_acceptance_rate
+ *
+ *  Fraction of the N proposals accepted over the whole chain.
+ *
+ *****************************************************************************/
+
+int ch_acceptance_rate(ch_t *chain, precision *rate){
+
+  assert(chain);
+  assert(chain->ratio);
+
+  *rate = chain->ratio[chain->N];
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  ch_ratio
@@ -416,6 +798,59 @@ int ch_accepted(ch_t *chain, int **paccepted){
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  ch_weights
+ *
+ *  Steps spent in each state of a weighted chain, NULL otherwise.
+ *
+ *****************************************************************************/
+
+int ch_weights(ch_t *chain, int **pweights){
+
+  assert(chain);
+
+  *pweights = chain->weights;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_tree
+ *
+ *  Tree depth and gradient evaluations of each step, NULL unless the
+ *  sampler records them.
+ *
+ *****************************************************************************/
+
+int ch_tree(ch_t *chain, int **pdepth, int **pgrads){
+
+  assert(chain);
+
+  *pdepth = chain->depth;
+  *pgrads = chain->grads;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_nstates
+ *
+ *  Distinct states of a weighted chain, one per step otherwise.
+ *
+ *****************************************************************************/
+
+int ch_nstates(ch_t *chain, int *nstates){
+
+  assert(chain);
+
+  *nstates = (chain->storage == CH_STORAGE_WEIGHTED) ? chain->nstates : chain->N+1;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  ch_allocate_samples
@@ -426,6 +861,16 @@ static int ch_allocate_samples(ch_t *chain){
 
   assert(chain);
 
+  if(chain->storage == CH_STORAGE_STREAM) return 0;
+
+  if(chain->storage == CH_STORAGE_WEIGHTED)
+  {
+    chain->nstates = 0;
+    chain->capacity = 0;
+    ch_grow_states(chain);
+    return 0;
+  }
+
   mem_malloc_precision(&chain->samples, chain->dim * (chain->N+1));
 
   return 0;
@@ -489,12 +934,75 @@ int ch_append_sample(int idx, precision *sample, ch_t *chain){
 
   int i;
   int size = chain->dim;
+  int slot, row;
+  ch_stream_t *stream = chain->stream;
+  precision *dest = NULL;
+
+  if(chain->storage == CH_STORAGE_WEIGHTED)
+  {
+    if(chain->nstates == chain->capacity) ch_grow_states(chain);
+    dest = &chain->samples[(size_t)chain->nstates*size];
+    for(i=0; i<size; i++) dest[i] = sample[i];
+    chain->weights[chain->nstates++] = 1;
+    return 0;
+  }
+
+  if(stream == NULL)
+  {
+    for(i=0; i<size; i++) chain->samples[idx*size+i] = sample[i];
+    return 0;
+  }
+
+  /* Samples are streamed in order, each block once its slot is free */
+  assert(!stream->closed);
+  assert(idx == stream->nsamples);
+
+  row = idx % chain->block_size;
+  slot = (idx / chain->block_size) % chain->ring_blocks;
+
+  if(row == 0)
+  {
+    pthread_mutex_lock(&stream->lock);
+    while(stream->full[slot]) pthread_cond_wait(&stream->cond, &stream->lock);
+    pthread_mutex_unlock(&stream->lock);
+  }
 
-  for(i=0; i<size; i++) chain->samples[idx*size+i] = sample[i];
+  dest = &stream->ring[((size_t)slot*chain->block_size + row)*size];
+  for(i=0; i<size; i++) dest[i] = sample[i];
+  stream->pending = row + 1;
+  stream->nsamples++;
+
+  if(row == chain->block_size-1 || idx == chain->N)
+  {
+    ch_stream_submit(stream, slot, stream->pending);
+  }
 
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  ch_repeat_sample
+ *
+ *  The chain stays in the state of step idx-1, given by sample. A weighted
+ *  chain only counts one more step in that state.
+ *
+ *****************************************************************************/
+
+int ch_repeat_sample(int idx, precision *sample, ch_t *chain){
+
+  assert(chain);
+
+  if(chain->storage == CH_STORAGE_WEIGHTED)
+  {
+    assert(chain->nstates > 0);
+    chain->weights[chain->nstates-1]++;
+    return 0;
+  }
+
+  return ch_append_sample(idx, sample, chain);
+}
+
 /*****************************************************************************
  *
  *  ch_append_probability
@@ -510,6 +1018,33 @@ int ch_append_probability(int idx, precision probability, ch_t *chain){
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  ch_append_tree
+ *
+ *  Cost of step idx for a sampler that builds a trajectory per step. The
+ *  arrays are allocated on first use and written out with the chain.
+ *
+ *****************************************************************************/
+
+int ch_append_tree(int idx, int depth, int grads, ch_t *chain){
+
+  assert(chain);
+
+  if(chain->depth == NULL)
+  {
+    mem_malloc_integers(&chain->depth, chain->N+1);
+    mem_malloc_integers(&chain->grads, chain->N+1);
+    chain->depth[0] = 0;
+    chain->grads[0] = 0;
+  }
+
+  chain->depth[idx] = depth;
+  chain->grads[idx] = grads;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  ch_append_stats
@@ -542,3 +1077,230 @@ int ch_init_stats(int idx, ch_t *chain){
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  ch_init_storage_rt
+ *
+ *****************************************************************************/
+
+static int ch_init_storage_rt(rt_t *rt, ch_t *chain, const char *chain_type){
+
+  int block_size, ring_blocks;
+  char storage[BUFSIZ];
+
+  assert(rt);
+  assert(chain);
+
+  if(!chain->storage_set && rt_string_parameter(rt, "chain_storage", storage, BUFSIZ))
+  {
+    if(ch_storage_from_name(storage, &chain->storage) == 0)
+    {
+      pe_fatal(chain->pe, "Unrecognised chain_storage \"%s\"\n", storage);
+    }
+  }
+
+  if(rt_int_parameter(rt, "chain_block_size", &block_size))
+  {
+    if(block_size < 1) pe_fatal(chain->pe, "chain_block_size must be positive\n");
+    ch_block_size_set(chain, block_size);
+  }
+
+  if(rt_int_parameter(rt, "chain_ring_blocks", &ring_blocks))
+  {
+    if(ring_blocks < 2) pe_fatal(chain->pe, "chain_ring_blocks must be at least 2\n");
+    ch_ring_blocks_set(chain, ring_blocks);
+  }
+
+  if(chain->storage == CH_STORAGE_STREAM) ch_stream_open(chain, chain_type);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_storage_from_name
+ *  returns 1 if the name matches a storage mode, 0 otherwise
+ *
+ *****************************************************************************/
+
+static int ch_storage_from_name(const char *name, ch_storage_enum_t *storage){
+
+  int n;
+
+  for(n=0; n<CH_STORAGE_MAX; n++)
+  {
+    if(strcmp(name, ch_storage_names[n]) == 0)
+    {
+      *storage = (ch_storage_enum_t) n;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_stream_open
+ *
+ *  Creates <outdir>/<chain_type>_samples_<rank>.bin sized for the whole
+ *  chain, with the samples stored row after row as in memory, and starts
+ *  the writer thread.
+ *
+ *****************************************************************************/
+
+static int ch_stream_open(ch_t *chain, const char *chain_type){
+
+  int n;
+  ch_stream_t *stream = NULL;
+
+  assert(chain);
+
+  stream = (ch_stream_t *) calloc(1, sizeof(ch_stream_t));
+  assert(stream);
+  if(stream == NULL) pe_fatal(chain->pe, "calloc(ch_stream_t) failed\n");
+
+  mem_malloc_precision(&stream->ring, chain->ring_blocks*chain->block_size*chain->dim);
+  mem_malloc_integers(&stream->full, chain->ring_blocks);
+  memset(stream->full, 0, chain->ring_blocks*sizeof(int));
+
+  rw_create_dir(chain->outdir);
+  if(chain->id > 0)
+    n = snprintf(stream->filename, FILENAME_MAX, "%s/%s_chain%d_samples_%d.bin",
+                 chain->outdir, chain_type, chain->id, pe_mpi_rank(chain->pe));
+  else
+    n = snprintf(stream->filename, FILENAME_MAX, "%s/%s_samples_%d.bin",
+                 chain->outdir, chain_type, pe_mpi_rank(chain->pe));
+  if(n < 0 || n >= FILENAME_MAX)
+    pe_fatal(chain->pe, "Chain file name in %s too long\n", chain->outdir);
+
+  stream->size = (size_t)(chain->N+1)*chain->dim*sizeof(precision);
+  stream->fd = open(stream->filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(stream->fd < 0) pe_fatal(chain->pe, "Cannot create %s\n", stream->filename);
+  if(ftruncate(stream->fd, stream->size) != 0)
+  {
+    pe_fatal(chain->pe, "Cannot allocate %s\n", stream->filename);
+  }
+
+  pthread_mutex_init(&stream->lock, NULL);
+  pthread_cond_init(&stream->cond, NULL);
+
+  chain->stream = stream;
+
+  if(pthread_create(&stream->writer, NULL, ch_stream_writer, chain) != 0)
+  {
+    pe_fatal(chain->pe, "Cannot start the chain writer thread\n");
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_stream_submit
+ *
+ *  Hands the block in slot over to the writer.
+ *
+ *****************************************************************************/
+
+static int ch_stream_submit(ch_stream_t *stream, int slot, int rows){
+
+  assert(stream);
+
+  pthread_mutex_lock(&stream->lock);
+  stream->full[slot] = rows;
+  stream->pending = 0;
+  pthread_cond_broadcast(&stream->cond);
+  pthread_mutex_unlock(&stream->lock);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ch_stream_writer
+ *
+ *  Writer thread: flushes the blocks in order and frees their slots,
+ *  until told that no more blocks will come.
+ *
+ *****************************************************************************/
+
+static void *ch_stream_writer(void *arg){
+
+  ch_t *chain = (ch_t *) arg;
+  ch_stream_t *stream = chain->stream;
+  int slot, rows;
+  size_t bytes, done;
+  ssize_t nw;
+  off_t offset;
+  char *src = NULL;
+
+  pthread_mutex_lock(&stream->lock);
+
+  for(;;)
+  {
+    slot = stream->next % chain->ring_blocks;
+    while(stream->full[slot] == 0 && !stream->done)
+    {
+      pthread_cond_wait(&stream->cond, &stream->lock);
+    }
+    if(stream->full[slot] == 0) break;
+
+    rows = stream->full[slot];
+    pthread_mutex_unlock(&stream->lock);
+
+    src = (char *) &stream->ring[(size_t)slot*chain->block_size*chain->dim];
+    bytes = (size_t)rows*chain->dim*sizeof(precision);
+    offset = (off_t)stream->next*chain->block_size*chain->dim*sizeof(precision);
+
+    for(done=0; done<bytes && stream->error == 0; done+=nw)
+    {
+      nw = pwrite(stream->fd, src+done, bytes-done, offset+done);
+      if(nw < 0) stream->error = errno;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    stream->full[slot] = 0;
+    stream->next++;
+    pthread_cond_broadcast(&stream->cond);
+  }
+
+  pthread_mutex_unlock(&stream->lock);
+
+  return NULL;
+}
+
+/*****************************************************************************
+ *
+ *  ch_grow_states
+ *
+ *  Doubles the states of a weighted chain, up to one per step.
+ *
+ *****************************************************************************/
+
+static int ch_grow_states(ch_t *chain){
+
+  int capacity;
+  precision *samples = NULL;
+  int *weights = NULL;
+
+  assert(chain);
+
+  capacity = (chain->capacity > 0) ? 2*chain->capacity : CHAIN_STATES_DEFAULT;
+  if(capacity > chain->N+1) capacity = chain->N+1;
+
+  samples = (precision *) realloc(chain->samples,
+                                  (size_t)capacity*chain->dim*sizeof(precision));
+  weights = (int *) realloc(chain->weights, (size_t)capacity*sizeof(int));
+  if(samples == NULL || weights == NULL)
+  {
+    pe_fatal(chain->pe, "realloc(weighted chain) failed\n");
+  }
+
+  chain->samples = samples;
+  chain->weights = weights;
+  chain->capacity = capacity;
+
+  return 0;
+}
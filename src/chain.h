@@ -7,6 +7,14 @@
 
 typedef struct ch_s ch_t;
 
+/* Samples held in memory for the whole run, streamed to a file through
+ * a ring of blocks and mapped back once the chain is complete, or held
+ * in memory as distinct states with the number of steps spent in each */
+typedef enum {CH_STORAGE_MEMORY = 0,
+              CH_STORAGE_STREAM,
+              CH_STORAGE_WEIGHTED,
+              CH_STORAGE_MAX} ch_storage_enum_t;
+
 int ch_create(pe_t *pe, ch_t **pchain);
 int ch_free(ch_t *chain);
 
@@ -15,24 +23,39 @@ int ch_init_chain_rt(rt_t *rt, ch_t *chain);
 int ch_burn_info(pe_t *pe, ch_t *burn);
 int ch_chain_info(pe_t *pe, ch_t *chain);
 int ch_write_files(ch_t *chain, const char *chain_type);
+int ch_flush(ch_t *chain);
 
 int ch_dim_set(ch_t *chain, int dim);
 int ch_N_set(ch_t *chain, int N);
 int ch_outfreq_set(ch_t *chain, int outfreq);
 int ch_outdir_set(ch_t *chain, const char *outdir);
+int ch_id_set(ch_t *chain, int id);
+int ch_storage_set(ch_t *chain, ch_storage_enum_t storage);
+int ch_block_size_set(ch_t *chain, int block_size);
+int ch_ring_blocks_set(ch_t *chain, int ring_blocks);
 
 int ch_dim(ch_t *chain, int *dim);
 int ch_N(ch_t *chain, int *N);
 int ch_outfreq(ch_t *chain, int *outfreq);
 int ch_outdir(ch_t *chain, char *outdir);
+int ch_storage(ch_t *chain, ch_storage_enum_t *storage);
+int ch_block_size(ch_t *chain, int *block_size);
+int ch_ring_blocks(ch_t *chain, int *ring_blocks);
 int ch_samples(ch_t *chain, precision **psamples);
 int ch_probability(ch_t *chain, precision **pprobability);
 int ch_ratio(ch_t *chain, precision **pratio);
+int ch_acceptance_rate(ch_t *chain, precision *rate);
+int ch_split_rhat(ch_t **chains, int nchains, precision *rhat);
 int ch_accepted(ch_t *chain, int **paccepted);
+int ch_tree(ch_t *chain, int **pdepth, int **pgrads);
+int ch_weights(ch_t *chain, int **pweights);
+int ch_nstates(ch_t *chain, int *nstates);
 
 int ch_append_probability(int idx, precision probability, ch_t *chain);
 int ch_append_sample(int idx, precision *sample, ch_t *chain);
+int ch_repeat_sample(int idx, precision *sample, ch_t *chain);
 int ch_append_stats(int idx, int accepted, ch_t *chain);
+int ch_append_tree(int idx, int depth, int grads, ch_t *chain);
 int ch_init_stats(int idx, ch_t *chain);
 
 #endif // __CHAIN_H__
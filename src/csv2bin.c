@@ -0,0 +1,196 @@
+/*****************************************************************************
+ *
+ *  csv2bin.c
+ *
+ *  Converts a CSV dataset (one row per line, comma separated) into the
+ *  binary format read with "data_format BINARY" (see data_binary.h).
+ *
+ *  csv2bin.exe [-t double|float|int] [-s header_lines] input.csv output.bin
+ *
+ *  The number of rows and columns is taken from the file. Datapoints
+ *  should be stored with the precision of the mcmc build (double, or
+ *  float with -D_FLOAT_) and labels as int, so that they are mapped
+ *  without conversion.
+ *
+ *****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "data_binary.h"
+
+static void csv2bin_usage(const char *exe);
+static int csv2bin_dtype_from_name(const char *name, uint32_t *dtype);
+static int csv2bin_write_value(FILE *fp, uint32_t dtype, const char *tok);
+
+/*****************************************************************************
+ *
+ *  main
+ *
+ *****************************************************************************/
+
+int main(int argc, char **argv){
+
+  int n, skip = 1;
+  uint32_t dtype = DATA_BIN_FLOAT64;
+  uint64_t N = 0, dim = 0, ncols;
+  char *line = NULL, *tok = NULL;
+  size_t len = 0;
+  FILE *in = NULL, *out = NULL;
+  data_bin_header_t header;
+
+  for(n=1; n<argc-2; n++)
+  {
+    if(strcmp(argv[n], "-t") == 0 && n+1 < argc-2)
+    {
+      if(csv2bin_dtype_from_name(argv[++n], &dtype) == 0) csv2bin_usage(argv[0]);
+    }
+    else if(strcmp(argv[n], "-s") == 0 && n+1 < argc-2)
+    {
+      skip = atoi(argv[++n]);
+    }
+    else
+    {
+      csv2bin_usage(argv[0]);
+    }
+  }
+  if(argc < 3) csv2bin_usage(argv[0]);
+
+  in = fopen(argv[argc-2], "r");
+  if(in == NULL)
+  {
+    fprintf(stderr, "Cannot open %s\n", argv[argc-2]);
+    return 1;
+  }
+
+  out = fopen(argv[argc-1], "wb");
+  if(out == NULL)
+  {
+    fprintf(stderr, "Cannot create %s\n", argv[argc-1]);
+    return 1;
+  }
+
+  /* Header is written again once the number of rows is known */
+  memset(&header, 0, sizeof(data_bin_header_t));
+  memcpy(header.magic, DATA_BIN_MAGIC, sizeof(DATA_BIN_MAGIC));
+  header.version = DATA_BIN_VERSION;
+  header.endian = DATA_BIN_ENDIAN;
+  header.dtype = dtype;
+  header.offset = sizeof(data_bin_header_t);
+  fwrite(&header, sizeof(data_bin_header_t), 1, out);
+
+  for(n=0; n<skip; n++)
+  {
+    if(getline(&line, &len, in) < 0) break;
+  }
+
+  while(getline(&line, &len, in) > 0)
+  {
+    if(line[0] == '\n' || line[0] == '\r') continue;
+
+    ncols = 0;
+    for(tok = strtok(line, ",\r\n"); tok != NULL; tok = strtok(NULL, ",\r\n"))
+    {
+      csv2bin_write_value(out, dtype, tok);
+      ncols++;
+    }
+
+    if(N == 0) dim = ncols;
+    if(ncols != dim)
+    {
+      fprintf(stderr, "Row %llu has %llu values, expected %llu\n",
+              (unsigned long long) N+1, (unsigned long long) ncols,
+              (unsigned long long) dim);
+      return 1;
+    }
+    N++;
+  }
+
+  header.N = N;
+  header.dim = dim;
+  header.stride = dim * data_bin_dtype_size[dtype];
+
+  fseek(out, 0, SEEK_SET);
+  fwrite(&header, sizeof(data_bin_header_t), 1, out);
+
+  free(line);
+  fclose(in);
+  if(fclose(out) != 0)
+  {
+    fprintf(stderr, "Cannot write %s\n", argv[argc-1]);
+    return 1;
+  }
+
+  printf("%30s\t%s (%llu x %llu)\n", "Wrote:", argv[argc-1],
+         (unsigned long long) N, (unsigned long long) dim);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  csv2bin_usage
+ *
+ *****************************************************************************/
+
+static void csv2bin_usage(const char *exe){
+
+  fprintf(stderr, "Usage: %s [-t double|float|int] [-s header_lines] "
+                  "input.csv output.bin\n", exe);
+  exit(1);
+}
+
+/*****************************************************************************
+ *
+ *  csv2bin_dtype_from_name
+ *
+ *****************************************************************************/
+
+static int csv2bin_dtype_from_name(const char *name, uint32_t *dtype){
+
+  if(strcmp(name, "int") == 0)
+    *dtype = DATA_BIN_INT32;
+  else if(strcmp(name, "float") == 0)
+    *dtype = DATA_BIN_FLOAT32;
+  else if(strcmp(name, "double") == 0)
+    *dtype = DATA_BIN_FLOAT64;
+  else
+    return 0;
+
+  return 1;
+}
+
+/*****************************************************************************
+ *
+ *  csv2bin_write_value
+ *
+ *****************************************************************************/
+
+static int csv2bin_write_value(FILE *fp, uint32_t dtype, const char *tok){
+
+  int32_t ivalue;
+  float fvalue;
+  double dvalue;
+
+  if(dtype == DATA_BIN_INT32)
+  {
+    ivalue = (int32_t) atoi(tok);
+    fwrite(&ivalue, sizeof(int32_t), 1, fp);
+  }
+  else if(dtype == DATA_BIN_FLOAT32)
+  {
+    fvalue = (float) atof(tok);
+    fwrite(&fvalue, sizeof(float), 1, fp);
+  }
+  else
+  {
+    dvalue = atof(tok);
+    fwrite(&dvalue, sizeof(double), 1, fp);
+  }
+
+  return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef __DATA_BINARY_H__
+#define __DATA_BINARY_H__
+
+#include <stdint.h>
+
+/*****************************************************************************
+ *
+ *  data_binary.h
+ *
+ *  Layout of the binary dataset files (data_format BINARY).
+ *
+ *  A file holds one row-major matrix: a fixed 64 byte header followed,
+ *  at byte "offset", by N rows of "dim" values, "stride" bytes apart.
+ *  The values are stored in the byte order of the writing host, which
+ *  the reader detects from the "endian" marker.
+ *
+ *  Files are produced from the CSV datasets by csv2bin (src/csv2bin.c).
+ *
+ *****************************************************************************/
+
+#define DATA_BIN_MAGIC   "MCMCBIN"
+#define DATA_BIN_VERSION 1
+#define DATA_BIN_ENDIAN  0x01020304
+#define DATA_BIN_ALIGN   64
+
+typedef enum {DATA_BIN_INT32 = 0,
+              DATA_BIN_FLOAT32,
+              DATA_BIN_FLOAT64,
+              DATA_BIN_DTYPE_MAX} data_bin_dtype_enum_t;
+
+typedef struct data_bin_header_s{
+  char magic[8];       /* DATA_BIN_MAGIC */
+  uint32_t version;    /* DATA_BIN_VERSION */
+  uint32_t endian;     /* DATA_BIN_ENDIAN as written by the host */
+  uint32_t dtype;      /* data_bin_dtype_enum_t */
+  uint32_t reserved;
+  uint64_t N;          /* Number of rows */
+  uint64_t dim;        /* Values per row */
+  uint64_t stride;     /* Bytes between the start of consecutive rows */
+  uint64_t offset;     /* Bytes from the start of the file to the first row */
+  uint8_t pad[8];
+} data_bin_header_t;
+
+static const uint32_t data_bin_dtype_size[DATA_BIN_DTYPE_MAX] = {4, 4, 8};
+
+#endif // __DATA_BINARY_H__
@@ -3,13 +3,24 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "data_input.h"
+#include "data_binary.h"
 #include "memory.h"
 #include "timer.h"
 
 
 #define SKIP_HEADER 1
+#define INDEX_CHUNK (1 << 20)   /* Bytes scanned at a time by the line index */
+#define DELIMITER ','
+#define TOKEN_MAX 64            /* Longest value handed to the strtod fallback */
 
 struct data_s{
   pe_t *pe;               /* Parallel Environment */
@@ -17,8 +28,17 @@ struct data_s{
   int dimx;               /* Datapoints Dimensionality */
   int dimy;               /* Labels Dimensionality */
   int N;                  /* Number of Datapoints */
+  int shard;              /* Hold only the rows of this process */
+  int low;                /* Global index of the first local row */
+  int Nlocal;             /* Number of local rows */
   precision *x;           /* Datapoints */
   int *y;                 /* Labels */
+  int fold;               /* Labels folded into the datapoints, x_n <- y_n x_n */
+  data_format_enum_t format;  /* Format of the input files */
+  void *map_x;            /* Mapping backing x, binary files only */
+  size_t map_x_size;
+  void *map_y;            /* Mapping backing y, binary files only */
+  size_t map_y_size;
   char fx[FILENAME_MAX];  /* Datapoints filename */
   char fy[FILENAME_MAX];  /* Lablels filename */
   int rank;
@@ -26,12 +46,28 @@ struct data_s{
   int nthreads;
 };
 
-static int data_csvread(pe_t *pe, char *filename, int rowSz, int colSz, int skip_header,
-                    const char *delimiter, const char *datatype, void *data);
-static void data_rmheader(char* line, FILE *fp, int skip_num);
+static int data_csvread(pe_t *pe, data_t *data, char *filename, int dim,
+                        long begin, long end, const char *datatype, void *dest);
+static int data_csvoffset(pe_t *pe, data_t *data, char *filename, long *begin,
+                          long *end);
+static const char *data_csvchunk(const char *map, long begin, long end, int t, int nt);
+static int data_csvcount(const char *lo, const char *hi);
+static const char *data_csvrow(const char *p, const char *hi, int dim, int is_int,
+                               void *dest, int row, int *ok);
+static double data_parse_double(const char **pp, const char *hi);
+static int data_parse_int(const char **pp, const char *hi);
+static int data_csvindex(pe_t *pe, char *filename, int skip_header, int nrows,
+                         const int *rows, long *offsets);
+static int data_local_rows(data_t *data);
 static int data_allocate_x(data_t *data);
 static int data_allocate_y(data_t *data);
-static int convert_tok(const char *tok, const char *datatype, void *data, int pos);
+static int data_fold_labels(data_t *data);
+static int data_binread(pe_t *pe, data_t *data, char *filename, int dim,
+                        const char *datatype, void **pdata, void **pmap,
+                        size_t *pmap_size);
+static int data_format_from_name(const char *name, data_format_enum_t *format);
+
+static const char *data_format_names[DATA_FORMAT_MAX] = {"CSV", "BINARY"};
 
 void data_create_device_x(data_t *data);
 void data_create_device_y(data_t *data);
@@ -69,6 +105,9 @@ int data_create_train(pe_t *pe, dc_t *dc, data_t **pdata){
   data_N_set(data, N_TRAIN_DEFAULT);
   data_fx_set(data, TRAIN_X_DEFAULT);
   data_fy_set(data, TRAIN_Y_DEFAULT);
+  data_fold_set(data, FOLD_LABELS_DEFAULT);
+  data_shard_set(data, 1);
+  data_format_from_name(DATA_FORMAT_DEFAULT, &data->format);
 
   *pdata = data;
 
@@ -104,6 +143,7 @@ int data_create_test(pe_t *pe, dc_t *dc, data_t **pdata){
    data_N_set(data, N_TEST_DEFAULT);
    data_fx_set(data, TEST_X_DEFAULT);
    data_fy_set(data, TEST_Y_DEFAULT);
+   data_format_from_name(DATA_FORMAT_DEFAULT, &data->format);
 
    *pdata = data;
 
@@ -121,7 +161,18 @@ int data_free(data_t *data){
    assert(data);
 
    data_free_device_x(data);
-   data_free_device_y(data);
+   if(!data->fold) data_free_device_y(data);
+
+   if(data->map_x)
+   {
+     munmap(data->map_x, data->map_x_size);
+     data->x = NULL;
+   }
+   if(data->map_y)
+   {
+     munmap(data->map_y, data->map_y_size);
+     data->y = NULL;
+   }
 
    mem_free((void**)&data->x);
    mem_free((void**)&data->y);
@@ -139,8 +190,8 @@ int data_free(data_t *data){
 
 int data_init_train_rt(pe_t *pe, rt_t *rt, data_t *train){
 
-  int dimx, dimy, N, nprocs, nthreads;
-  char x[FILENAME_MAX], y[FILENAME_MAX];
+  int dimx, dimy, N, nprocs, nthreads, fold;
+  char x[FILENAME_MAX], y[FILENAME_MAX], format[BUFSIZ];
 
   assert(rt);
   assert(train);
@@ -170,6 +221,11 @@ int data_init_train_rt(pe_t *pe, rt_t *rt, data_t *train){
     data_fy_set(train, y);
   }
 
+  if(rt_int_parameter(rt, "train_fold_labels", &fold))
+  {
+    data_fold_set(train, fold);
+  }
+
   if(rt_int_parameter(rt, "nprocs", &nprocs))
   {
     data_nprocs_set(train, nprocs);
@@ -180,8 +236,22 @@ int data_init_train_rt(pe_t *pe, rt_t *rt, data_t *train){
     data_nthreads_set(train, nthreads);
   }
 
-  data_allocate_x(train);
-  data_allocate_y(train);
+  if(rt_string_parameter(rt, "data_format", format, BUFSIZ))
+  {
+    if(data_format_from_name(format, &train->format) == 0)
+    {
+      pe_fatal(pe, "Unrecognised data_format \"%s\"\n", format);
+    }
+  }
+
+  data_local_rows(train);
+
+  /* Binary files are mapped, not copied, when they are read */
+  if(train->format == DATA_FORMAT_CSV)
+  {
+    data_allocate_x(train);
+    data_allocate_y(train);
+  }
 
   return 0;
 }
@@ -195,7 +265,7 @@ int data_init_train_rt(pe_t *pe, rt_t *rt, data_t *train){
 int data_init_test_rt(pe_t *pe, rt_t *rt, data_t *test){
 
   int dimx, dimy, N, nprocs, nthreads;
-  char x[FILENAME_MAX], y[FILENAME_MAX];
+  char x[FILENAME_MAX], y[FILENAME_MAX], format[BUFSIZ];
 
   assert(rt);
   assert(test);
@@ -235,8 +305,22 @@ int data_init_test_rt(pe_t *pe, rt_t *rt, data_t *test){
     data_nthreads_set(test, nthreads);
   }
 
-  data_allocate_x(test);
-  data_allocate_y(test);
+  if(rt_string_parameter(rt, "data_format", format, BUFSIZ))
+  {
+    if(data_format_from_name(format, &test->format) == 0)
+    {
+      pe_fatal(pe, "Unrecognised data_format \"%s\"\n", format);
+    }
+  }
+
+  data_local_rows(test);
+
+  /* Binary files are mapped, not copied, when they are read */
+  if(test->format == DATA_FORMAT_CSV)
+  {
+    data_allocate_x(test);
+    data_allocate_y(test);
+  }
 
   return 0;
 }
@@ -244,21 +328,54 @@ int data_init_test_rt(pe_t *pe, rt_t *rt, data_t *test){
 /*****************************************************************************
 *
 *  data_read_file
-*  at the moment each process reads the entire dataset
+*  a sharded dataset reads (and stores) only the rows of this process,
+*  found through a byte-offset line index of the CSV files
+*  with folded labels only the datapoints are copied to the device
 *
 *****************************************************************************/
 
 int data_read_file(pe_t *pe, data_t *data){
 
+  long begin, end;
+
   assert(data);
-  assert(data->x);
-  assert(data->y);
 
-  data_csvread(pe, data->fx, data->dimx, data->N, SKIP_HEADER, ",", "precision", data->x);
-  data_update_device_x(data);
+  if(data->format == DATA_FORMAT_BINARY)
+  {
+    /* Arrays allocated for a CSV read are replaced by the mapping */
+    if(data->map_x == NULL) mem_free((void**)&data->x);
+    if(data->map_y == NULL) mem_free((void**)&data->y);
+
+    data_binread(pe, data, data->fx, data->dimx, "precision",
+                 (void **) &data->x, &data->map_x, &data->map_x_size);
+    data_binread(pe, data, data->fy, data->dimy, "int",
+                 (void **) &data->y, &data->map_y, &data->map_y_size);
+
+    data_create_device_x(data);
+    if(!data->fold) data_create_device_y(data);
+  }
+  else
+  {
+    assert(data->x);
+    assert(data->y);
+
+    data_csvoffset(pe, data, data->fx, &begin, &end);
+    data_csvread(pe, data, data->fx, data->dimx, begin, end, "precision", data->x);
 
-  data_csvread(pe, data->fy, data->dimy, data->N, SKIP_HEADER, ",", "int", data->y);
-  data_update_device_y(data);
+    data_csvoffset(pe, data, data->fy, &begin, &end);
+    data_csvread(pe, data, data->fy, data->dimy, begin, end, "int", data->y);
+  }
+
+  if(data->fold)
+  {
+    data_fold_labels(data);
+  }
+  else
+  {
+    data_update_device_y(data);
+  }
+
+  data_update_device_x(data);
 
   return 0;
 }
@@ -283,7 +400,7 @@ void data_create_device_x(data_t *data){
   {
     int tid = omp_get_thread_num();
     int size = thi[tid] - tlow[tid];
-    precision *REST x = &data->x[tlow[tid]*dimx];
+    precision *REST x = &data->x[(tlow[tid]-data->low)*dimx];
 
     int gpuid = tid + nthreads*(data->rank%data->nprocs);
     #pragma acc set device_num(gpuid) device_type(acc_device_nvidia)
@@ -313,7 +430,7 @@ void data_create_device_y(data_t *data){
   {
     int tid = omp_get_thread_num();
     int size = thi[tid] - tlow[tid];
-    int *REST y = &data->y[tlow[tid]*dimy];
+    int *REST y = &data->y[(tlow[tid]-data->low)*dimy];
 
     int gpuid = tid + nthreads*(data->rank%data->nprocs);
     #pragma acc set device_num(gpuid) device_type(acc_device_nvidia)
@@ -343,7 +460,7 @@ void data_update_device_x(data_t *data){
   {
     int tid = omp_get_thread_num();
     int size = thi[tid] - tlow[tid];
-    precision *REST x = &data->x[tlow[tid]*dimx];
+    precision *REST x = &data->x[(tlow[tid]-data->low)*dimx];
 
     int gpuid = tid + nthreads*(data->rank%data->nprocs);
     #pragma acc set device_num(gpuid) device_type(acc_device_nvidia)
@@ -373,7 +490,7 @@ void data_update_device_y(data_t *data){
   {
     int tid = omp_get_thread_num();
     int size = thi[tid] - tlow[tid];
-    int *REST y = &data->y[tlow[tid]*dimy];
+    int *REST y = &data->y[(tlow[tid]-data->low)*dimy];
 
     int gpuid = tid + nthreads*(data->rank%data->nprocs);
     #pragma acc set device_num(gpuid) device_type(acc_device_nvidia)
@@ -401,7 +518,7 @@ void data_free_device_x(data_t *data){
   {
     int tid = omp_get_thread_num();
     int size = thi[tid] - tlow[tid];
-    precision *REST x = &data->x[tlow[tid]*dimx];
+    precision *REST x = &data->x[(tlow[tid]-data->low)*dimx];
 
     int gpuid = tid + nthreads*(data->rank%data->nprocs);
     #pragma acc set device_num(gpuid) device_type(acc_device_nvidia)
@@ -428,7 +545,7 @@ void data_free_device_y(data_t *data){
   {
     int tid = omp_get_thread_num();
     int size = thi[tid] - tlow[tid];
-    int *REST y = &data->y[tlow[tid]*dimy];
+    int *REST y = &data->y[(tlow[tid]-data->low)*dimy];
 
     int gpuid = tid + nthreads*(data->rank%data->nprocs);
     #pragma acc set device_num(gpuid) device_type(acc_device_nvidia)
@@ -542,6 +659,55 @@ int data_y_set(data_t *data, int *y){
  return 0;
 }
 
+/*****************************************************************************
+*
+*  data_fold_set
+*  must be set before the runtime init allocates the arrays
+*
+*****************************************************************************/
+
+int data_fold_set(data_t *data, int fold){
+
+ assert(data);
+
+ data->fold = fold;
+
+ return 0;
+}
+
+/*****************************************************************************
+*
+*  data_shard_set
+*  must be set before the runtime init allocates the arrays
+*
+*****************************************************************************/
+
+int data_shard_set(data_t *data, int shard){
+
+ assert(data);
+
+ data->shard = shard;
+
+ return 0;
+}
+
+/*****************************************************************************
+*
+*  data_format_set
+*  must be set before the runtime init allocates the arrays
+*
+*****************************************************************************/
+
+int data_format_set(data_t *data, data_format_enum_t format){
+
+ assert(data);
+ assert(format < DATA_FORMAT_MAX);
+
+ data->format = format;
+
+ return 0;
+}
+
 /*****************************************************************************
 *
 *  data_nprocs_set
@@ -677,6 +843,82 @@ int data_y(data_t *data, int **py){
  return 0;
 }
 
+/*****************************************************************************
+*
+*  data_fold
+*
+*****************************************************************************/
+
+int data_fold(data_t *data, int *fold){
+
+ assert(data);
+
+ *fold = data->fold;
+
+ return 0;
+}
+
+/*****************************************************************************
+*
+*  data_shard
+*
+*****************************************************************************/
+
+int data_shard(data_t *data, int *shard){
+
+ assert(data);
+
+ *shard = data->shard;
+
+ return 0;
+}
+
+/*****************************************************************************
+*
+*  data_low
+*  global index of the first row held by this process
+*
+*****************************************************************************/
+
+int data_low(data_t *data, int *low){
+
+ assert(data);
+
+ *low = data->low;
+
+ return 0;
+}
+
+/*****************************************************************************
+*
+*  data_Nlocal
+*
+*****************************************************************************/
+
+int data_Nlocal(data_t *data, int *Nlocal){
+
+ assert(data);
+
+ *Nlocal = data->Nlocal;
+
+ return 0;
+}
+
+/*****************************************************************************
+*
+*  data_format
+*
+*****************************************************************************/
+
+int data_format(data_t *data, data_format_enum_t *format){
+
+ assert(data);
+
+ *format = data->format;
+
+ return 0;
+}
+
 /*****************************************************************************
 *
 *  data_dc_set
@@ -735,6 +977,9 @@ int data_input_train_info(pe_t *pe, data_t *train){
  pe_info(pe, "%30s\t\t%d\n", "Labels Dimensionality:", dimy);
  pe_info(pe, "%30s\t\t%s\n", "Datapoints Filename:", fx);
  pe_info(pe, "%30s\t\t%s\n", "Labels Filename:", fy);
+ pe_info(pe, "%30s\t\t%s\n", "Data Format:", data_format_names[train->format]);
+ pe_info(pe, "%30s\t\t%s\n", "Sharded over Processes:", (train->shard) ? "True" : "False");
+ pe_info(pe, "%30s\t\t%s\n", "Folded Labels:", (train->fold) ? "True" : "False");
 
  return 0;
 }
@@ -767,6 +1012,8 @@ int data_input_test_info(pe_t *pe, data_t *test){
  pe_info(pe, "%30s\t\t%d\n", "Labels Dimensionality:", dimy);
  pe_info(pe, "%30s\t\t%s\n", "Datapoints Filename:", fx);
  pe_info(pe, "%30s\t\t%s\n", "Labels Filename:", fy);
+ pe_info(pe, "%30s\t\t%s\n", "Data Format:", data_format_names[test->format]);
+ pe_info(pe, "%30s\t\t%s\n", "Sharded over Processes:", (test->shard) ? "True" : "False");
 
  return 0;
 }
@@ -775,62 +1022,434 @@ int data_input_test_info(pe_t *pe, data_t *test){
  *
  *  data_csvread
  *
+ *  Parses the local rows, held in bytes [begin, end) of the file, into
+ *  dest. The file is mapped and the byte range split at line boundaries
+ *  between the threads: each thread counts the rows of its chunk, the
+ *  counts give the first row of every chunk and the chunks are then
+ *  parsed in parallel, straight into the typed destination. There is no
+ *  limit on the length of a line.
+ *
  *****************************************************************************/
 
-static int data_csvread(pe_t *pe, char *filename, int rowSz, int colSz, int skip_header,
-                    const char *delimiter, const char *datatype, void *data){
+static int data_csvread(pe_t *pe, data_t *data, char *filename, int dim,
+                        long begin, long end, const char *datatype, void *dest){
 
-  FILE* fp = NULL;
-  char line[BUFSIZ];
-  const char *tok;
-  int i,j;
+  int fd, t, nchunks = 1;
+  int nrows = data->Nlocal;
+  int nthreads = data->nthreads;
+  int is_int = (strcmp(datatype, "int") == 0);
+  int ok = 1;
+  int *count = NULL;
+  char *map = NULL;
+  struct stat st;
+  double elapsed;
 
-  assert(data);
+  assert(dest);
 
   pe_info(pe, "%30s\t%50s", "Reading data from:", filename);
+  elapsed = MPI_Wtime();
+
+  fd = open(filename, O_RDONLY);
+  if(fd < 0) pe_fatal(pe, "\nCannot open %s\n", filename);
+  if(fstat(fd, &st) != 0) pe_fatal(pe, "\nCannot stat %s\n", filename);
+  if(end > begin)
+  {
+    map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) pe_fatal(pe, "\nmmap(%s) failed\n", filename);
+  }
+  close(fd);
+
+  /* count[t+1] rows in chunk t, then (prefix sum) count[t] first row of t */
+  mem_malloc_integers(&count, nthreads+1);
+  count[0] = 0;
+
+  #pragma omp parallel default(shared) private(t) num_threads(nthreads) reduction(&&:ok)
+  {
+    int tid = omp_get_thread_num();
+    int nt = omp_get_num_threads();
+    const char *lo = data_csvchunk(map, begin, end, tid, nt);
+    const char *hi = data_csvchunk(map, begin, end, tid+1, nt);
+    const char *p = lo;
+    int row;
+
+    count[tid+1] = data_csvcount(lo, hi);
+
+    #pragma omp barrier
+    #pragma omp single
+    {
+      for(t=0; t<nt; t++) count[t+1] += count[t];
+      nchunks = nt;
+    }
+
+    row = count[tid];
+    while(p < hi && row < nrows)
+    {
+      p = data_csvrow(p, hi, dim, is_int, dest, row, &ok);
+      row++;
+    }
+  }
+
+  t = count[nchunks];
+  mem_free((void**)&count);
+  if(map) munmap(map, st.st_size);
+
+  if(t != nrows)
+  {
+    pe_fatal(pe, "\n%s: expected %d rows, found %d\n", filename, nrows, t);
+  }
+  if(!ok)
+  {
+    pe_fatal(pe, "\n%s: a row has fewer than %d values\n", filename, dim);
+  }
+
+  elapsed = MPI_Wtime() - elapsed;
+  pe_info(pe, "\tDone (%.1f MB/s)\n",
+          (end - begin) / (1.0e6 * ((elapsed > 0.0) ? elapsed : 1.0e-9)));
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  data_csvchunk
+ *
+ *  Start of chunk t of nt: the first line starting at or after the t-th
+ *  equal share of [begin, end).
+ *
+ *****************************************************************************/
+
+static const char *data_csvchunk(const char *map, long begin, long end, int t, int nt){
+
+  long pos = begin + (long)((double)(end - begin) * t / nt);
+  const char *p = NULL;
+
+  if(t == 0 || pos <= begin) return map + begin;
+  if(t >= nt || pos >= end) return map + end;
+
+  p = memchr(map + pos - 1, '\n', end - pos + 1);
+
+  return (p) ? p + 1 : map + end;
+}
+
+/*****************************************************************************
+ *
+ *  data_csvcount
+ *
+ *  Rows in [lo, hi); the last one may lack its newline.
+ *
+ *****************************************************************************/
+
+static int data_csvcount(const char *lo, const char *hi){
+
+  int n = 0;
+  const char *p = lo;
+
+  while(p < hi && (p = memchr(p, '\n', hi - p)) != NULL)
+  {
+    n++;
+    p++;
+  }
+  if(hi > lo && hi[-1] != '\n') n++;
+
+  return n;
+}
+
+/*****************************************************************************
+ *
+ *  data_csvrow
+ *
+ *  Parses dim values of the row starting at p into row "row" of dest.
+ *  Values past dim are ignored. Returns the start of the next row.
+ *
+ *****************************************************************************/
+
+static const char *data_csvrow(const char *p, const char *hi, int dim, int is_int,
+                               void *dest, int row, int *ok){
+
+  int j;
+  const char *eol = memchr(p, '\n', hi - p);
+
+  if(eol == NULL) eol = hi;
+
+  for(j=0; j<dim; j++)
+  {
+    if(j > 0)
+    {
+      if(p < eol && *p == DELIMITER)
+      {
+        p++;
+      }
+      else
+      {
+        *ok = 0;
+        break;
+      }
+    }
+
+    if(is_int)
+      ((int *) dest)[(long)row*dim+j] = data_parse_int(&p, eol);
+    else
+      ((precision *) dest)[(long)row*dim+j] = (precision) data_parse_double(&p, eol);
+  }
+
+  return (eol < hi) ? eol + 1 : hi;
+}
+
+/*****************************************************************************
+ *
+ *  data_parse_double
+ *
+ *  Locale-free decimal parser, stops at the first character that is not
+ *  part of the number. Up to 19 significant digits are kept as an integer
+ *  m, and the value is m * 10^e. It is exact when m < 2^53 and |e| <= 22;
+ *  otherwise the scaling is done in long double. Anything else (nan, inf,
+ *  hex) goes through strtod.
+ *
+ *****************************************************************************/
+
+static double data_parse_double(const char **pp, const char *hi){
+
+  static const double pow10[23] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+                                   1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14,
+                                   1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21,
+                                   1e22};
+  const char *p = *pp;
+  unsigned long long m = 0;
+  int neg = 0, digits = 0, e = 0, en = 0, eneg = 0;
+  long double v;
+  double value;
+
+  while(p < hi && (*p == ' ' || *p == '\t')) p++;
+  if(p < hi && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+
+  for(; p < hi && *p >= '0' && *p <= '9'; p++, digits++)
+  {
+    if(m < 1000000000000000000ULL) m = 10*m + (*p - '0');
+    else e++;
+  }
+  if(p < hi && *p == '.')
+  {
+    for(p++; p < hi && *p >= '0' && *p <= '9'; p++, digits++)
+    {
+      if(m < 1000000000000000000ULL)
+      {
+        m = 10*m + (*p - '0');
+        e--;
+      }
+    }
+  }
+
+  if(digits == 0)
+  {
+    /* Not a plain decimal number */
+    char token[TOKEN_MAX];
+    char *tail = NULL;
+    size_t len = hi - *pp;
+    if(len >= TOKEN_MAX) len = TOKEN_MAX - 1;
+    memcpy(token, *pp, len);
+    token[len] = '\0';
+    value = strtod(token, &tail);
+    *pp += tail - token;
+    return value;
+  }
+
+  if(p < hi && (*p == 'e' || *p == 'E'))
+  {
+    const char *q = p + 1;
+    if(q < hi && (*q == '-' || *q == '+')) eneg = (*q++ == '-');
+    if(q < hi && *q >= '0' && *q <= '9')
+    {
+      for(; q < hi && *q >= '0' && *q <= '9'; q++)
+      {
+        if(en < 100000) en = 10*en + (*q - '0');
+      }
+      e += (eneg) ? -en : en;
+      p = q;
+    }
+  }
+
+  *pp = p;
+
+  if(m == 0)
+  {
+    value = 0.0;
+  }
+  else if(m < (1ULL << 53) && e >= -22 && e <= 22)
+  {
+    value = (e >= 0) ? (double) m * pow10[e] : (double) m / pow10[-e];
+  }
+  else
+  {
+    v = (long double) m;
+    if(e >= 0) v *= powl(10.0L, e);
+    else v /= powl(10.0L, -e);
+    value = (double) v;
+  }
+
+  return (neg) ? -value : value;
+}
+
+/*****************************************************************************
+ *
+ *  data_parse_int
+ *
+ *  Integer part of a decimal value, so labels written as -1.000 read as -1.
+ *
+ *****************************************************************************/
+
+static int data_parse_int(const char **pp, const char *hi){
+
+  const char *p = *pp;
+  int neg = 0, value = 0;
+
+  while(p < hi && (*p == ' ' || *p == '\t')) p++;
+  if(p < hi && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+
+  for(; p < hi && *p >= '0' && *p <= '9'; p++) value = 10*value + (*p - '0');
+
+  /* Skip the fraction and exponent */
+  while(p < hi && *p != DELIMITER && *p != '\n' && *p != '\r') p++;
+
+  *pp = p;
+
+  return (neg) ? -value : value;
+}
+
+/*****************************************************************************
+ *
+ *  data_csvoffset
+ *
+ *  Byte range [begin, end) of the local rows of a CSV file. Rank 0 builds
+ *  the line index for the first and last row of every process and
+ *  broadcasts it, so the file is scanned once and only up to the last of
+ *  those rows.
+ *
+ *****************************************************************************/
+
+static int data_csvoffset(pe_t *pe, data_t *data, char *filename, long *begin,
+                          long *end){
+
+  int size, rank;
+  int bounds[2];
+  int *rows = NULL;
+  long *offsets = NULL;
+  MPI_Comm comm;
+
+  assert(data);
+
+  pe_mpi_comm(pe, &comm);
+  size = pe_mpi_size(pe);
+  rank = pe_mpi_rank(pe);
+
+  mem_malloc_integers(&rows, 2*size);
+  offsets = (long *) malloc(2*size*sizeof(long));
+  assert(offsets);
+
+  bounds[0] = data->low;
+  bounds[1] = data->low + data->Nlocal;
+  MPI_Allgather(bounds, 2, MPI_INT, rows, 2, MPI_INT, comm);
+  if(rank == 0) data_csvindex(pe, filename, SKIP_HEADER, 2*size, rows, offsets);
+  MPI_Bcast(offsets, 2*size, MPI_LONG, 0, comm);
+
+  *begin = offsets[2*rank];
+  *end = offsets[2*rank+1];
+
+  mem_free((void**)&rows);
+  mem_free((void**)&offsets);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  data_csvindex
+ *
+ *  Byte offsets of the given (non-decreasing) data rows, counting rows
+ *  after the skip_header header lines. The file is read in INDEX_CHUNK
+ *  blocks and only the newlines are looked at. The row after a last line
+ *  without a newline starts at the end of the file.
+ *
+ *****************************************************************************/
+
+static int data_csvindex(pe_t *pe, char *filename, int skip_header, int nrows,
+                         const int *rows, long *offsets){
+
+  FILE *fp = NULL;
+  char *chunk = NULL;
+  char *p = NULL, *end = NULL;
+  long line = 0, base = 0;
+  size_t nread;
+  int n = 0;
+
   fp = fopen(filename, "r");
-  assert(fp);
-
-  data_rmheader(line, fp, skip_header);
-  for(i=0; i<colSz; i++)
-  {
-      /* Read a line from the file and parse each value creating a token
-       * convert and store token to data vector with appropriate type
-       */
-      fgets(line, BUFSIZ, fp);
-      tok = strtok(line, delimiter);
-      convert_tok(tok, datatype, data, i*rowSz);
-
-      /* keep reading tokens from the buffer (using NULL)
-       * until reach the end of line, each time converting them
-       * and add them to data vector
-       */
-      for(j=1; j<rowSz; j++)
+  if(fp == NULL) pe_fatal(pe, "Cannot open %s\n", filename);
+
+  chunk = (char *) malloc(INDEX_CHUNK);
+  assert(chunk);
+
+  /* Line l starts right after the l-th newline, data row r is line r+skip */
+  while(n < nrows && rows[n] + skip_header == 0) offsets[n++] = 0;
+
+  while(n < nrows && (nread = fread(chunk, 1, INDEX_CHUNK, fp)) > 0)
+  {
+    p = chunk;
+    end = chunk + nread;
+    while(n < nrows && (p = memchr(p, '\n', end - p)) != NULL)
+    {
+      p++;
+      line++;
+      while(n < nrows && rows[n] + skip_header == line)
       {
-         tok = strtok(NULL, delimiter);
-         convert_tok(tok, datatype, data, i*rowSz+j);
+        offsets[n++] = base + (p - chunk);
       }
+    }
+    base += nread;
+  }
+
+  if(base > 0 && chunk[(base-1)%INDEX_CHUNK] != '\n')
+  {
+    while(n < nrows && rows[n] + skip_header == line + 1) offsets[n++] = base;
   }
 
+  free(chunk);
   fclose(fp);
-  pe_info(pe, "\tDone\n");
+
+  if(n < nrows) pe_fatal(pe, "%s has fewer than %d data rows\n", filename, rows[n]+1);
 
   return 0;
 }
 
 /*****************************************************************************
  *
- *  data_rmheader
+ *  data_local_rows
+ *
+ *  A sharded dataset holds the rows [plow, phi) of the decomposition;
+ *  datasets that are not sharded, or that the decomposition does not
+ *  describe, are held whole.
  *
  *****************************************************************************/
 
-static void data_rmheader(char* line, FILE *fp, int skip_num){
+static int data_local_rows(data_t *data){
+
+  int plow, phi, work;
+
+  assert(data);
+
+  data->low = 0;
+  data->Nlocal = data->N;
 
-  int i;
-  for(i=0; i<skip_num; i++)
+  if(data->shard && data->dc)
   {
-    fgets(line, BUFSIZ, fp);
+    dc_work(data->dc, &work);
+    dc_pbound(data->dc, &plow, &phi);
+    if(work == data->N && phi > plow)
+    {
+      data->low = plow;
+      data->Nlocal = phi - plow;
+    }
   }
+
+  return 0;
 }
 
 /*****************************************************************************
@@ -843,7 +1462,7 @@ static int data_allocate_x(data_t *data){
 
   assert(data);
 
-  mem_malloc_precision(&data->x, data->dimx * data->N);
+  mem_malloc_precision(&data->x, data->dimx * data->Nlocal);
 
   data_create_device_x(data);
 
@@ -860,31 +1479,189 @@ static int data_allocate_y(data_t *data){
 
   assert(data);
 
-  mem_malloc_integers(&data->y, data->dimy * data->N);
+  mem_malloc_integers(&data->y, data->dimy * data->Nlocal);
+
+  if(!data->fold) data_create_device_y(data);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  data_fold_labels
+ *  x_n <- y_n * x_n, so that the likelihood reads the datapoints only
+ *  (labels are -1 or 1, the sign flip is exact)
+ *
+ *****************************************************************************/
+
+static int data_fold_labels(data_t *data){
+
+  int i, j, dimx;
+
+  assert(data);
+  assert(data->dimy == 1);
+
+  dimx = data->dimx;
 
-  data_create_device_y(data);
+  for(i=0; i<data->Nlocal; i++)
+  {
+    if(data->y[i] < 0)
+    {
+      for(j=0; j<dimx; j++) data->x[i*dimx+j] = -data->x[i*dimx+j];
+    }
+  }
 
   return 0;
 }
 
 /*****************************************************************************
  *
- *  convert_tok
- *  converts an input token from character
- *  to real or integer based on the desired type
+ *  data_binread
+ *
+ *  Maps a binary dataset file (see data_binary.h). When the stored type
+ *  and row layout match the in-memory ones the local rows of the mapping
+ *  are used as the array itself, and only their pages are ever read;
+ *  otherwise the local rows are converted into a new array and the file
+ *  is unmapped. The mapping is private and writable, so folding
+ *  the labels touches only the pages it changes and never the file.
  *
  *****************************************************************************/
 
-static int convert_tok(const char *tok, const char *datatype, void *data, int pos){
+static int data_binread(pe_t *pe, data_t *data, char *filename, int dim,
+                        const char *datatype, void **pdata, void **pmap,
+                        size_t *pmap_size){
+
+  int fd;
+  size_t i, j;
+  struct stat st;
+  void *map = NULL;
+  char *rows = NULL;
+  data_bin_header_t *header = NULL;
+  uint32_t dtype, size;
+
+  assert(data);
+  assert(pdata);
 
-  if(!strcmp(datatype, "int")){
-    *((int *)data + pos) = atoi(tok);
-  }else if(!strcmp(datatype,"precision")){
-    *((precision *)data + pos) = (precision)atof(tok);
-  }else{
-    fprintf(stderr, "ERROR::%s:%d:%s: Invalid type argument \"%s\"!\n",\
-            __FILE__, __LINE__,__func__, datatype);\
-    exit(1);
+  pe_info(pe, "%30s\t%50s", "Mapping data from:", filename);
+
+  fd = open(filename, O_RDONLY);
+  if(fd < 0) pe_fatal(pe, "\nCannot open %s\n", filename);
+  if(fstat(fd, &st) != 0) pe_fatal(pe, "\nCannot stat %s\n", filename);
+  if((size_t) st.st_size < sizeof(data_bin_header_t))
+  {
+    pe_fatal(pe, "\n%s is too short for a binary dataset\n", filename);
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED) pe_fatal(pe, "\nmmap(%s) failed\n", filename);
+
+  header = (data_bin_header_t *) map;
+  dtype = header->dtype;
+
+  if(strncmp(header->magic, DATA_BIN_MAGIC, sizeof(header->magic)) != 0 ||
+     header->version != DATA_BIN_VERSION)
+  {
+    pe_fatal(pe, "\n%s is not a binary dataset (see csv2bin)\n", filename);
+  }
+  if(header->endian != DATA_BIN_ENDIAN)
+  {
+    pe_fatal(pe, "\n%s was written with a different byte order\n", filename);
+  }
+  if(dtype >= DATA_BIN_DTYPE_MAX)
+  {
+    pe_fatal(pe, "\n%s has an unknown data type %u\n", filename, dtype);
+  }
+  if(header->N != (uint64_t) data->N || header->dim != (uint64_t) dim)
+  {
+    pe_fatal(pe, "\n%s holds %llu x %llu values, expected %d x %d\n", filename,
+             (unsigned long long) header->N, (unsigned long long) header->dim,
+             data->N, dim);
+  }
+
+  size = data_bin_dtype_size[dtype];
+  if(header->stride < header->dim*size ||
+     header->offset + header->N*header->stride > (uint64_t) st.st_size)
+  {
+    pe_fatal(pe, "\n%s is truncated or has an invalid row stride\n", filename);
+  }
+
+  rows = (char *) map + header->offset + data->low*header->stride;
+
+  if(!strcmp(datatype, "int") && dtype == DATA_BIN_INT32 &&
+     header->stride == dim*sizeof(int) && header->offset%sizeof(int) == 0)
+  {
+    *pdata = rows;
+  }
+  else if(!strcmp(datatype, "precision") &&
+          dtype == ((sizeof(precision) == 8) ? DATA_BIN_FLOAT64 : DATA_BIN_FLOAT32) &&
+          header->stride == dim*sizeof(precision) &&
+          header->offset%sizeof(precision) == 0)
+  {
+    *pdata = rows;
+  }
+  else
+  {
+    /* Type or layout differs from memory, convert row by row */
+    if(!strcmp(datatype, "int"))
+    {
+      mem_malloc_integers((int **) pdata, data->Nlocal * dim);
+    }
+    else
+    {
+      mem_malloc_precision((precision **) pdata, data->Nlocal * dim);
+    }
+
+    for(i=0; i<(size_t) data->Nlocal; i++)
+    {
+      char *row = rows + i*header->stride;
+      for(j=0; j<header->dim; j++)
+      {
+        double value;
+        if(dtype == DATA_BIN_INT32)
+          value = ((int32_t *) row)[j];
+        else if(dtype == DATA_BIN_FLOAT32)
+          value = ((float *) row)[j];
+        else
+          value = ((double *) row)[j];
+
+        if(!strcmp(datatype, "int"))
+          ((int *) *pdata)[i*dim+j] = (int) value;
+        else
+          ((precision *) *pdata)[i*dim+j] = (precision) value;
+      }
+    }
+
+    munmap(map, st.st_size);
+    map = NULL;
+  }
+
+  *pmap = map;
+  *pmap_size = (map) ? (size_t) st.st_size : 0;
+
+  pe_info(pe, "\tDone\n");
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  data_format_from_name
+ *  returns 1 if the name matches a format, 0 otherwise
+ *
+ *****************************************************************************/
+
+static int data_format_from_name(const char *name, data_format_enum_t *format){
+
+  int n;
+
+  for(n=0; n<DATA_FORMAT_MAX; n++)
+  {
+    if(strcmp(name, data_format_names[n]) == 0)
+    {
+      *format = (data_format_enum_t) n;
+      return 1;
+    }
   }
 
   return 0;
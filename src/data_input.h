@@ -8,6 +8,10 @@
 
 typedef struct data_s data_t;
 
+typedef enum {DATA_FORMAT_CSV = 0,
+              DATA_FORMAT_BINARY,
+              DATA_FORMAT_MAX} data_format_enum_t;
+
 int data_create_train(pe_t *pe, dc_t *dc, data_t **pdata);
 int data_create_test(pe_t *pe, dc_t *dc, data_t **pdata);
 int data_free(data_t *data);
@@ -24,6 +28,9 @@ int data_fx_set(data_t *data, const char *filename);
 int data_fy_set(data_t *data, const char *filename);
 int data_x_set(data_t *data, precision *x);
 int data_y_set(data_t *data, int *y);
+int data_fold_set(data_t *data, int fold);
+int data_shard_set(data_t *data, int shard);
+int data_format_set(data_t *data, data_format_enum_t format);
 
 int data_dimx(data_t *data, int *dimx);
 int data_dimy(data_t *data, int *dimy);
@@ -32,6 +39,11 @@ int data_fx(data_t *data, char *fx);
 int data_fy(data_t *data, char *fy);
 int data_x(data_t *data, precision **px);
 int data_y(data_t *data, int **py);
+int data_fold(data_t *data, int *fold);
+int data_shard(data_t *data, int *shard);
+int data_low(data_t *data, int *low);
+int data_Nlocal(data_t *data, int *Nlocal);
+int data_format(data_t *data, data_format_enum_t *format);
 int data_dc(data_t *data, dc_t **pdc);
 int data_dc_set(data_t *data, dc_t *dc);
 int data_nprocs_set(data_t *data, int nprocs);
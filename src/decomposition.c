@@ -302,3 +302,18 @@ int dc_work_set(dc_t *dc, int work){
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  dc_work
+ *
+ *****************************************************************************/
+
+int dc_work(dc_t *dc, int *work){
+
+  assert(dc);
+
+  *work = dc->work;
+
+  return 0;
+}
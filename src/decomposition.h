@@ -25,5 +25,6 @@ int dc_tbound(dc_t *dc, int **ptlow, int **pthi);
 int dc_rank_set(dc_t *dc, int rank);
 int dc_size_set(dc_t *dc, int size);
 int dc_work_set(dc_t *dc, int work);
+int dc_work(dc_t *dc, int *work);
 
 #endif // __DECOMPOSITION_H__
@@ -13,6 +13,10 @@
   #define PRECISION_TOLERANCE  1.0e-07
   #define POTRF LAPACKE_spotrf
   #define TRMV cblas_strmv
+  #define TRSV cblas_strsv
+  #define GEMM cblas_sgemm
+  #define SYRK cblas_ssyrk
+  #define SYEV LAPACKE_ssyev
   #define GEMV cublasSgemv
   #define PRINT_PREC FLT_DIG+3
 #else
@@ -20,6 +24,10 @@
   #define PRECISION_TOLERANCE 1.0e-14
   #define POTRF LAPACKE_dpotrf
   #define TRMV cblas_dtrmv
+  #define TRSV cblas_dtrsv
+  #define GEMM cblas_dgemm
+  #define SYRK cblas_dsyrk
+  #define SYEV LAPACKE_dsyev
   #define GEMV cublasDgemv
   #define PRINT_PREC DBL_DIG+3
 #endif
@@ -30,16 +38,31 @@ static const int DEFAULT_THREADS = 1;
 static const char ALGORITHM_DEFAULT[BUFSIZ] = "metropolis";
 static const char KERNEL_DEFAULT[BUFSIZ] = "mvn_block";
 static const char LHOOD_DEFAULT[BUFSIZ] = "logistic_regression";
+#ifdef _OPENACC
+static const char LHOOD_KERNEL_DEFAULT[BUFSIZ] = "fused";
+#else
+static const char LHOOD_KERNEL_DEFAULT[BUFSIZ] = "simd";
+#endif
+static const char SIMD_ISA_DEFAULT[BUFSIZ] = "auto";
 static const char ESS_CASE_DEFAULT[BUFSIZ] = "max";
 static const char MC_CASE_DEFAULT[BUFSIZ] = "logistic_regression";
+static const char INFR_MODE_DEFAULT[BUFSIZ] = "batch";
+static const int INFR_EVERY_DEFAULT = 0;
+static const char DATA_FORMAT_DEFAULT[BUFSIZ] = "CSV";
 
 static const int DIMX_DEFAULT = 3;
 static const int DIMY_DEFAULT = 1;
 static const int TUNE_DEFAULT = 0;
+static const double TUNE_TARGET_DEFAULT = 0.234;
+static const char PROPOSAL_COV_DEFAULT[BUFSIZ] = "dense";
+static const int PROPOSAL_COV_BAND_DEFAULT = 1;
+static const int PROPOSAL_COV_RANK_DEFAULT = 1;
+static const int ADAPT_COV_DEFAULT = 0;
 static const int N_TRAIN_DEFAULT = 500;
 static const int N_TEST_DEFAULT = 100;
 static const int N_DATA_DEFAULT = 500;
 static const int N_CHAIN_DEFAULT = 500;
+static const int FOLD_LABELS_DEFAULT = 1;
 
 static const char TRAIN_X_DEFAULT[FILENAME_MAX] = "../data/synthetic/default/X_train.csv";
 static const char TRAIN_Y_DEFAULT[FILENAME_MAX] = "../data/synthetic/default/Y_train.csv";
@@ -49,11 +72,33 @@ static const char TEST_Y_DEFAULT[FILENAME_MAX] = "../data/synthetic/default/Y_te
 // RWSD_DEFAULT = 2.38 / sqrt(DIM_DEFAULT - 1);
 static const precision RWSD_DEFAULT = 1.6829141392239828;
 static const int RAND_INIT_DEFAULT = 0;
+static const int NCHAINS_DEFAULT = 1;
+static const int PREFETCH_DEPTH_DEFAULT = 0;
+static const int MTM_TRIES_DEFAULT = 4;
+static const int PT_TEMPERATURES_DEFAULT = 4;
+static const precision PT_BETA_MIN_DEFAULT = 0.1;
+static const int PT_SWAP_EVERY_DEFAULT = 10;
+static const precision HMC_STEP_SIZE_DEFAULT = 0.1;
+static const int HMC_STEPS_DEFAULT = 10;
+static const double MALA_TUNE_TARGET_DEFAULT = 0.574;
+static const double HMC_TUNE_TARGET_DEFAULT = 0.65;
+static const int NUTS_MAX_DEPTH_DEFAULT = 10;
+static const double NUTS_TARGET_DEFAULT = 0.8;
+static const int MASS_ADAPT_DEFAULT = 1;
+static const int MASS_WINDOW_DEFAULT = 25;
+static const int PREFETCH_DEPTH_MAX = 12;
+static const char RNG_DEFAULT[BUFSIZ] = "philox";
+static const int RNG_BUFFER_DEFAULT = 4096;
 
 static const int MAXLAG_AUTO_DEFAULT = 249;
 static const precision THRESHOLD_AUTO_DEFAULT = 0.1;
+static const char ACR_METHOD_DEFAULT[BUFSIZ] = "fft";
 
 static const int OUTFREQ_CHAIN_DEFAULT = 50;
+static const char CHAIN_STORAGE_DEFAULT[BUFSIZ] = "memory";
+static const int CHAIN_BLOCK_DEFAULT = 1024;
+static const int CHAIN_RING_DEFAULT = 4;
+static const int CHAIN_STATES_DEFAULT = 1024;
 static const int OUTFREQ_AUTO_DEFAULT = 50;
 static const char OUTDIR_DEFAULT[FILENAME_MAX] = "../out";
 
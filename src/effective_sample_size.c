@@ -20,6 +20,7 @@ struct ess_s{
   precision *median;      /* Median ESS */
   precision *mean;        /* Mean ESS */
   int dim;                /* Dimensionality of Samples */
+  double time;            /* Time taken to sample the chain, 0 if unknown */
 };
 
 static int ess_max(ess_t *ess);
@@ -173,6 +174,15 @@ int ess_print_ess(pe_t *pe, ess_t *ess){
   if(ess->median) pe_info(pe, "\tMedian:\t%f\n", ess->median[0]);
   if(ess->mean) pe_info(pe, "\tMean:\t%f\n", ess->mean[0]);
 
+  if(ess->time > 0.0)
+  {
+    pe_info(pe, "\tSampling Time:\t%f s\n", ess->time);
+    if(ess->max) pe_info(pe, "\tMax/s:\t%f\n", ess->max[0] / ess->time);
+    if(ess->min) pe_info(pe, "\tMin/s:\t%f\n", ess->min[0] / ess->time);
+    if(ess->median) pe_info(pe, "\tMedian/s:\t%f\n", ess->median[0] / ess->time);
+    if(ess->mean) pe_info(pe, "\tMean/s:\t%f\n", ess->mean[0] / ess->time);
+  }
+
   pe_info(pe, "\n");
 
   return 0;
@@ -229,6 +239,23 @@ int ess_case_set(ess_t *ess, const char *ess_case){
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  ess_time_set
+ *
+ *  Time taken to sample the chain, to report ESS per second.
+ *
+ *****************************************************************************/
+
+int ess_time_set(ess_t *ess, double time){
+
+  assert(ess);
+
+  ess->time = time;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  ess_max
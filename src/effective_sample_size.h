@@ -17,5 +17,6 @@ int ess_info(pe_t *pe, ess_t *ess);
 
 int ess_dim_set(ess_t *ess, int dim);
 int ess_case_set(ess_t *ess, const char *ess_case);
+int ess_time_set(ess_t *ess, double time);
 
 #endif // __EFFECTIVE_SAMPLE_SIZE_H__
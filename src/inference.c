@@ -3,25 +3,50 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "inference.h"
 #include "logistic_regression.h"
 #include "data_input.h"
 #include "memory.h"
 #include "timer.h"
+#include "cblas.h"
+
+#define BLOCK_ROWS    64    /* Test points per block of the MC integration */
+#define BLOCK_STATES  512   /* Chain states per block of the MC integration */
 
 struct infr_s{
   pe_t *pe;             /* Parallel Environment */
   ch_t *chain;          /* Generated chain */
-  data_t *data;         /* Test data */
-  precision *sum;       /* MC Integration out */
-  int *labels;          /* Infered labels */
+  dc_t *dc;             /* Decomposition of the test set */
+  data_t *data;         /* Test data, local rows only */
+  precision *sum;       /* MC Integration out, local rows */
+  int *labels;          /* Infered labels, local rows */
+  precision *probability; /* Predictive probability of every row (root) */
   precision accuracy;   /* Resulted accuracy */
+  double throughput;    /* Sample-point evaluations per second */
   char mc_case[BUFSIZ];
+  infr_mode_enum_t mode;  /* Integrate after (batch) or during sampling (stream) */
+  int every;            /* Stream every k-th step, 0 for every accepted state */
+  int N_samples;        /* Steps of the chain integrated over */
+  precision *states;    /* States waiting to be integrated (stream) */
+  precision *w;         /* Steps represented by each waiting state */
+  int nstates;          /* Number of waiting states */
+  double evaluations;   /* Sample-point evaluations so far */
+  double elapsed;       /* Time spent in them */
 };
 
+static const char *infr_mode_names[INFR_MODE_MAX] = {"batch", "stream"};
+
 static int infr_allocate_sum(infr_t *infr);
 static int infr_allocate_labels(infr_t *infr);
+static int infr_gather_probability(infr_t *infr);
+static int infr_mode_from_name(const char *name, infr_mode_enum_t *mode);
+static int infr_accumulate_lr(infr_t *infr, precision *states, precision *w,
+                              int nstates);
+static int infr_predict_lr(infr_t *infr);
 
 /*****************************************************************************
  *
@@ -29,13 +54,12 @@ static int infr_allocate_labels(infr_t *infr);
  *
  *****************************************************************************/
 
-int infr_create(pe_t *pe, ch_t *chain, dc_t *dc, infr_t **pinfr){
+int infr_create(pe_t *pe, ch_t *chain, infr_t **pinfr){
 
   infr_t *infr = NULL;
 
   assert(pe);
   assert(chain);
-  assert(dc);
 
   infr = (infr_t *) calloc(1, sizeof(infr_t));
   assert(infr);
@@ -44,8 +68,13 @@ int infr_create(pe_t *pe, ch_t *chain, dc_t *dc, infr_t **pinfr){
   infr->pe = pe;
   infr->chain = chain;
 
-  data_create_test(pe, dc, &infr->data);
+  /* The test rows are split over processes and threads on their own */
+  dc_create(pe, &infr->dc);
+  data_create_test(pe, infr->dc, &infr->data);
+  data_shard_set(infr->data, 1);
   infr_mc_case_set(infr, MC_CASE_DEFAULT);
+  infr_mode_from_name(INFR_MODE_DEFAULT, &infr->mode);
+  infr_every_set(infr, INFR_EVERY_DEFAULT);
 
   *pinfr = infr;
 
@@ -64,8 +93,12 @@ int infr_free(infr_t *infr){
 
   mem_free((void **)&infr->sum);
   mem_free((void **)&infr->labels);
+  mem_free((void **)&infr->probability);
+  mem_free((void **)&infr->states);
+  mem_free((void **)&infr->w);
 
   if(infr->data) data_free(infr->data);
+  if(infr->dc) dc_free(infr->dc);
 
   mem_free((void **)&infr);
 
@@ -81,11 +114,20 @@ int infr_free(infr_t *infr){
 int infr_init_rt(pe_t *pe, rt_t *rt, infr_t *infr){
 
   char mc_case[BUFSIZ];
+  char mode[BUFSIZ];
+  int work = N_TEST_DEFAULT;
+  int every;
 
   assert(pe);
   assert(rt);
   assert(infr);
 
+  /* Decompose based on the test set */
+  dc_init_rt(pe, rt, infr->dc);
+  rt_int_parameter(rt, "test_N", &work);
+  dc_work_set(infr->dc, work);
+  dc_decompose(infr->dc);
+
   data_init_test_rt(pe, rt, infr->data);
   data_input_test_info(pe, infr->data);
 
@@ -95,6 +137,20 @@ int infr_init_rt(pe_t *pe, rt_t *rt, infr_t *infr){
    infr_mc_case_set(infr, mc_case);
   }
 
+  if(rt_string_parameter(rt, "inference_mode", mode, BUFSIZ))
+  {
+    if(infr_mode_from_name(mode, &infr->mode) == 0)
+    {
+      pe_fatal(pe, "Unrecognised inference_mode \"%s\"\n", mode);
+    }
+  }
+
+  if(rt_int_parameter(rt, "inference_every", &every))
+  {
+    if(every < 0) pe_fatal(pe, "inference_every must not be negative\n");
+    infr_every_set(infr, every);
+  }
+
   infr_allocate_sum(infr);
   infr_allocate_labels(infr);
 
@@ -133,7 +189,16 @@ int infr_info(pe_t *pe, infr_t *infr){
   pe_info(pe, "\n\n");
   pe_info(pe, "Inference Properties\n");
   pe_info(pe, "--------------------\n");
-  pe_info(pe, "%30s\t\t%s\n\n", "Monte Carlo Case:", infr->mc_case);
+  pe_info(pe, "%30s\t\t%s\n", "Monte Carlo Case:", infr->mc_case);
+  pe_info(pe, "%30s\t\t%s\n", "Mode:", infr_mode_names[infr->mode]);
+  if(infr->mode == INFR_MODE_STREAM)
+  {
+    if(infr->every > 0)
+      pe_info(pe, "%30s\t\t%d %s\n", "Every:", infr->every, "steps");
+    else
+      pe_info(pe, "%30s\t\t%s\n", "Every:", "accepted state");
+  }
+  pe_info(pe, "\n");
 
   return 0;
 }
@@ -154,6 +219,7 @@ int infr_print(pe_t *pe, infr_t *infr){
   if(strcmp(infr->mc_case, "logistic_regression") == 0)
   {
     pe_info(pe, "\tClassification Accuracy:\t%1.3f\n", infr->accuracy);
+    pe_info(pe, "\tThroughput:\t\t\t%.3e evaluations/s\n", infr->throughput);
   }
 
   pe_info(pe, "\n");
@@ -169,46 +235,258 @@ int infr_print(pe_t *pe, infr_t *infr){
 
 int infr_mc_integration_lr(infr_t *infr){
 
-  int dim, N_data, N_samples;
+  int N_samples, N_states;
+  int j, n, count;
   precision *samples = NULL;
-  precision *x = NULL;
-  int *y = NULL;
+  precision *w = NULL;
+  int *weights = NULL;
   assert(infr);
 
   TIMER_start(TIMER_MC_INT);
 
-  data_dimx(infr->data, &dim);
-  data_N(infr->data, &N_data);
-  data_x(infr->data, &x);
-  data_y(infr->data, &y);
   ch_N(infr->chain, &N_samples);
   ch_samples(infr->chain, &samples);
+  ch_weights(infr->chain, &weights);
+  ch_nstates(infr->chain, &N_states);
+
+  /* Steps of each state within the first N_samples steps of the chain.
+   * A weighted chain evaluates each state once. */
+  mem_malloc_precision(&w, N_states);
+  for(j=0, n=0; j<N_states && n<N_samples; j++, n+=count)
+  {
+    count = (weights) ? weights[j] : 1;
+    if(count > N_samples - n) count = N_samples - n;
+    w[j] = count;
+  }
+  N_states = j;
+
+  data_Nlocal(infr->data, &n);
+  for(j=0; j<n; j++) infr->sum[j] = 0.0;
+
+  infr->N_samples = N_samples;
+  infr_accumulate_lr(infr, samples, w, N_states);
+  infr_predict_lr(infr);
+
+  mem_free((void **)&w);
+
+  TIMER_stop(TIMER_MC_INT);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  infr_stream_begin
+ *
+ *  Prepares the integration of the post burn-in chain while it is
+ *  sampled (inference_mode stream). The test set must be loaded.
+ *
+ *****************************************************************************/
+
+int infr_stream_begin(infr_t *infr){
+
+  int i, dim, N_local;
+
+  assert(infr);
+
+  data_dimx(infr->data, &dim);
+  data_Nlocal(infr->data, &N_local);
+  ch_N(infr->chain, &infr->N_samples);
+
+  if(infr->states == NULL) mem_malloc_precision(&infr->states, BLOCK_STATES*dim);
+  if(infr->w == NULL) mem_malloc_precision(&infr->w, BLOCK_STATES);
+  infr->nstates = 0;
+
+  for(i=0; i<N_local; i++) infr->sum[i] = 0.0;
+
+  return 0;
+}
 
-  int i,j;
-  precision acc_sum=0.0;
-  /* Perform a logistic regression on each data point
-   * going through all the generated samples.
-   * Accumulate the sum (MC integration) for each data point to evaluate its class
-  */
+/*****************************************************************************
+ *
+ *  infr_stream_push
+ *
+ *  Step idx of the chain is in state sample, newly accepted or not.
+ *  States are buffered with the steps they stand for, either their run
+ *  length (every accepted state) or inference_every steps, and integrated
+ *  a block at a time. Steps past the N integrated in batch mode are ignored.
+ *
+ *****************************************************************************/
+
+int infr_stream_push(infr_t *infr, int idx, precision *sample, int accepted){
+
+  int j, dim, count;
+
+  assert(infr);
+  assert(sample);
+
+  if(idx >= infr->N_samples) return 0;
 
-  for(i=0; i<N_data; i++)
+  if(infr->every > 0)
+  {
+    if(idx % infr->every) return 0;
+    count = (infr->N_samples - idx < infr->every) ? infr->N_samples - idx : infr->every;
+  }
+  else if(accepted || infr->nstates == 0)
   {
-    infr->sum[i] = 0.0;
-    for(j=0; j<N_samples; j++)
+    count = 1;
+  }
+  else
+  {
+    /* One more step in the last state */
+    infr->w[infr->nstates-1] += 1.0;
+    return 0;
+  }
+
+  /* The buffered states are final once a new one arrives */
+  if(infr->nstates == BLOCK_STATES)
+  {
+    TIMER_start(TIMER_MC_INT);
+    infr_accumulate_lr(infr, infr->states, infr->w, infr->nstates);
+    TIMER_stop(TIMER_MC_INT);
+    infr->nstates = 0;
+  }
+
+  data_dimx(infr->data, &dim);
+  for(j=0; j<dim; j++) infr->states[infr->nstates*dim+j] = sample[j];
+  infr->w[infr->nstates++] = count;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  infr_stream_end
+ *
+ *  Integrates the last buffered states and evaluates the predictions,
+ *  ready for infr_print.
+ *
+ *****************************************************************************/
+
+int infr_stream_end(infr_t *infr){
+
+  assert(infr);
+
+  TIMER_start(TIMER_MC_INT);
+  infr_accumulate_lr(infr, infr->states, infr->w, infr->nstates);
+  infr->nstates = 0;
+  infr_predict_lr(infr);
+  TIMER_stop(TIMER_MC_INT);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  infr_accumulate_lr
+ *
+ *  Adds w[j] * sigmoid(x_i . state_j) over the nstates states to the sum
+ *  of every local test point.
+ *  Each thread takes its share of the local rows in blocks; within a block
+ *  the dot products against a block of states are one GEMM, followed by
+ *  the sigmoid and the weighted sum over the states.
+ *
+ *****************************************************************************/
+
+static int infr_accumulate_lr(infr_t *infr, precision *states, precision *w,
+                              int nstates){
+
+  int dim, N_data, nthreads;
+  int i, j;
+  int *tlow = NULL, *thi = NULL;
+  precision *x = NULL;
+  double t0;
+
+  assert(infr);
+
+  if(nstates == 0) return 0;
+
+  t0 = MPI_Wtime();
+
+  data_dimx(infr->data, &dim);
+  data_N(infr->data, &N_data);
+  data_x(infr->data, &x);
+  dc_nthreads(infr->dc, &nthreads);
+  dc_tbound(infr->dc, &tlow, &thi);
+
+  #pragma omp parallel default(shared) private(i,j) num_threads(nthreads)
+  {
+    int tid = omp_get_thread_num();
+    int low = tlow[tid] - tlow[0];  /* Make sure first thread starts at zero */
+    int hi = thi[tid] - tlow[0];
+    int i0, j0, rows, cols;
+    precision sum;
+    precision *REST dot = NULL;
+
+    mem_malloc_precision((precision **)&dot, BLOCK_ROWS*BLOCK_STATES);
+
+    for(i0=low; i0<hi; i0+=BLOCK_ROWS)
     {
-      infr->sum[i] += lr_logistic_regression(&samples[j*dim], &x[i*dim], dim) / N_samples;
+      rows = (hi - i0 < BLOCK_ROWS) ? hi - i0 : BLOCK_ROWS;
+
+      for(j0=0; j0<nstates; j0+=BLOCK_STATES)
+      {
+        cols = (nstates - j0 < BLOCK_STATES) ? nstates - j0 : BLOCK_STATES;
+
+        GEMM(CblasRowMajor, CblasNoTrans, CblasTrans, rows, cols, dim,
+             1.0, &x[i0*dim], dim, &states[j0*dim], dim, 0.0, dot, cols);
+
+        for(i=0; i<rows; i++)
+        {
+          sum = 0.0;
+          for(j=0; j<cols; j++)
+          {
+            sum += w[j0+j] / (1.0 + exp(-dot[i*cols+j]));
+          }
+          infr->sum[i0+i] += sum;
+        }
+      }
     }
+
+    mem_free((void **)&dot);
   }
 
-  for(i=0; i<N_data; i++)
+  infr->evaluations += (double)N_data * nstates;
+  infr->elapsed += MPI_Wtime() - t0;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  infr_predict_lr
+ *
+ *  Turns the accumulated sums into predictive probabilities and labels,
+ *  and combines the accuracy and the probabilities over processes.
+ *
+ *****************************************************************************/
+
+static int infr_predict_lr(infr_t *infr){
+
+  int i, N_data, N_local;
+  int *y = NULL;
+  int acc_sum=0, global_acc_sum=0;
+  MPI_Comm comm;
+
+  assert(infr);
+
+  pe_mpi_comm(infr->pe, &comm);
+  data_N(infr->data, &N_data);
+  data_Nlocal(infr->data, &N_local);
+  data_y(infr->data, &y);
+
+  for(i=0; i<N_local; i++)
   {
+    infr->sum[i] /= infr->N_samples;
     infr->labels[i] = (infr->sum[i]>=0.5) ? 1 : -1;
     acc_sum += (infr->labels[i] == y[i]) ? 1 : 0;
   }
 
-  infr->accuracy = (precision)acc_sum / (precision)N_data;
+  MPI_Allreduce(&acc_sum, &global_acc_sum, 1, MPI_INT, MPI_SUM, comm);
+  infr_gather_probability(infr);
 
-  TIMER_stop(TIMER_MC_INT);
+  infr->accuracy = (precision)global_acc_sum / (precision)N_data;
+  infr->throughput = (infr->elapsed > 0.0) ? infr->evaluations / infr->elapsed : 0.0;
 
   return 0;
 }
@@ -243,6 +521,114 @@ int infr_mc_case(infr_t *infr, char *mc_case){
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  infr_mode_set
+ *
+ *****************************************************************************/
+
+int infr_mode_set(infr_t *infr, infr_mode_enum_t mode){
+
+  assert(infr);
+  assert(mode < INFR_MODE_MAX);
+
+  infr->mode = mode;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  infr_mode
+ *
+ *****************************************************************************/
+
+int infr_mode(infr_t *infr, infr_mode_enum_t *mode){
+
+  assert(infr);
+
+  *mode = infr->mode;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  infr_every_set
+ *
+ *****************************************************************************/
+
+int infr_every_set(infr_t *infr, int every){
+
+  assert(infr);
+
+  infr->every = every;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  infr_every
+ *
+ *****************************************************************************/
+
+int infr_every(infr_t *infr, int *every){
+
+  assert(infr);
+
+  *every = infr->every;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  infr_dc
+ *
+ *****************************************************************************/
+
+int infr_dc(infr_t *infr, dc_t **pdc){
+
+  assert(infr);
+
+  *pdc = infr->dc;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  infr_probability
+ *
+ *  Predictive probability of every test row, on the root process only.
+ *
+ *****************************************************************************/
+
+int infr_probability(infr_t *infr, precision **pprobability){
+
+  assert(infr);
+
+  *pprobability = infr->probability;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  infr_accuracy
+ *
+ *****************************************************************************/
+
+int infr_accuracy(infr_t *infr, precision *accuracy){
+
+  assert(infr);
+
+  *accuracy = infr->accuracy;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  infr_allocate_sum
@@ -256,6 +642,10 @@ static int infr_allocate_sum(infr_t *infr){
   int N;
   data_N(infr->data, &N);
 
+  if(pe_mpi_rank(infr->pe) == 0) mem_malloc_precision(&infr->probability, N);
+
+  data_Nlocal(infr->data, &N);
+
   mem_malloc_precision(&infr->sum, N);
 
   return 0;
@@ -272,9 +662,77 @@ static int infr_allocate_labels(infr_t *infr){
   assert(infr);
 
   int N;
-  data_N(infr->data, &N);
+  data_Nlocal(infr->data, &N);
 
   mem_malloc_integers(&infr->labels, N);
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  infr_gather_probability
+ *
+ *  Collects the predictive probabilities of the local rows on the root
+ *  process, in the order of the test set.
+ *
+ *****************************************************************************/
+
+static int infr_gather_probability(infr_t *infr){
+
+  int i, size, rank, N_local;
+  int *counts = NULL, *displs = NULL;
+  MPI_Comm comm;
+
+  assert(infr);
+
+  pe_mpi_comm(infr->pe, &comm);
+  size = pe_mpi_size(infr->pe);
+  rank = pe_mpi_rank(infr->pe);
+  data_Nlocal(infr->data, &N_local);
+
+  if(rank == 0)
+  {
+    mem_malloc_integers(&counts, size);
+    mem_malloc_integers(&displs, size);
+  }
+
+  MPI_Gather(&N_local, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+
+  if(rank == 0)
+  {
+    displs[0] = 0;
+    for(i=1; i<size; i++) displs[i] = displs[i-1] + counts[i-1];
+  }
+
+  MPI_Gatherv(infr->sum, N_local, MPI_PRECISION, infr->probability, counts,
+              displs, MPI_PRECISION, 0, comm);
+
+  mem_free((void **)&counts);
+  mem_free((void **)&displs);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  infr_mode_from_name
+ *  returns 1 if the name matches a mode, 0 otherwise
+ *
+ *****************************************************************************/
+
+static int infr_mode_from_name(const char *name, infr_mode_enum_t *mode){
+
+  int n;
+
+  for(n=0; n<INFR_MODE_MAX; n++)
+  {
+    if(strcmp(name, infr_mode_names[n]) == 0)
+    {
+      *mode = (infr_mode_enum_t) n;
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -3,12 +3,18 @@
 
 typedef struct infr_s infr_t;
 
+/* MC integration over the stored chain once sampling ends (batch), or
+ * accumulated while the post burn-in chain is sampled (stream) */
+typedef enum {INFR_MODE_BATCH = 0,
+              INFR_MODE_STREAM,
+              INFR_MODE_MAX} infr_mode_enum_t;
+
 #include "pe.h"
 #include "runtime.h"
 #include "chain.h"
 #include "decomposition.h"
 
-int infr_create(pe_t *pe, ch_t *chain, dc_t *dc, infr_t **pinfr);
+int infr_create(pe_t *pe, ch_t *chain, infr_t **pinfr);
 int infr_free(infr_t *infr);
 int infr_init_rt(pe_t *pe, rt_t *rt, infr_t *infr);
 int infr_init(pe_t *pe, infr_t *infr);
@@ -16,8 +22,18 @@ int infr_info(pe_t *pe, infr_t *infr);
 int infr_print(pe_t *pe, infr_t *infr);
 
 int infr_mc_integration_lr(infr_t *infr);
+int infr_stream_begin(infr_t *infr);
+int infr_stream_push(infr_t *infr, int idx, precision *sample, int accepted);
+int infr_stream_end(infr_t *infr);
 
 int infr_mc_case_set(infr_t *infr, const char *mc_case);
 int infr_mc_case(infr_t *infr, char *mc_case);
+int infr_mode_set(infr_t *infr, infr_mode_enum_t mode);
+int infr_mode(infr_t *infr, infr_mode_enum_t *mode);
+int infr_every_set(infr_t *infr, int every);
+int infr_every(infr_t *infr, int *every);
+int infr_dc(infr_t *infr, dc_t **pdc);
+int infr_probability(infr_t *infr, precision **pprobability);
+int infr_accuracy(infr_t *infr, precision *accuracy);
 
 #endif // __INFERENCE_H__
@@ -4,11 +4,18 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "cblas.h"
+
 #include "logistic_regression.h"
 #include "decomposition.h"
+#include "polya_gamma.h"
+#include "ran.h"
 #include "memory.h"
 #include "timer.h"
 
+/* Rows of each thread taken at a time by lr_lhood_multi */
+#define LR_BLOCK_ROWS 256
+
 #ifdef _FLOAT_
   MPI_Datatype MPI_PRECISION = MPI_FLOAT;
 #else
@@ -19,8 +26,10 @@ struct lr_s{
   pe_t *pe;
   dc_t *dc;
   data_t *data;
-  precision *dot;
+  precision *dot;        /* theta^T x_n buffer, two-pass kernel only */
   precision lhood;
+  lr_kernel_enum_t kernel;
+  simd_isa_enum_t isa;    /* Instruction set of the simd kernel */
   int dim;
   int N;
   MPI_Comm comm;
@@ -35,6 +44,13 @@ void lr_free_device_dot(lr_t *lr);
 
 void mvmul(lr_t *REST lr, precision *REST x, precision *REST sample);
 precision reduce_lhood(lr_t *REST lr, int *REST y);
+precision fused_lhood(lr_t *REST lr, precision *REST x, int *REST y,
+                      precision *REST sample);
+precision simd_host_lhood(lr_t *REST lr, precision *REST x, int *REST y,
+                          precision *REST sample);
+
+static const char *lr_kernel_names[LR_KERNEL_MAX] = {"fused", "two_pass", "simd"};
+static int lr_kernel_from_name(const char *name, lr_kernel_enum_t *kernel);
 
 /*****************************************************************************
 *
@@ -70,8 +86,10 @@ int lr_lhood_create(pe_t *pe, data_t *data, lr_t **plr){
   lr->rank = pe_mpi_rank(lr->pe);
   pe_mpi_comm(lr->pe, &lr->comm);
 
-  mem_malloc_precision(&lr->dot, lr->size);
-  lr_create_device_dot(lr);
+  lr_kernel_enum_t kernel = LR_KERNEL_FUSED;
+  lr_kernel_from_name(LHOOD_KERNEL_DEFAULT, &kernel);
+  lr_kernel_set(lr, kernel);
+  lr_isa_set(lr, simd_isa_detect());
 
   *plr = lr;
 
@@ -88,7 +106,7 @@ int lr_lhood_free(lr_t *lr){
 
   assert(lr);
 
-  lr_free_device_dot(lr);
+  if(lr->dot) lr_free_device_dot(lr);
   mem_free((void**)&lr->dot);
 
   mem_free((void**)&lr);
@@ -96,12 +114,60 @@ int lr_lhood_free(lr_t *lr){
   return 0;
 }
 
+/*****************************************************************************
+*
+*  lr_lhood_init_rt
+*
+*****************************************************************************/
+
+int lr_lhood_init_rt(rt_t *rt, lr_t *lr){
+
+  char kernel_value[BUFSIZ];
+  char isa_value[BUFSIZ];
+  lr_kernel_enum_t kernel = LR_KERNEL_FUSED;
+  simd_isa_enum_t isa = SIMD_ISA_SCALAR;
+
+  assert(rt);
+  assert(lr);
+
+  sprintf(kernel_value, "%s", LHOOD_KERNEL_DEFAULT);
+  sprintf(isa_value, "%s", SIMD_ISA_DEFAULT);
+
+  lr_kernel_from_name(LHOOD_KERNEL_DEFAULT, &kernel);
+
+  rt_string_parameter(rt, "lhood_kernel", kernel_value, BUFSIZ);
+  if(lr_kernel_from_name(kernel_value, &kernel) == 0)
+  {
+    pe_fatal(lr->pe, "Unrecognised lhood_kernel \"%s\"\n", kernel_value);
+  }
+  lr_kernel_set(lr, kernel);
+
+  rt_string_parameter(rt, "simd_isa", isa_value, BUFSIZ);
+  if(strcmp(isa_value, "auto") == 0)
+  {
+    isa = simd_isa_detect();
+  }
+  else if(simd_isa_from_name(isa_value, &isa) == 0)
+  {
+    pe_fatal(lr->pe, "Unrecognised simd_isa \"%s\"\n", isa_value);
+  }
+  else if(!simd_isa_supported(isa))
+  {
+    pe_fatal(lr->pe, "simd_isa \"%s\" is not supported by this host\n", isa_value);
+  }
+  lr_isa_set(lr, isa);
+
+  return 0;
+}
+
 /*****************************************************************************
 *
 *  lr_lhood
 *  evaluates logistic regression likelihood in log-domain
 *  L_n(theta) = 1 / (1 + exp(-y_n * theta^T * x_n)) where y_n={-1,1}
 *  log(L_n(theta)) = - log(1 + exp(-y_n * theta^T * x_n)
+*  with folded labels x_n already holds y_n * x_n and the kernels get y=NULL
+*  the data hold only the rows [plow, phi) of this process, from index 0
 *
 *****************************************************************************/
 
@@ -109,25 +175,346 @@ precision lr_lhood(lr_t *lr, precision *sample){
 
   assert(lr);
 
-  int plow, phi;
+  int fold;
   precision lhood = 0.0f;
   precision *x = NULL;
   int * y = NULL;
 
   data_x(lr->data, &x);
   data_y(lr->data, &y);
-  dc_pbound(lr->dc, &plow, &phi);
+  data_fold(lr->data, &fold);
+
+  int *lab = (fold) ? NULL : y;
 
   TIMER_start(TIMER_LIKELIHOOD);
 
-  mvmul(lr, &x[plow*lr->dim], sample);
-  lhood = reduce_lhood(lr, &y[plow]);
+  if(lr->kernel == LR_KERNEL_TWO_PASS)
+  {
+    mvmul(lr, x, sample);
+    lhood = reduce_lhood(lr, lab);
+  }else if(lr->kernel == LR_KERNEL_SIMD){
+    lhood = simd_host_lhood(lr, x, lab, sample);
+  }else{
+    lhood = fused_lhood(lr, x, lab, sample);
+  }
 
   TIMER_stop(TIMER_LIKELIHOOD);
 
   return lhood;
 }
 
+/*****************************************************************************
+*
+*  lr_lhood_multi
+*  log-likelihoods of nsamples parameter vectors (rows of samples) in one
+*  pass over the data. Each block of datapoints is multiplied by all the
+*  samples as one GEMM, so it is read once for the lot rather than once per
+*  sample, and the per-sample sums go through a single Allreduce.
+*  The log-sigmoid of the products is vectorised as in the simd kernel.
+*
+*****************************************************************************/
+
+int lr_lhood_multi(lr_t *lr, precision *samples, int nsamples, precision *lhood){
+
+  int *tlow = NULL, *thi = NULL;
+  int dim = lr->dim;
+  int fold, k, t;
+  int *y = NULL;
+  precision *x = NULL;
+  precision *partial = NULL;
+
+  assert(lr);
+  assert(samples);
+  assert(lhood);
+
+  data_x(lr->data, &x);
+  data_y(lr->data, &y);
+  data_fold(lr->data, &fold);
+
+  int *lab = (fold) ? NULL : y;
+
+  TIMER_start(TIMER_LIKELIHOOD);
+
+  dc_tbound(lr->dc, &tlow, &thi);
+
+  int nthreads = lr->nthreads;
+  simd_isa_enum_t isa = (lr->kernel == LR_KERNEL_SIMD) ? lr->isa : SIMD_ISA_SCALAR;
+  mem_malloc_precision(&partial, nthreads*nsamples);
+
+  #pragma omp parallel default(shared) private(k) num_threads(nthreads)
+  {
+    int tid = omp_get_thread_num();
+    int low = tlow[tid] - tlow[0];  /* Make sure first thread starts at zero */
+    int hi = thi[tid] - tlow[0];
+    int i, i0, rows;
+    precision *REST dot = NULL;
+    precision *REST sum = &partial[tid*nsamples];
+
+    mem_malloc_precision((precision **)&dot, LR_BLOCK_ROWS*nsamples);
+    for(k=0; k<nsamples; k++) sum[k] = 0.0;
+
+    for(i0=low; i0<hi; i0+=LR_BLOCK_ROWS)
+    {
+      rows = (hi - i0 < LR_BLOCK_ROWS) ? hi - i0 : LR_BLOCK_ROWS;
+
+      /* dot[k][i] = theta_k^T x_i, a row of products per sample */
+      GEMM(CblasRowMajor, CblasNoTrans, CblasTrans, nsamples, rows, dim,
+           1.0, samples, dim, &x[i0*dim], dim, 0.0, dot, LR_BLOCK_ROWS);
+
+      for(k=0; k<nsamples; k++)
+      {
+        if(lab)
+        {
+          for(i=0; i<rows; i++) dot[k*LR_BLOCK_ROWS+i] *= lab[i0+i];
+        }
+        sum[k] += simd_log_sigmoid(isa, &dot[k*LR_BLOCK_ROWS], rows);
+      }
+    }
+
+    mem_free((void **)&dot);
+  }
+
+  for(t=1; t<nthreads; t++)
+    for(k=0; k<nsamples; k++) partial[k] += partial[t*nsamples+k];
+
+  MPI_Allreduce(partial, lhood, nsamples, MPI_PRECISION, MPI_SUM, lr->comm);
+
+  mem_free((void **)&partial);
+
+  TIMER_stop(TIMER_LIKELIHOOD);
+
+  return 0;
+}
+
+/*****************************************************************************
+*
+*  lr_lhood_grad
+*  log-likelihood and its gradient in one pass over the data
+*  log(L_n(theta)) = log sigma(z_n), z_n = y_n * theta^T * x_n
+*  d/dtheta log(L_n(theta)) = (1 - sigma(z_n)) * y_n * x_n
+*  each thread sums the dim+1 values over its rows, and value and gradient
+*  go through a single Allreduce
+*
+*****************************************************************************/
+
+precision lr_lhood_grad(lr_t *lr, precision *sample, precision *grad){
+
+  int *tlow = NULL, *thi = NULL;
+  int dim = lr->dim;
+  int fold, j, t;
+  int *y = NULL;
+  precision *x = NULL;
+  precision *partial = NULL;
+  precision lhood;
+
+  assert(lr);
+  assert(sample);
+  assert(grad);
+
+  data_x(lr->data, &x);
+  data_y(lr->data, &y);
+  data_fold(lr->data, &fold);
+
+  int *lab = (fold) ? NULL : y;
+
+  TIMER_start(TIMER_LHOOD_GRAD);
+
+  dc_tbound(lr->dc, &tlow, &thi);
+
+  int nthreads = lr->nthreads;
+  mem_malloc_precision(&partial, (nthreads+1)*(dim+1));
+
+  TIMER_start(TIMER_LHOOD_GRAD_KERNEL);
+
+  #pragma omp parallel default(shared) private(j) num_threads(nthreads)
+  {
+    int tid = omp_get_thread_num();
+    int low = tlow[tid] - tlow[0];  /* Make sure first thread starts at zero */
+    int hi = thi[tid] - tlow[0];
+    int i;
+    precision *REST part = &partial[tid*(dim+1)];
+
+    for(j=0; j<dim+1; j++) part[j] = 0.0;
+
+    for(i=low; i<hi; i++)
+    {
+      precision *REST row = &x[i*dim];
+      precision label = (lab) ? (precision)lab[i] : 1.0;
+      precision dot = 0.0;
+
+      for(j=0; j<dim; j++) dot += sample[j] * row[j];
+
+      /* One exponential serves both, e = exp(-|z|) and
+       * 1 - sigma(z) = e/(1+e) for z >= 0, 1/(1+e) otherwise */
+      precision z = label * dot;
+      precision e = exp(-fabs(z));
+      precision w = label * ((z < 0.0) ? 1.0 : e) / (1.0 + e);
+
+      part[dim] -= ((z < 0.0) ? -z : 0.0) + log1p(e);
+      for(j=0; j<dim; j++) part[j] += w * row[j];
+    }
+  }
+
+  TIMER_stop(TIMER_LHOOD_GRAD_KERNEL);
+
+  for(t=1; t<nthreads; t++)
+    for(j=0; j<dim+1; j++) partial[j] += partial[t*(dim+1)+j];
+
+  MPI_Allreduce(partial, &partial[nthreads*(dim+1)], dim+1, MPI_PRECISION,
+                MPI_SUM, lr->comm);
+
+  for(j=0; j<dim; j++) grad[j] = partial[nthreads*(dim+1)+j];
+  lhood = partial[nthreads*(dim+1)+dim];
+
+  mem_free((void **)&partial);
+
+  TIMER_stop(TIMER_LHOOD_GRAD);
+
+  return lhood;
+}
+
+/*****************************************************************************
+*
+*  lr_pg_precision
+*  Polya-Gamma augmentation, one pass over the data:
+*  omega_n ~ PG(1, theta^T x_n) and X^T Omega X = sum_n omega_n x_n x_n^T
+*  (lower triangle, row major), with the log-likelihood of theta from the
+*  same dot products, through a single Allreduce of dim*dim+1 values;
+*  rows are scaled by sqrt(omega_n) into blocks of LR_BLOCK_ROWS and each
+*  block is added with one rank-k update
+*  omega_n of sweep s comes from the stream of datapoint n at s * 2^32,
+*  whichever rank or thread holds the row
+*
+*****************************************************************************/
+
+precision lr_pg_precision(lr_t *lr, precision *sample, unsigned long long sweep,
+                          precision *xwx){
+
+  int *tlow = NULL, *thi = NULL;
+  int dim = lr->dim;
+  int fold, j, t;
+  int *y = NULL;
+  precision *x = NULL;
+  precision *partial = NULL;
+  precision lhood;
+
+  assert(lr);
+  assert(sample);
+  assert(xwx);
+
+  data_x(lr->data, &x);
+  data_y(lr->data, &y);
+  data_fold(lr->data, &fold);
+
+  int *lab = (fold) ? NULL : y;
+
+  TIMER_start(TIMER_PG);
+
+  dc_tbound(lr->dc, &tlow, &thi);
+
+  int nthreads = lr->nthreads;
+  int size = dim*dim + 1;
+  mem_malloc_precision(&partial, (nthreads+1)*size);
+
+  #pragma omp parallel default(shared) private(j) num_threads(nthreads)
+  {
+    int tid = omp_get_thread_num();
+    int low = tlow[tid] - tlow[0];  /* Make sure first thread starts at zero */
+    int hi = thi[tid] - tlow[0];
+    int i, rows = 0;
+    precision *REST part = &partial[tid*size];
+    precision *REST w = NULL;
+    ran_stream_t *rng = NULL;
+
+    ran_stream_create(ran_seed(), 0, RAN_PURPOSE_PG, &rng);
+    mem_malloc_precision((precision **)&w, LR_BLOCK_ROWS*dim);
+
+    for(j=0; j<size; j++) part[j] = 0.0;
+
+    for(i=low; i<hi; i++)
+    {
+      precision *REST row = &x[i*dim];
+      precision label = (lab) ? (precision)lab[i] : 1.0;
+      precision dot = 0.0, omega, z;
+
+      for(j=0; j<dim; j++) dot += sample[j] * row[j];
+
+      z = label * dot;
+      part[dim*dim] -= ((z < 0.0) ? -z : 0.0) + log1p(exp(-fabs(z)));
+
+      /* PG(1, z) is even in z, so folded labels change nothing */
+      ran_stream_reset(rng, tlow[0] + i, sweep << 32);
+      omega = sqrt(pg_draw(dot, rng));
+
+      for(j=0; j<dim; j++) w[rows*dim+j] = omega * row[j];
+
+      if(++rows == LR_BLOCK_ROWS || i == hi - 1)
+      {
+        SYRK(CblasRowMajor, CblasLower, CblasTrans, dim, rows,
+             1.0, w, dim, 1.0, part, dim);
+        rows = 0;
+      }
+    }
+
+    mem_free((void **)&w);
+    ran_stream_free(rng);
+  }
+
+  for(t=1; t<nthreads; t++)
+    for(j=0; j<size; j++) partial[j] += partial[t*size+j];
+
+  MPI_Allreduce(partial, &partial[nthreads*size], size, MPI_PRECISION,
+                MPI_SUM, lr->comm);
+
+  memcpy(xwx, &partial[nthreads*size], dim*dim*sizeof(precision));
+  lhood = partial[nthreads*size+dim*dim];
+
+  mem_free((void **)&partial);
+
+  TIMER_stop(TIMER_PG);
+
+  return lhood;
+}
+
+/*****************************************************************************
+*
+*  lr_pg_kappa
+*  X^T kappa, kappa_n = y_n / 2, the part of the Polya-Gamma conditional
+*  that does not change from sweep to sweep
+*
+*****************************************************************************/
+
+int lr_pg_kappa(lr_t *lr, precision *kappa){
+
+  int dim = lr->dim;
+  int fold, i, j;
+  int *y = NULL;
+  precision *x = NULL;
+  precision *partial = NULL;
+
+  assert(lr);
+  assert(kappa);
+
+  data_x(lr->data, &x);
+  data_y(lr->data, &y);
+  data_fold(lr->data, &fold);
+
+  mem_malloc_precision(&partial, dim);
+  for(j=0; j<dim; j++) partial[j] = 0.0;
+
+  for(i=0; i<lr->size; i++)
+  {
+    precision label = (fold) ? 1.0 : (precision)y[i];
+    for(j=0; j<dim; j++) partial[j] += 0.5 * label * x[i*dim+j];
+  }
+
+  MPI_Allreduce(partial, kappa, dim, MPI_PRECISION, MPI_SUM, lr->comm);
+
+  mem_free((void **)&partial);
+
+  return 0;
+}
+
 void mvmul(lr_t *REST lr, precision *REST x, precision *REST sample){
 
   int *tlow = NULL, *thi = NULL;
@@ -148,8 +535,10 @@ void mvmul(lr_t *REST lr, precision *REST x, precision *REST sample){
     precision *REST dot = &lr->dot[low];
     precision *REST mat = &x[low*dim];
 
+#ifdef _OPENACC
     int gpuid = tid + lr->nthreads*(lr->rank%lr->nprocs);
     #pragma acc set device_num(gpuid) device_type(acc_device_nvidia)
+#endif
     #pragma acc kernels present(dot[:size]) \
                         present(sample[:dim]) \
                         present(mat[:size*dim])
@@ -192,18 +581,37 @@ precision reduce_lhood(lr_t *REST lr, int *REST y){
     precision dlhood = 0.0f;
 
     precision *REST dot = &lr->dot[low];
-    int *REST lab = &y[low];
 
+#ifdef _OPENACC
     int gpuid = tid + lr->nthreads*(lr->rank%lr->nprocs);
     #pragma acc set device_num(gpuid) device_type(acc_device_nvidia)
-    #pragma acc kernels present(dot[:size], lab[:size]) \
-                        copyout(dlhood)
+#endif
+    if(y == NULL)
     {
-      dlhood = 0.0f;
-      #pragma acc loop reduction(+:dlhood)
-      for(i=0; i<size; i++)
+      #pragma acc kernels present(dot[:size]) \
+                          copyout(dlhood)
       {
-        dlhood -= log(1.0f + exp(-(precision)lab[i] * dot[i]));
+        dlhood = 0.0f;
+        #pragma acc loop reduction(+:dlhood)
+        for(i=0; i<size; i++)
+        {
+          dlhood -= log(1.0f + exp(-dot[i]));
+        }
+      }
+    }
+    else
+    {
+      int *REST lab = &y[low];
+
+      #pragma acc kernels present(dot[:size], lab[:size]) \
+                          copyout(dlhood)
+      {
+        dlhood = 0.0f;
+        #pragma acc loop reduction(+:dlhood)
+        for(i=0; i<size; i++)
+        {
+          dlhood -= log(1.0f + exp(-(precision)lab[i] * dot[i]));
+        }
       }
     }
     lhood += dlhood;
@@ -215,6 +623,129 @@ precision reduce_lhood(lr_t *REST lr, int *REST y){
   return global_lhood;
 }
 
+/*****************************************************************************
+*
+*  fused_lhood
+*  streams each datapoint once: the dot product, the log-sigmoid term and
+*  the partial sum are kept in registers, so no N-sized buffer is touched
+*
+*****************************************************************************/
+
+precision fused_lhood(lr_t *REST lr, precision *REST x, int *REST y,
+                      precision *REST sample){
+
+  int *tlow = NULL, *thi = NULL;
+  int dim = lr->dim;
+  precision global_lhood = 0.0f, lhood = 0.0f;
+  int i, j;
+
+  TIMER_start(TIMER_FUSED_LHOOD);
+
+  dc_tbound(lr->dc, &tlow, &thi);
+
+  int nthreads = lr->nthreads;
+  #pragma omp parallel default(shared) num_threads(nthreads) private(i,j) reduction(+:lhood)
+  {
+    int tid = omp_get_thread_num();
+    int low = tlow[tid] - tlow[0];  /* Make sure first thread starts at zero */
+    int hi = thi[tid] - tlow[0];
+    int size = hi - low;
+    precision dlhood = 0.0f;
+
+    precision *REST mat = &x[low*dim];
+
+#ifdef _OPENACC
+    int gpuid = tid + lr->nthreads*(lr->rank%lr->nprocs);
+    #pragma acc set device_num(gpuid) device_type(acc_device_nvidia)
+#endif
+    if(y == NULL)
+    {
+      #pragma acc kernels present(sample[:dim]) \
+                          present(mat[:size*dim]) \
+                          copyout(dlhood)
+      {
+        dlhood = 0.0f;
+        #pragma acc loop reduction(+:dlhood)
+        for(i=0; i<size; i++)
+        {
+          precision dot_local = 0.0f;
+          #pragma acc loop seq
+          for(j=0; j<dim; j++)
+          {
+            dot_local += sample[j] * mat[i*dim+j];
+          }
+          dlhood -= log(1.0f + exp(-dot_local));
+        }
+      }
+    }
+    else
+    {
+      int *REST lab = &y[low];
+
+      #pragma acc kernels present(sample[:dim]) \
+                          present(mat[:size*dim], lab[:size]) \
+                          copyout(dlhood)
+      {
+        dlhood = 0.0f;
+        #pragma acc loop reduction(+:dlhood)
+        for(i=0; i<size; i++)
+        {
+          precision dot_local = 0.0f;
+          #pragma acc loop seq
+          for(j=0; j<dim; j++)
+          {
+            dot_local += sample[j] * mat[i*dim+j];
+          }
+          dlhood -= log(1.0f + exp(-(precision)lab[i] * dot_local));
+        }
+      }
+    }
+    lhood += dlhood;
+  }
+  MPI_Allreduce(&lhood, &global_lhood, 1, MPI_PRECISION, MPI_SUM, lr->comm);
+
+  TIMER_stop(TIMER_FUSED_LHOOD);
+
+  return global_lhood;
+}
+
+/*****************************************************************************
+*
+*  simd_host_lhood
+*  each thread runs the vectorised host kernel on its own rows
+*
+*****************************************************************************/
+
+precision simd_host_lhood(lr_t *REST lr, precision *REST x, int *REST y,
+                          precision *REST sample){
+
+  int *tlow = NULL, *thi = NULL;
+  int dim = lr->dim;
+  simd_isa_enum_t isa = lr->isa;
+  precision global_lhood = 0.0f, lhood = 0.0f;
+
+  TIMER_start(TIMER_SIMD_LHOOD);
+
+  dc_tbound(lr->dc, &tlow, &thi);
+
+  int nthreads = lr->nthreads;
+  #pragma omp parallel default(shared) num_threads(nthreads) reduction(+:lhood)
+  {
+    int tid = omp_get_thread_num();
+    int low = tlow[tid] - tlow[0];  /* Make sure first thread starts at zero */
+    int hi = thi[tid] - tlow[0];
+
+    int *lab = (y) ? &y[low] : NULL;
+
+    lhood += simd_lhood(isa, &x[low*dim], lab, sample, hi-low, dim);
+  }
+  MPI_Allreduce(&lhood, &global_lhood, 1, MPI_PRECISION, MPI_SUM, lr->comm);
+
+  TIMER_stop(TIMER_SIMD_LHOOD);
+
+  return global_lhood;
+}
+
 /*****************************************************************************
 *
 *  lr_create_device_dot
@@ -237,8 +768,10 @@ void lr_create_device_dot(lr_t *lr){
     int low = tlow[tid] - tlow[0];  /* Make sure first thread starts at zero */
     int hi = thi[tid] - tlow[0];
 
+#ifdef _OPENACC
     int gpuid = tid + lr->nthreads*(lr->rank%lr->nprocs);
     #pragma acc set device_num(gpuid) device_type(acc_device_nvidia)
+#endif
     #pragma acc enter data create(dot[low:hi])
   }
 
@@ -263,8 +796,10 @@ void lr_free_device_dot(lr_t *lr){
     int low = tlow[tid] - tlow[0];  /* Make sure first thread starts at zero */
     precision *REST dot = &lr->dot[low];
 
+#ifdef _OPENACC
     int gpuid = tid + lr->nthreads*(lr->rank%lr->nprocs);
     #pragma acc set device_num(gpuid) device_type(acc_device_nvidia)
+#endif
     #pragma acc exit data delete(dot)
   }
 
@@ -333,3 +868,90 @@ int lr_N(lr_t *lr, int *N){
 
   return 0;
 }
+
+/*****************************************************************************
+*
+*  lr_kernel_set
+*  the dot buffer only exists while the two-pass kernel is selected
+*
+*****************************************************************************/
+
+int lr_kernel_set(lr_t *lr, lr_kernel_enum_t kernel){
+
+  assert(lr);
+  assert(kernel < LR_KERNEL_MAX);
+
+  lr->kernel = kernel;
+
+  if(kernel == LR_KERNEL_TWO_PASS && lr->dot == NULL)
+  {
+    mem_malloc_precision(&lr->dot, lr->size);
+    lr_create_device_dot(lr);
+  }
+
+  if(kernel != LR_KERNEL_TWO_PASS && lr->dot != NULL)
+  {
+    lr_free_device_dot(lr);
+    mem_free((void**)&lr->dot);
+  }
+
+  return 0;
+}
+
+int lr_kernel(lr_t *lr, lr_kernel_enum_t *kernel){
+
+  assert(lr);
+
+  *kernel = lr->kernel;
+
+  return 0;
+}
+
+const char *lr_kernel_name(lr_kernel_enum_t kernel){
+
+  assert(kernel < LR_KERNEL_MAX);
+
+  return lr_kernel_names[kernel];
+}
+
+int lr_isa_set(lr_t *lr, simd_isa_enum_t isa){
+
+  assert(lr);
+  assert(isa < SIMD_ISA_MAX);
+
+  lr->isa = isa;
+
+  return 0;
+}
+
+int lr_isa(lr_t *lr, simd_isa_enum_t *isa){
+
+  assert(lr);
+
+  *isa = lr->isa;
+
+  return 0;
+}
+
+/*****************************************************************************
+*
+*  lr_kernel_from_name
+*  returns 1 if the name matches a kernel, 0 otherwise
+*
+*****************************************************************************/
+
+static int lr_kernel_from_name(const char *name, lr_kernel_enum_t *kernel){
+
+  int n;
+
+  for(n=0; n<LR_KERNEL_MAX; n++)
+  {
+    if(strcmp(name, lr_kernel_names[n]) == 0)
+    {
+      *kernel = (lr_kernel_enum_t) n;
+      return 1;
+    }
+  }
+
+  return 0;
+}
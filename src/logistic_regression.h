@@ -3,17 +3,41 @@
 
 #include "definitions.h"
 #include "pe.h"
+#include "runtime.h"
 #include "data_input.h"
+#include "simd.h"
 
 typedef struct lr_s lr_t;
 
+/* MPI datatype matching precision */
+extern MPI_Datatype MPI_PRECISION;
+
+/* Likelihood kernels: single pass over the data (fused), matrix-vector
+ * product into a buffer followed by a separate reduction (two-pass), or the
+ * vectorised host kernels of simd.c (simd) */
+typedef enum {LR_KERNEL_FUSED = 0,
+              LR_KERNEL_TWO_PASS,
+              LR_KERNEL_SIMD,
+              LR_KERNEL_MAX} lr_kernel_enum_t;
+
 int lr_lhood_create(pe_t *pe, data_t *data, lr_t **plr);
 int lr_lhood_free(lr_t *lr);
+int lr_lhood_init_rt(rt_t *rt, lr_t *lr);
 precision lr_lhood(lr_t *lr, precision *sample);
+int lr_lhood_multi(lr_t *lr, precision *samples, int nsamples, precision *lhood);
+precision lr_lhood_grad(lr_t *lr, precision *sample, precision *grad);
+precision lr_pg_precision(lr_t *lr, precision *sample, unsigned long long sweep,
+                          precision *xwx);
+int lr_pg_kappa(lr_t *lr, precision *kappa);
 precision lr_logistic_regression(precision *sample, precision *x, int dim);
 
 int lr_dim(lr_t *lr, int *dim);
 int lr_N(lr_t *lr, int *N);
 int lr_data(lr_t *lr, data_t **pdata);
 int lr_dot(lr_t *lr, precision **pdot);
+int lr_kernel_set(lr_t *lr, lr_kernel_enum_t kernel);
+int lr_kernel(lr_t *lr, lr_kernel_enum_t *kernel);
+const char *lr_kernel_name(lr_kernel_enum_t kernel);
+int lr_isa_set(lr_t *lr, simd_isa_enum_t isa);
+int lr_isa(lr_t *lr, simd_isa_enum_t *isa);
 #endif // __LOGISTIC_REGRESSION_H__
@@ -30,6 +30,10 @@ struct mcmc_s{
   acr_t *acr;      /* Autocorrelation structure */
   ess_t *ess;      /* Effective Sample Size */
   infr_t  *infr;   /* Inference data structure */
+  int nchains;     /* Chains of the ensemble, or rungs of the pt ladder */
+  int ensemble;    /* Chains k>0 are samples of the posterior too */
+  ch_t **burns;    /* Burn-in chain k of the ensemble, [0] is burn */
+  ch_t **chains;   /* Post burn-in chain k of the ensemble, [0] is chain */
 };
 
 static int mcmc_rt(mcmc_t *mcmc);
@@ -45,6 +49,13 @@ static int mcmc_rt(mcmc_t *mcmc);
    mcmc_t *mcmc = NULL;
    MPI_Comm comm;
    char mc_case[BUFSIZ];
+   infr_mode_enum_t mode = INFR_MODE_BATCH;
+   precision rate_burn, rate_post;
+   precision *rhat = NULL;
+   precision rhat_max = 0.0, rhat_mean = 0.0;
+   char stub[BUFSIZ];
+   double t_sampling;
+   int k, d, dim;
 
    mcmc = (mcmc_t*) calloc(1, sizeof(mcmc_t));
    assert(mcmc);
@@ -68,14 +79,30 @@ static int mcmc_rt(mcmc_t *mcmc);
      met_run(mcmc->pe, mcmc->met);
      TIMER_stop(TIMER_BURN_IN);
      /* Post burn-in */
-     met_chain_set(mcmc->met, mcmc->chain);
+     met_chains_set(mcmc->met, mcmc->chains);
+
+     /* Streamed inference needs the test set before the first state */
+     if(mcmc->infr) infr_mode(mcmc->infr, &mode);
+     if(mcmc->infr && mode == INFR_MODE_STREAM)
+     {
+       infr_init(mcmc->pe, mcmc->infr);
+       infr_stream_begin(mcmc->infr);
+       met_infr_set(mcmc->met, mcmc->infr);
+     }
+
      met_init_post_burn(mcmc->pe, mcmc->met);
 
      TIMER_start(TIMER_POST_BURN_IN);
+     t_sampling = MPI_Wtime();
      met_run(mcmc->pe, mcmc->met);
+     ess_time_set(mcmc->ess, MPI_Wtime() - t_sampling);
      TIMER_stop(TIMER_POST_BURN_IN);
-     /* Clean up */
-     met_free(mcmc->met);
+
+     if(mcmc->infr && mode == INFR_MODE_STREAM)
+     {
+       infr_stream_end(mcmc->infr);
+       met_infr_set(mcmc->met, NULL);
+     }
      TIMER_stop(TIMER_MCMC_METROPOLIS);
    }
 
@@ -89,6 +116,32 @@ static int mcmc_rt(mcmc_t *mcmc);
    ess_compute(mcmc->ess);
    ess_print_ess(mcmc->pe, mcmc->ess);
 
+   ch_acceptance_rate(mcmc->burn, &rate_burn);
+   ch_acceptance_rate(mcmc->chain, &rate_post);
+   pe_info(mcmc->pe, "Acceptance Rate Summary:\n");
+   pe_info(mcmc->pe, "------------------------\n");
+   pe_info(mcmc->pe, "\tBurn-in:\t%f\n", rate_burn);
+   pe_info(mcmc->pe, "\tPost Burn-in:\t%f\n\n", rate_post);
+
+   /* Agreement of the ensemble, per coordinate */
+   if(mcmc->ensemble)
+   {
+     ch_dim(mcmc->chain, &dim);
+     rhat = (precision *) calloc(dim, sizeof(precision));
+     assert(rhat);
+     ch_split_rhat(mcmc->chains, mcmc->nchains, rhat);
+     for(d=0; d<dim; d++)
+     {
+       if(rhat[d] > rhat_max) rhat_max = rhat[d];
+       rhat_mean += rhat[d] / dim;
+     }
+     pe_info(mcmc->pe, "Split R-hat Summary (%d chains):\n", mcmc->nchains);
+     pe_info(mcmc->pe, "------------------------\n");
+     pe_info(mcmc->pe, "\tMax:\t%f\n", rhat_max);
+     pe_info(mcmc->pe, "\tMean:\t%f\n\n", rhat_mean);
+     free(rhat);
+   }
+
    MPI_Barrier(comm);
 
    /* Write output files */
@@ -96,6 +149,13 @@ static int mcmc_rt(mcmc_t *mcmc);
    {
      ch_write_files(mcmc->burn, "burn");
      ch_write_files(mcmc->chain, "postburn");
+     for(k=1; k<mcmc->nchains && mcmc->ensemble; k++)
+     {
+       sprintf(stub, "burn_chain%d", k);
+       ch_write_files(mcmc->burns[k], stub);
+       sprintf(stub, "postburn_chain%d", k);
+       ch_write_files(mcmc->chains[k], stub);
+     }
      acr_write_acr(mcmc->acr);
    }
 
@@ -103,11 +163,14 @@ static int mcmc_rt(mcmc_t *mcmc);
    {
      TIMER_start(TIMER_INFERENCE);
 
-     infr_init(mcmc->pe, mcmc->infr);
-
      infr_mc_case(mcmc->infr, mc_case);
-     if(strcmp(mc_case, "logistic_regression") == 0)
+     if(mode == INFR_MODE_STREAM)
      {
+       infr_print(mcmc->pe, mcmc->infr);
+     }
+     else if(strcmp(mc_case, "logistic_regression") == 0)
+     {
+       infr_init(mcmc->pe, mcmc->infr);
        infr_mc_integration_lr(mcmc->infr);
        infr_print(mcmc->pe, mcmc->infr);
      }
@@ -122,10 +185,18 @@ static int mcmc_rt(mcmc_t *mcmc);
 
    MPI_Barrier(comm);
 
+   if(mcmc->met) met_free(mcmc->met);
    acr_free(mcmc->acr);
    ess_free(mcmc->ess);
    ch_free(mcmc->burn);
    ch_free(mcmc->chain);
+   for(k=1; k<mcmc->nchains; k++)
+   {
+     ch_free(mcmc->burns[k]);
+     ch_free(mcmc->chains[k]);
+   }
+   free(mcmc->burns);
+   free(mcmc->chains);
 
    rt_free(mcmc->rt);
    pe_free(mcmc->pe);
@@ -146,9 +217,11 @@ static int mcmc_rt(mcmc_t *mcmc);
 
    pe_t  *pe  = NULL;
    rt_t  *rt  = NULL;
-   dc_t *dc = NULL;
 
    char algorithm_value[BUFSIZ];
+   met_algorithm_enum_t algorithm = MET_ALGORITHM_METROPOLIS;
+   ch_storage_enum_t storage;
+   int k;
 
    assert(mcmc);
 
@@ -175,14 +248,49 @@ static int mcmc_rt(mcmc_t *mcmc);
    ch_chain_info(pe, mcmc->chain);
 
    rt_string_parameter(rt, "mcmc_algorithm", algorithm_value, BUFSIZ);
-   if(strcmp(algorithm_value, "metropolis") == 0)
+   if(met_algorithm_from_name(algorithm_value, &algorithm))
    {
      met_create(pe, mcmc->burn, &mcmc->met);
      met_init_rt(pe, rt, mcmc->met);
      met_info_rt(pe, mcmc->met);
-     met_dc(mcmc->met, &dc);
    }
 
+   /* Chains 1..K-1 of an ensemble, or the hot rungs of pt, get chains of their own */
+   mcmc->nchains = 1;
+   if(mcmc->met)
+   {
+     met_nchains(mcmc->met, &mcmc->nchains);
+     met_algorithm(mcmc->met, &algorithm);
+   }
+
+   /* Only the beta = 1 rung of a tempered ladder samples the posterior */
+   mcmc->ensemble = (mcmc->nchains > 1 && algorithm != MET_ALGORITHM_PT);
+
+   mcmc->burns = (ch_t **) calloc(mcmc->nchains, sizeof(ch_t *));
+   mcmc->chains = (ch_t **) calloc(mcmc->nchains, sizeof(ch_t *));
+   assert(mcmc->burns);
+   assert(mcmc->chains);
+   mcmc->burns[0] = mcmc->burn;
+   mcmc->chains[0] = mcmc->chain;
+
+   /* The hot rungs are never written, so they do not stream to files */
+   ch_storage(mcmc->chain, &storage);
+   if(storage == CH_STORAGE_STREAM && !mcmc->ensemble) storage = CH_STORAGE_MEMORY;
+
+   for(k=1; k<mcmc->nchains; k++)
+   {
+     ch_create(pe, &mcmc->burns[k]);
+     ch_id_set(mcmc->burns[k], k);
+     if(!mcmc->ensemble) ch_storage_set(mcmc->burns[k], storage);
+     ch_init_burn_rt(rt, mcmc->burns[k]);
+
+     ch_create(pe, &mcmc->chains[k]);
+     ch_id_set(mcmc->chains[k], k);
+     if(!mcmc->ensemble) ch_storage_set(mcmc->chains[k], storage);
+     ch_init_chain_rt(rt, mcmc->chains[k]);
+   }
+   if(mcmc->met) met_chains_set(mcmc->met, mcmc->burns);
+
    acr_create(pe, mcmc->chain, &mcmc->acr);
    acr_init_rt(rt, mcmc->chain, mcmc->acr);
    acr_info(pe, mcmc->acr);
@@ -193,7 +301,7 @@ static int mcmc_rt(mcmc_t *mcmc);
 
    if(rt_switch(rt, "inference"))
    {
-     infr_create(pe, mcmc->chain, dc, &mcmc->infr);
+     infr_create(pe, mcmc->chain, &mcmc->infr);
      infr_init_rt(pe, rt, mcmc->infr);
      infr_info(pe, mcmc->infr);
    }
@@ -4,12 +4,49 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "cblas.h"
+#include "lapacke.h"
+
 #include "metropolis.h"
 #include "prior.h"
 #include "ran.h"
 #include "memory.h"
 #include "timer.h"
 
+/* Dual averaging of the NUTS step (Hoffman and Gelman, JMLR 15, 1593, 2014) */
+#define NUTS_GAMMA 0.05
+#define NUTS_T0 10.0
+#define NUTS_KAPPA 0.75
+/* Energy error beyond which a trajectory has diverged */
+#define NUTS_MAX_DELTA 1000.0
+
+/* Tree endpoints, the leaf being integrated and the subtree's proposal */
+enum {NUTS_LEFT = 0, NUTS_RIGHT, NUTS_LEAF, NUTS_SUBTREE, NUTS_POOL};
+
+static int met_ensemble_init(met_t *met);
+static int met_ensemble_lhood(met_t *met, sample_t **samples);
+static int met_ensemble_step(met_t *met, int i);
+static int met_prefetch_tree(met_t *met, int depth);
+static int met_mtm_step(met_t *met, int i);
+static int met_pt_swap(met_t *met, int i);
+static int met_hmc_step(met_t *met, int i);
+static int met_mass_update(met_t *met);
+static precision met_kinetic(met_t *met, precision *p);
+static int met_nuts_step(met_t *met, int i);
+static int met_nuts_adapt(met_t *met, precision alpha);
+static int met_nuts_adapt_restart(met_t *met);
+static int met_nuts_turning(met_t *met, precision *p_left, precision *p_right,
+                            precision *rho);
+static int met_nuts_copy(sample_t *dst, sample_t *src);
+static precision met_uniform(met_t *met);
+static int met_pg_step(met_t *met, int i);
+static precision met_log_sum_exp(precision *a, int n);
+
+static const char *met_algorithm_names[MET_ALGORITHM_MAX] = {"metropolis", "mtm", "pt",
+                                                                  "mala", "hmc", "nuts",
+                                                                  "pg_gibbs"};
+static int met_prefetch_step(met_t *met, int i);
+
 struct met_s{
   pe_t *pe;             /* Parallel Environment */
   rt_t *rt;             /* Runtime */
@@ -20,6 +57,70 @@ struct met_s{
   lr_t *lr;             /* Logistic Regression Likelihood */
   sample_t *current;    /* Current sample */
   sample_t *proposed;   /* Proposed sample */
+  infr_t *infr;         /* Inference streamed during the run, if any */
+  ran_stream_t *rng_proposal; /* Philox streams of this chain, NULL with lecuyer */
+  ran_stream_t *rng_accept;
+  int nchains;          /* Chains of the ensemble, 1 for a single chain */
+  ch_t **chains;        /* Ensemble state of chain k, [0] mirrors the fields above */
+  sample_t **currents;
+  sample_t **proposeds;
+  ran_stream_t **rng_proposals;
+  ran_stream_t **rng_accepts;
+  precision *betas;     /* Inverse temperature of chain k, 1 but with pt */
+  precision *scales;    /* Step scale of chain k */
+  int swap_every;       /* Steps between replica exchanges */
+  int *swaps;           /* Exchanges accepted, and tried, of pair (k,k+1) */
+  int *swaps_tried;
+  ran_stream_t *rng_swap;
+  precision *values;    /* Proposals of the ensemble packed row by row */
+  precision *lhoods;    /* Their likelihoods */
+  met_algorithm_enum_t algorithm;
+  int tries;            /* Candidates per step of multiple-try Metropolis */
+  precision *tries_values;     /* Candidates then reference points */
+  precision *tries_lhoods;
+  precision *tries_posteriors;
+  int leapfrog;         /* Leapfrog steps per trajectory, 1 with mala */
+  precision step_size;  /* Leapfrog step, times the tuned scale */
+  precision *grad_current;  /* Gradient of the log posterior at the current state */
+  precision *grad_proposed; /* and at the end of the trajectory */
+  precision *momentum;
+  precision *inv_mass;  /* Diagonal of the inverse mass matrix */
+  precision *mass_mean; /* Running mean and sum of squares of the window */
+  precision *mass_m2;
+  int mass_adapt;       /* Mass matrix follows the burn-in variance */
+  int mass_n;           /* Steps in the window, and its length */
+  int mass_window;
+  int adapting_mass;    /* Mass matrix adapts in this run */
+  int max_depth;        /* Doublings of a NUTS trajectory at most */
+  precision target;     /* Mean acceptance statistic aimed for by dual averaging */
+  int adapting_step;    /* Step size adapts in this run */
+  precision da_mu;      /* Dual averaging state: shrinkage point, */
+  precision da_hbar;    /* running acceptance error, */
+  precision da_log_eps_bar; /* and averaged log step */
+  int da_t;
+  int divergences;
+  sample_t *nuts_pool[NUTS_POOL];
+  precision *nuts_p;    /* Momentum and gradient of each slot of the pool */
+  precision *nuts_g;
+  precision *nuts_ckpt_p;   /* Momentum and momentum sum at the start of */
+  precision *nuts_ckpt_rho; /* each open sub-subtree, max_depth of them */
+  precision *nuts_rho;      /* Momentum sum of the tree and the subtree */
+  precision *nuts_rho_sub;
+  precision *nuts_tmp;
+  precision *pg_xwx;    /* X^T Omega X of the next sweep, then P and its factor */
+  precision *pg_kappa;  /* X^T kappa */
+  unsigned long long sweeps; /* Polya-Gamma sweeps so far, burn-in included */
+  int prefetch;         /* Depth of the prefetching tree, 0 steps one at a time */
+  int tree_depth;       /* Levels of the current tree, and the one reached */
+  int tree_level;
+  int tree_node;        /* Node of the current state, heap order */
+  precision *tree_states;    /* State at each node */
+  precision *tree_proposals; /* Its proposal for the level's increment */
+  precision *tree_lhoods;    /* Likelihood of each proposal */
+  precision *tree_noise;     /* Proposal increment of each level */
+  precision *tree_zero;
+  int adapting;         /* Proposal adapts to the chain in this run */
+  int tuning;           /* Step size is tuned in this run */
   int random_init;
 };
 
@@ -36,6 +137,7 @@ int met_create(pe_t *pe, ch_t *chain, met_t **pmet){
 
   met->pe = pe;
   met->chain = chain;
+  met->nchains = 1;
 
   met_random_init_set(met, RAND_INIT_DEFAULT); /* Default initialize to zero */
 
@@ -46,14 +148,61 @@ int met_create(pe_t *pe, ch_t *chain, met_t **pmet){
 
 int met_free(met_t *met){
 
+  int k;
+
   assert(met);
 
+  for(k=1; k<met->nchains; k++)
+  {
+    if(met->currents[k]) sample_free(met->currents[k]);
+    if(met->proposeds[k]) sample_free(met->proposeds[k]);
+    if(met->rng_proposals[k]) ran_stream_free(met->rng_proposals[k]);
+    if(met->rng_accepts[k]) ran_stream_free(met->rng_accepts[k]);
+  }
+  met_prefetch_set(met, 0);
+  free(met->tries_values);
+  free(met->tries_lhoods);
+  free(met->tries_posteriors);
+  free(met->grad_current);
+  free(met->grad_proposed);
+  free(met->momentum);
+  free(met->inv_mass);
+  free(met->mass_mean);
+  free(met->mass_m2);
+  free(met->nuts_p);
+  free(met->nuts_g);
+  free(met->nuts_ckpt_p);
+  free(met->nuts_ckpt_rho);
+  free(met->nuts_rho);
+  free(met->nuts_rho_sub);
+  free(met->nuts_tmp);
+  free(met->pg_xwx);
+  free(met->pg_kappa);
+  for(k=0; k<NUTS_POOL; k++) if(met->nuts_pool[k]) sample_free(met->nuts_pool[k]);
+  if(met->nchains > 1)
+  {
+    free(met->chains);
+    free(met->currents);
+    free(met->proposeds);
+    free(met->rng_proposals);
+    free(met->rng_accepts);
+    free(met->values);
+    free(met->lhoods);
+    free(met->betas);
+    free(met->scales);
+    free(met->swaps);
+    free(met->swaps_tried);
+  }
+
   if(met->mvnb) mvn_block_free(met->mvnb);
   if(met->lr) lr_lhood_free(met->lr);
   if(met->current) sample_free(met->current);
   if(met->proposed) sample_free(met->proposed);
   if(met->data) data_free(met->data);
   if(met->dc) dc_free(met->dc);
+  if(met->rng_proposal) ran_stream_free(met->rng_proposal);
+  if(met->rng_accept) ran_stream_free(met->rng_accept);
+  if(met->rng_swap) ran_stream_free(met->rng_swap);
   mem_free((void**)&met);
 
   return 0;
@@ -64,7 +213,14 @@ int met_init_rt(pe_t *pe, rt_t *rt, met_t *met){
 
   char kernel_value[BUFSIZ];
   char lhood_value[BUFSIZ];
+  char algorithm_value[BUFSIZ];
   int rinit = 0;
+  int k, dim, adapt = 0, tune = 0;
+  double beta_min = PT_BETA_MIN_DEFAULT;
+  double step_size = HMC_STEP_SIZE_DEFAULT, target;
+  double nuts_target = NUTS_TARGET_DEFAULT;
+  precision scale;
+  int prefetch = PREFETCH_DEPTH_DEFAULT;
 
   assert(rt);
   assert(met);
@@ -74,6 +230,15 @@ int met_init_rt(pe_t *pe, rt_t *rt, met_t *met){
 
   ran_init_rt(pe, rt); /* initialize state of the random number generator */
 
+  /* Chain 0 draws its proposals and acceptances from streams of its own */
+  if(ran_rng() == RAN_RNG_PHILOX)
+  {
+    ran_stream_create(ran_seed(), 0, RAN_PURPOSE_PROPOSAL, &met->rng_proposal);
+    ran_stream_create(ran_seed(), 0, RAN_PURPOSE_ACCEPT, &met->rng_accept);
+    ran_stream_buffer_set(met->rng_proposal, ran_buffer());
+    ran_stream_buffer_set(met->rng_accept, ran_buffer());
+  }
+
   dc_create(pe, &met->dc);
   dc_init_rt(pe,rt, met->dc);
   dc_print_info(pe, met->dc);
@@ -103,12 +268,14 @@ int met_init_rt(pe_t *pe, rt_t *rt, met_t *met){
     mvn_block_create(pe, &met->mvnb);
     mvn_block_init_rt(rt, met->mvnb);
     mvn_block_init(met->mvnb);
+    mvn_block_rng_set(met->mvnb, met->rng_proposal);
   }
 
   rt_string_parameter(rt, "lhood", lhood_value, BUFSIZ);
   if(strcmp(lhood_value, "logistic_regression") == 0)
   {
     lr_lhood_create(pe, met->data, &met->lr);
+    lr_lhood_init_rt(rt, met->lr);
   }
 
   if(rt_switch(rt, "random_init"))
@@ -117,12 +284,253 @@ int met_init_rt(pe_t *pe, rt_t *rt, met_t *met){
     met_random_init_set(met, rinit);
   }
 
+  if(rt_string_parameter(rt, "mcmc_algorithm", algorithm_value, BUFSIZ))
+  {
+    if(!met_algorithm_from_name(algorithm_value, &met->algorithm))
+      pe_fatal(pe, "mcmc_algorithm \"%s\" not recognised\n", algorithm_value);
+  }
+
+  /* K candidates and K-1 reference points per step */
+  if(met->algorithm == MET_ALGORITHM_MTM)
+  {
+    met->tries = MTM_TRIES_DEFAULT;
+    rt_int_parameter(rt, "mtm_tries", &met->tries);
+    if(met->tries < 1) pe_fatal(pe, "mtm_tries must be positive\n");
+    if(met->mvnb == NULL || met->lr == NULL)
+      pe_fatal(pe, "mcmc_algorithm mtm requires kernel mvn_block and lhood logistic_regression\n");
+
+    sample_dim(met->current, &dim);
+    met->tries_values = (precision *) calloc(2*met->tries*dim, sizeof(precision));
+    met->tries_lhoods = (precision *) calloc(2*met->tries, sizeof(precision));
+    met->tries_posteriors = (precision *) calloc(2*met->tries, sizeof(precision));
+    if(met->tries_values == NULL || met->tries_lhoods == NULL || met->tries_posteriors == NULL)
+      pe_fatal(pe, "calloc(met tries) failed\n");
+  }
+
+  /* Gradient-based proposals: hmc follows hmc_steps leapfrog steps of
+   * hmc_step_size under a diagonal mass matrix, mala is the single step and
+   * nuts doubles the trajectory until it turns back. Each step costs a
+   * gradient, i.e. one pass over the data, per leapfrog */
+  if(met->algorithm == MET_ALGORITHM_MALA || met->algorithm == MET_ALGORITHM_HMC ||
+     met->algorithm == MET_ALGORITHM_NUTS)
+  {
+    if(met->lr == NULL)
+      pe_fatal(pe, "mcmc_algorithm %s requires lhood logistic_regression\n",
+               met_algorithm_name(met->algorithm));
+
+    rt_double_parameter(rt, "hmc_step_size", &step_size);
+    if(step_size <= 0.0) pe_fatal(pe, "hmc_step_size must be positive\n");
+    met->step_size = step_size;
+
+    met->leapfrog = 1;
+    if(met->algorithm == MET_ALGORITHM_HMC)
+    {
+      met->leapfrog = HMC_STEPS_DEFAULT;
+      rt_int_parameter(rt, "hmc_steps", &met->leapfrog);
+      if(met->leapfrog < 1) pe_fatal(pe, "hmc_steps must be positive\n");
+    }
+
+    met->mass_adapt = MASS_ADAPT_DEFAULT;
+    rt_int_parameter(rt, "mass_adapt", &met->mass_adapt);
+
+    /* tune_sd scales the leapfrog step, to the optimal acceptance of the
+     * algorithm unless tune_target is given */
+    if(met->mvnb)
+    {
+      mvn_block_adapt(met->mvnb, &adapt);
+      if(adapt)
+        pe_fatal(pe, "mcmc_algorithm %s cannot be combined with adapt_cov, see mass_adapt\n",
+                 met_algorithm_name(met->algorithm));
+      if(!rt_double_parameter(rt, "tune_target", &target))
+        mvn_block_target_set(met->mvnb, (met->algorithm == MET_ALGORITHM_HMC)
+                             ? HMC_TUNE_TARGET_DEFAULT : MALA_TUNE_TARGET_DEFAULT);
+    }
+
+    sample_dim(met->current, &dim);
+    met->grad_current = (precision *) calloc(dim, sizeof(precision));
+    met->grad_proposed = (precision *) calloc(dim, sizeof(precision));
+    met->momentum = (precision *) calloc(dim, sizeof(precision));
+    met->inv_mass = (precision *) calloc(dim, sizeof(precision));
+    met->mass_mean = (precision *) calloc(dim, sizeof(precision));
+    met->mass_m2 = (precision *) calloc(dim, sizeof(precision));
+    if(met->grad_current == NULL || met->grad_proposed == NULL || met->momentum == NULL ||
+       met->inv_mass == NULL || met->mass_mean == NULL || met->mass_m2 == NULL)
+      pe_fatal(pe, "calloc(met gradient) failed\n");
+
+    for(k=0; k<dim; k++) met->inv_mass[k] = 1.0;
+  }
+
+  /* Tree of at most 2^nuts_max_depth leaves, of which only the endpoints,
+   * the leaf and the proposal are held, and dual averaging of the step
+   * towards nuts_target during burn-in */
+  if(met->algorithm == MET_ALGORITHM_NUTS)
+  {
+    met->max_depth = NUTS_MAX_DEPTH_DEFAULT;
+    rt_int_parameter(rt, "nuts_max_depth", &met->max_depth);
+    if(met->max_depth < 1 || met->max_depth > 30)
+      pe_fatal(pe, "nuts_max_depth must be between 1 and 30\n");
+    rt_double_parameter(rt, "nuts_target", &nuts_target);
+    if(nuts_target <= 0.0 || nuts_target >= 1.0) pe_fatal(pe, "nuts_target must be in (0,1)\n");
+    met->target = nuts_target;
+
+    for(k=0; k<NUTS_POOL; k++)
+    {
+      sample_create(pe, &met->nuts_pool[k]);
+      sample_init_rt(rt, met->nuts_pool[k]);
+    }
+    met->nuts_p = (precision *) calloc(NUTS_POOL*dim, sizeof(precision));
+    met->nuts_g = (precision *) calloc(NUTS_POOL*dim, sizeof(precision));
+    met->nuts_ckpt_p = (precision *) calloc(met->max_depth*dim, sizeof(precision));
+    met->nuts_ckpt_rho = (precision *) calloc(met->max_depth*dim, sizeof(precision));
+    met->nuts_rho = (precision *) calloc(dim, sizeof(precision));
+    met->nuts_rho_sub = (precision *) calloc(dim, sizeof(precision));
+    met->nuts_tmp = (precision *) calloc(dim, sizeof(precision));
+    if(met->nuts_p == NULL || met->nuts_g == NULL || met->nuts_ckpt_p == NULL ||
+       met->nuts_ckpt_rho == NULL || met->nuts_rho == NULL ||
+       met->nuts_rho_sub == NULL || met->nuts_tmp == NULL)
+      pe_fatal(pe, "calloc(met nuts) failed\n");
+  }
+
+  /* Blocked Gibbs on the Polya-Gamma augmentation: a sweep draws omega_n
+   * for every datapoint from a stream keyed by the datapoint, then theta
+   * from its Gaussian conditional through a dim x dim Cholesky factor */
+  if(met->algorithm == MET_ALGORITHM_PG_GIBBS)
+  {
+    if(met->lr == NULL)
+      pe_fatal(pe, "mcmc_algorithm pg_gibbs requires lhood logistic_regression\n");
+    if(ran_rng() != RAN_RNG_PHILOX)
+      pe_fatal(pe, "mcmc_algorithm pg_gibbs requires rng philox\n");
+
+    sample_dim(met->current, &dim);
+    met->pg_xwx = (precision *) calloc(dim*dim, sizeof(precision));
+    met->pg_kappa = (precision *) calloc(dim, sizeof(precision));
+    if(met->pg_xwx == NULL || met->pg_kappa == NULL)
+      pe_fatal(pe, "calloc(met pg_gibbs) failed\n");
+  }
+
+  /* Prefetching evaluates the next steps of both outcomes ahead; the
+   * chain is that of sequential steps only if the proposal increments and
+   * the uniforms do not depend on the path, i.e. come from streams of
+   * their own */
+  rt_int_parameter(rt, "prefetch_depth", &prefetch);
+  if(prefetch < 0 || prefetch > PREFETCH_DEPTH_MAX)
+    pe_fatal(pe, "prefetch_depth must be between 0 and %d\n", PREFETCH_DEPTH_MAX);
+
+  if(prefetch > 0)
+  {
+    if(met->algorithm != MET_ALGORITHM_METROPOLIS)
+      pe_fatal(pe, "prefetch_depth requires mcmc_algorithm metropolis\n");
+    if(met->mvnb == NULL || met->lr == NULL)
+      pe_fatal(pe, "prefetch_depth requires kernel mvn_block and lhood logistic_regression\n");
+    if(ran_rng() != RAN_RNG_PHILOX)
+      pe_fatal(pe, "prefetch_depth requires rng philox\n");
+    mvn_block_adapt(met->mvnb, &adapt);
+    mvn_block_tune(met->mvnb, &tune);
+    if(adapt || tune)
+      pe_fatal(pe, "prefetch_depth cannot be combined with adapt_cov or tune_sd\n");
+  }
+
+  /* An ensemble runs K chains side by side, chain k with streams of its own;
+   * with pt the chains are the rungs of the temperature ladder */
+  met->nchains = NCHAINS_DEFAULT;
+  rt_int_parameter(rt, "nchains", &met->nchains);
+  if(met->nchains < 1) pe_fatal(pe, "nchains must be positive\n");
+
+  if(met->algorithm == MET_ALGORITHM_PT)
+  {
+    met->nchains = PT_TEMPERATURES_DEFAULT;
+    rt_int_parameter(rt, "pt_temperatures", &met->nchains);
+    rt_double_parameter(rt, "pt_beta_min", &beta_min);
+    met->swap_every = PT_SWAP_EVERY_DEFAULT;
+    rt_int_parameter(rt, "pt_swap_every", &met->swap_every);
+    if(met->nchains < 2) pe_fatal(pe, "pt_temperatures must be at least 2\n");
+    if(beta_min <= 0.0 || beta_min > 1.0) pe_fatal(pe, "pt_beta_min must be in (0,1]\n");
+    if(met->swap_every < 1) pe_fatal(pe, "pt_swap_every must be positive\n");
+  }
+
+  if(met->nchains > 1)
+  {
+    if(met->mvnb == NULL || met->lr == NULL)
+      pe_fatal(pe, "nchains > 1 requires kernel mvn_block and lhood logistic_regression\n");
+    mvn_block_adapt(met->mvnb, &adapt);
+    mvn_block_tune(met->mvnb, &tune);
+    if(adapt || tune)
+      pe_fatal(pe, "nchains > 1 cannot be combined with adapt_cov or tune_sd\n");
+    if(prefetch > 0)
+      pe_fatal(pe, "nchains > 1 cannot be combined with prefetch_depth\n");
+    if(met->algorithm == MET_ALGORITHM_MTM || met->grad_current ||
+       met->algorithm == MET_ALGORITHM_PG_GIBBS)
+      pe_fatal(pe, "nchains > 1 cannot be combined with mcmc_algorithm %s\n",
+               met_algorithm_name(met->algorithm));
+
+    sample_dim(met->current, &dim);
+    met->chains = (ch_t **) calloc(met->nchains, sizeof(ch_t *));
+    met->currents = (sample_t **) calloc(met->nchains, sizeof(sample_t *));
+    met->proposeds = (sample_t **) calloc(met->nchains, sizeof(sample_t *));
+    met->rng_proposals = (ran_stream_t **) calloc(met->nchains, sizeof(ran_stream_t *));
+    met->rng_accepts = (ran_stream_t **) calloc(met->nchains, sizeof(ran_stream_t *));
+    met->values = (precision *) calloc(met->nchains*dim, sizeof(precision));
+    met->lhoods = (precision *) calloc(met->nchains, sizeof(precision));
+    met->betas = (precision *) calloc(met->nchains, sizeof(precision));
+    met->scales = (precision *) calloc(met->nchains, sizeof(precision));
+    met->swaps = (int *) calloc(met->nchains, sizeof(int));
+    met->swaps_tried = (int *) calloc(met->nchains, sizeof(int));
+    if(met->chains == NULL || met->currents == NULL || met->proposeds == NULL ||
+       met->rng_proposals == NULL || met->rng_accepts == NULL ||
+       met->values == NULL || met->lhoods == NULL || met->betas == NULL ||
+       met->scales == NULL || met->swaps == NULL || met->swaps_tried == NULL)
+      pe_fatal(pe, "calloc(met ensemble) failed\n");
+
+    /* Geometric ladder from beta = 1 (chain 0) down to pt_beta_min, each
+     * rung with a step widened as the tempered posterior, 1/sqrt(beta) */
+    mvn_block_scale(met->mvnb, &scale);
+    for(k=0; k<met->nchains; k++)
+    {
+      met->betas[k] = 1.0;
+      if(met->algorithm == MET_ALGORITHM_PT)
+        met->betas[k] = pow(beta_min, (double) k/(met->nchains-1));
+      met->scales[k] = scale/sqrt(met->betas[k]);
+    }
+
+    if(met->algorithm == MET_ALGORITHM_PT && ran_rng() == RAN_RNG_PHILOX)
+    {
+      ran_stream_create(ran_seed(), 0, RAN_PURPOSE_SWAP, &met->rng_swap);
+      ran_stream_buffer_set(met->rng_swap, ran_buffer());
+    }
+
+    met->chains[0] = met->chain;
+    met->rng_proposals[0] = met->rng_proposal;
+    met->rng_accepts[0] = met->rng_accept;
+
+    for(k=1; k<met->nchains; k++)
+    {
+      met->chains[k] = met->chain;
+      sample_create(pe, &met->currents[k]);
+      sample_create(pe, &met->proposeds[k]);
+      sample_init_rt(rt, met->currents[k]);
+      sample_init_rt(rt, met->proposeds[k]);
+
+      if(ran_rng() == RAN_RNG_PHILOX)
+      {
+        ran_stream_create(ran_seed(), k, RAN_PURPOSE_PROPOSAL, &met->rng_proposals[k]);
+        ran_stream_create(ran_seed(), k, RAN_PURPOSE_ACCEPT, &met->rng_accepts[k]);
+        ran_stream_buffer_set(met->rng_proposals[k], ran_buffer());
+        ran_stream_buffer_set(met->rng_accepts[k], ran_buffer());
+      }
+    }
+  }
+
+  met_prefetch_set(met, prefetch);
+
   return 0;
 }
 
 int met_info_rt(pe_t *pe, met_t *met){
 
   int dim, random_init, tune_rw_sd;
+  int band, rank, adapt;
+  precision target;
+  mvn_cov_enum_t cov;
   double rwsd;
   assert(pe);
   assert(met);
@@ -135,16 +543,71 @@ int met_info_rt(pe_t *pe, met_t *met){
   pe_info(pe, "\n");
   pe_info(pe, "Metropolis Properties\n");
   pe_info(pe, "---------------------\n");
+  pe_info(pe, "%30s\t\t%s\n", "Algorithm:", met_algorithm_name(met->algorithm));
+  if(met->algorithm == MET_ALGORITHM_MTM)
+    pe_info(pe, "%30s\t\t%d\n", "Tries:", met->tries);
+  if(met->algorithm == MET_ALGORITHM_PT)
+  {
+    pe_info(pe, "%30s\t\t%d\n", "Temperatures:", met->nchains);
+    pe_info(pe, "%30s\t\t%f\n", "Minimum Beta:", met->betas[met->nchains-1]);
+    pe_info(pe, "%30s\t\t%d\n", "Swap Every:", met->swap_every);
+  }
+  if(met->grad_current)
+  {
+    pe_info(pe, "%30s\t\t%f\n", "Leapfrog Step:", met->step_size);
+    if(met->algorithm == MET_ALGORITHM_NUTS)
+    {
+      pe_info(pe, "%30s\t\t%d\n", "Max Tree Depth:", met->max_depth);
+      pe_info(pe, "%30s\t\t%f\n", "Target Acceptance:", met->target);
+    }
+    else
+      pe_info(pe, "%30s\t\t%d\n", "Leapfrog Steps:", met->leapfrog);
+    pe_info(pe, "%30s\t\t%s\n", "Mass Adaptation:", met->mass_adapt>0 ? "True" : "False");
+  }
   pe_info(pe, "%30s\t\t%d\n", "Sample Dimensionality:", dim);
   pe_info(pe, "%30s\t\t%s\n", "Random Initialisation:", random_init>0 ? "True" : "False");
+  if(met->algorithm != MET_ALGORITHM_PT)
+    pe_info(pe, "%30s\t\t%d\n", "Chains:", met->nchains);
+  if(met->prefetch > 0) pe_info(pe, "%30s\t\t%d\n", "Prefetch Depth:", met->prefetch);
   if(met->mvnb)
   {
     pe_info(pe, "%30s\n", "Proposal Kernel:");
     pe_info(pe, "%30s\t\t%s\n", "Type ", "Multivariate Normal (Block)");
+    mvn_block_cov(met->mvnb, &cov);
+    pe_info(pe, "%30s\t\t%s\n", "Covariance ", mvn_cov_name(cov));
+    if(cov == MVN_COV_BANDED)
+    {
+      mvn_block_band(met->mvnb, &band);
+      pe_info(pe, "%30s\t\t%d\n", "Band ", band);
+    }
+    if(cov == MVN_COV_LOWRANK)
+    {
+      mvn_block_rank(met->mvnb, &rank);
+      pe_info(pe, "%30s\t\t%d\n", "Rank ", rank);
+    }
     pe_info(pe, "%30s\t\t%f\n", "Step Size ", rwsd);
     pe_info(pe, "%30s\t\t%s\n", "Tune ", tune_rw_sd>0 ? "True" : "False");
+    if(tune_rw_sd)
+    {
+      mvn_block_target(met->mvnb, &target);
+      pe_info(pe, "%30s\t\t%f\n", "Target Acceptance ", target);
+    }
+    mvn_block_adapt(met->mvnb, &adapt);
+    pe_info(pe, "%30s\t\t%s\n", "Adaptive (burn-in) ", adapt>0 ? "True" : "False");
+  }
+  if(met->lr)
+  {
+    lr_kernel_enum_t lr_kernel_value;
+    lr_kernel(met->lr, &lr_kernel_value);
+    pe_info(pe, "%30s\t\t%s\n", "Likelihood:", "Logistic Regression");
+    pe_info(pe, "%30s\t\t%s\n", "Kernel ", lr_kernel_name(lr_kernel_value));
+    if(lr_kernel_value == LR_KERNEL_SIMD)
+    {
+      simd_isa_enum_t isa;
+      lr_isa(met->lr, &isa);
+      pe_info(pe, "%30s\t\t%s\n", "SIMD ISA ", simd_isa_name(isa));
+    }
   }
-  if(met->lr) pe_info(pe, "%30s\t\t%s\n", "Likelihood:", "Logistic Regression");
 
 
   return 0;
@@ -165,6 +628,13 @@ int met_init(pe_t *pe, met_t *met){
   data_read_file(pe, met->data);  /* Load data */
   TIMER_stop(TIMER_LOAD_TRAIN);
 
+  if(met->nchains > 1)
+  {
+    met_ensemble_init(met);
+    TIMER_stop(TIMER_METROPOLIS_INIT);
+    return 0;
+  }
+
   /* Initialise first sample */
   sample_init_zero(met->current);
 
@@ -182,11 +652,52 @@ int met_init(pe_t *pe, met_t *met){
   ch_append_sample(0, sample, met->chain);
   ch_init_stats(0, met->chain);
 
-  /* Ensure sample update is completed before evaluating lhood */
-  if(met->lr) lhood = lr_lhood(met->lr, sample);
-  prior = pr_log_prob(sample, dim);
+  /* Burn-in adapts the proposal to the chain when asked to */
+  if(met->mvnb)
+  {
+    mvn_block_adapt(met->mvnb, &met->adapting);
+    if(met->adapting) mvn_block_adapt_update(met->mvnb, sample);
+    mvn_block_tune(met->mvnb, &met->tuning);
+  }
+
+  /* Ensure sample update is completed before evaluating lhood; the
+   * gradient-based steps carry the gradient of the current state along */
+  if(met->grad_current)
+  {
+    lhood = lr_lhood_grad(met->lr, sample, met->grad_current);
+    prior = pr_log_prob_grad(sample, dim, met->grad_current);
+
+    met->adapting_mass = met->mass_adapt;
+    met->mass_n = 0;
+    met->mass_window = MASS_WINDOW_DEFAULT;
+
+    /* nuts adapts its step by dual averaging instead of tune_sd */
+    if(met->algorithm == MET_ALGORITHM_NUTS)
+    {
+      met->tuning = 0;
+      met->adapting_step = 1;
+      met->divergences = 0;
+      met_nuts_adapt_restart(met);
+    }
+  }
+  else
+  {
+    if(met->lr) lhood = lr_lhood(met->lr, sample);
+    prior = pr_log_prob(sample, dim);
+  }
   posterior = prior + lhood;
 
+  /* Every Gibbs draw is kept, nothing to adapt or tune; the omegas of
+   * the first sweep come from the initial state */
+  if(met->algorithm == MET_ALGORITHM_PG_GIBBS)
+  {
+    lr_pg_kappa(met->lr, met->pg_kappa);
+    met->adapting = 0;
+    met->tuning = 0;
+    met->sweeps = 0;
+    lr_pg_precision(met->lr, sample, met->sweeps++, met->pg_xwx);
+  }
+
   sample_prior_set(met->current, prior);
   sample_likelihood_set(met->current, lhood);
   sample_posterior_set(met->current, posterior);
@@ -199,22 +710,60 @@ int met_init(pe_t *pe, met_t *met){
 int met_init_post_burn(pe_t *pe, met_t *met){
 
   precision *sample = NULL;
+  precision rwsd, scale;
+  int k;
 
   assert(pe);
   assert(met);
 
+  /* Freeze the proposal for the post burn-in chain */
+  if(met->adapting_step)
+  {
+    met->step_size = exp(met->da_log_eps_bar);
+    pe_info(pe, "\n%30s\t\t%f\n", "Adapted Leapfrog Step:", met->step_size);
+  }
+  else if(met->tuning && met->grad_current)
+  {
+    mvn_block_scale(met->mvnb, &scale);
+    pe_info(pe, "\n%30s\t\t%f (scale %f)\n", "Tuned Leapfrog Step:", scale*met->step_size, scale);
+  }
+  else if(met->tuning)
+  {
+    mvn_block_rwsd(met->mvnb, &rwsd);
+    mvn_block_scale(met->mvnb, &scale);
+    pe_info(pe, "\n%30s\t\t%f (scale %f)\n", "Tuned Step Size:", scale*scale*rwsd, scale);
+  }
+  met->adapting = 0;
+  met->tuning = 0;
+  met->adapting_mass = 0;
+  met->adapting_step = 0;
+
   /* Reset stats for post burn-in chain */
   sample_values(met->current, &sample);
   ch_append_sample(0, sample, met->chain);
   ch_init_stats(0, met->chain);
 
+  if(met->infr) infr_stream_push(met->infr, 0, sample, 1);
+
+  for(k=1; k<met->nchains; k++)
+  {
+    sample_values(met->currents[k], &sample);
+    ch_append_sample(0, sample, met->chains[k]);
+    ch_init_stats(0, met->chains[k]);
+  }
+
   return 0;
 }
 
 int met_run(pe_t *pe, met_t *met){
 
-  int steps, i;
+  int steps, i, k;
+  int *accepted = NULL;
+  int *depth = NULL, *grads = NULL;
+  precision mean_depth, mean_grads;
   precision probability = 0.0;
+  precision *probabilities = NULL;
+  precision *sample = NULL;
 
   assert(pe);
   assert(met);
@@ -222,18 +771,107 @@ int met_run(pe_t *pe, met_t *met){
   ch_N(met->chain, &steps);
   pe_info(pe, "\nStarting metropolis run for %d steps..\n", steps);
 
+  met->tree_depth = 0;
+  met->tree_level = 0;
+
   for(i=1; i<steps+1; i++)
   {
     TIMER_start(TIMER_STEP);
 
-    if(met->mvnb) sample_propose_mvnb(met->mvnb, met->current, met->proposed);
-    if(met->lr) probability = sample_evaluate_lr(met->lr, met->current, met->proposed);
-    ch_append_probability(i, probability, met->chain);
-    sample_choose(i, met->chain, &met->current, &met->proposed);
+    if(met->prefetch > 0)
+    {
+      if(met->tree_level == met->tree_depth)
+        met_prefetch_tree(met, (steps+1-i < met->prefetch) ? steps+1-i : met->prefetch);
+      met_prefetch_step(met, i);
+    }
+    else if(met->algorithm == MET_ALGORITHM_PT && i%met->swap_every == 0)
+    {
+      met_pt_swap(met, i);
+    }
+    else if(met->nchains > 1)
+    {
+      met_ensemble_step(met, i);
+    }
+    else if(met->algorithm == MET_ALGORITHM_MTM)
+    {
+      met_mtm_step(met, i);
+    }
+    else if(met->algorithm == MET_ALGORITHM_NUTS)
+    {
+      met_nuts_step(met, i);
+    }
+    else if(met->algorithm == MET_ALGORITHM_PG_GIBBS)
+    {
+      met_pg_step(met, i);
+    }
+    else if(met->grad_current)
+    {
+      met_hmc_step(met, i);
+    }
+    else
+    {
+      if(met->mvnb) sample_propose_mvnb(met->mvnb, met->current, met->proposed);
+      if(met->lr) probability = sample_evaluate_lr(met->lr, met->current, met->proposed);
+      ch_append_probability(i, probability, met->chain);
+      sample_choose(i, met->chain, &met->current, &met->proposed, met->rng_accept);
+    }
+
+    if(met->adapting)
+    {
+      sample_values(met->current, &sample);
+      mvn_block_adapt_update(met->mvnb, sample);
+    }
+
+    if(met->adapting_mass) met_mass_update(met);
+
+    if(met->tuning)
+    {
+      /* Acceptance probability of this step, whichever algorithm made it */
+      ch_probability(met->chain, &probabilities);
+      mvn_block_tune_update(met->mvnb, probabilities[i]);
+    }
+
+    /* Row i of the chain is the current state, new if just accepted */
+    if(met->infr)
+    {
+      ch_accepted(met->chain, &accepted);
+      sample_values(met->current, &sample);
+      infr_stream_push(met->infr, i, sample, accepted[i] - accepted[i-1]);
+    }
 
     TIMER_stop(TIMER_STEP);
   }
 
+  /* A streamed chain is read back from its file from now on */
+  ch_flush(met->chain);
+  for(k=1; k<met->nchains; k++) ch_flush(met->chains[k]);
+
+  if(met->algorithm == MET_ALGORITHM_NUTS && steps > 0)
+  {
+    ch_tree(met->chain, &depth, &grads);
+    for(i=1, mean_depth=0.0, mean_grads=0.0; i<steps+1; i++)
+    {
+      mean_depth += depth[i];
+      mean_grads += grads[i];
+    }
+    pe_info(pe, "\n%30s\t\t%f\n", "Mean Tree Depth:", mean_depth/steps);
+    pe_info(pe, "%30s\t\t%f\n", "Mean Gradients per Step:", mean_grads/steps);
+    pe_info(pe, "%30s\t\t%d\n", "Divergences:", met->divergences);
+    met->divergences = 0;
+  }
+
+  if(met->algorithm == MET_ALGORITHM_PT)
+  {
+    pe_info(pe, "\n%30s\n", "Swap Acceptance:");
+    for(k=0; k<met->nchains-1; k++)
+    {
+      pe_info(pe, "%14s%.4f <-> %.4f\t\t%f\n", "beta ", met->betas[k], met->betas[k+1],
+              (met->swaps_tried[k] > 0) ? (double) met->swaps[k]/met->swaps_tried[k] : 0.0);
+      met->swaps[k] = 0;
+      met->swaps_tried[k] = 0;
+    }
+  }
+
   return 0;
 }
 
@@ -255,11 +893,146 @@ int met_random_init(met_t *met, int *random_init){
   return 0;
 }
 
+int met_algorithm_set(met_t *met, met_algorithm_enum_t algorithm){
+
+  assert(met);
+  assert(algorithm < MET_ALGORITHM_MAX);
+
+  met->algorithm = algorithm;
+
+  return 0;
+}
+
+int met_swap_every_set(met_t *met, int swap_every){
+
+  assert(met);
+  assert(swap_every > 0);
+
+  met->swap_every = swap_every;
+
+  return 0;
+}
+
+int met_prefetch_set(met_t *met, int depth){
+
+  int dim, nodes;
+
+  assert(met);
+  assert(depth >= 0);
+
+  free(met->tree_states);
+  free(met->tree_proposals);
+  free(met->tree_lhoods);
+  free(met->tree_noise);
+  free(met->tree_zero);
+  met->tree_states = NULL;
+  met->tree_proposals = NULL;
+  met->tree_lhoods = NULL;
+  met->tree_noise = NULL;
+  met->tree_zero = NULL;
+
+  met->prefetch = depth;
+  if(depth == 0) return 0;
+
+  sample_dim(met->current, &dim);
+  nodes = (1 << depth) - 1;
+
+  met->tree_states = (precision *) calloc(nodes*dim, sizeof(precision));
+  met->tree_proposals = (precision *) calloc(nodes*dim, sizeof(precision));
+  met->tree_lhoods = (precision *) calloc(nodes, sizeof(precision));
+  met->tree_noise = (precision *) calloc(depth*dim, sizeof(precision));
+  met->tree_zero = (precision *) calloc(dim, sizeof(precision));
+  if(met->tree_states == NULL || met->tree_proposals == NULL ||
+     met->tree_lhoods == NULL || met->tree_noise == NULL || met->tree_zero == NULL)
+    pe_fatal(met->pe, "calloc(met prefetch tree) failed\n");
+
+  return 0;
+}
+
+int met_step_size_set(met_t *met, precision step_size){
+
+  assert(met);
+  assert(step_size > 0.0);
+
+  met->step_size = step_size;
+
+  return 0;
+}
+
 int met_chain_set(met_t *met, ch_t *chain){
 
   assert(met);
 
   met->chain = chain;
+  if(met->nchains > 1) met->chains[0] = chain;
+
+  return 0;
+}
+
+int met_chains_set(met_t *met, ch_t **chains){
+
+  int k;
+
+  assert(met);
+  assert(chains);
+
+  met->chain = chains[0];
+  for(k=1; k<met->nchains; k++) met->chains[k] = chains[k];
+  if(met->nchains > 1) met->chains[0] = chains[0];
+
+  return 0;
+}
+
+int met_infr_set(met_t *met, infr_t *infr){
+
+  assert(met);
+
+  met->infr = infr;
+
+  return 0;
+}
+
+int met_algorithm(met_t *met, met_algorithm_enum_t *algorithm){
+
+  assert(met);
+
+  *algorithm = met->algorithm;
+
+  return 0;
+}
+
+int met_prefetch(met_t *met, int *depth){
+
+  assert(met);
+
+  *depth = met->prefetch;
+
+  return 0;
+}
+
+int met_step_size(met_t *met, precision *step_size){
+
+  assert(met);
+
+  *step_size = met->step_size;
+
+  return 0;
+}
+
+int met_inv_mass(met_t *met, precision **inv_mass){
+
+  assert(met);
+
+  *inv_mass = met->inv_mass;
+
+  return 0;
+}
+
+int met_nchains(met_t *met, int *nchains){
+
+  assert(met);
+
+  *nchains = met->nchains;
 
   return 0;
 }
@@ -326,3 +1099,982 @@ int met_proposed(met_t *met, sample_t **pproposed){
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  met_ensemble_init
+ *
+ *  First state of each chain of the ensemble, as met_init does for one.
+ *
+ *****************************************************************************/
+
+static int met_ensemble_init(met_t *met){
+
+  int k, dim;
+  precision *sample = NULL;
+  precision prior;
+
+  assert(met);
+
+  met->currents[0] = met->current;
+  met->proposeds[0] = met->proposed;
+
+  for(k=0; k<met->nchains; k++)
+  {
+    sample_init_zero(met->currents[k]);
+    if(met->random_init)
+    {
+      mvn_block_rng_set(met->mvnb, met->rng_proposals[k]);
+      sample_propose_mvnb(met->mvnb, met->currents[k], met->currents[k]);
+    }
+
+    sample_values(met->currents[k], &sample);
+    ch_append_sample(0, sample, met->chains[k]);
+    ch_init_stats(0, met->chains[k]);
+  }
+  mvn_block_rng_set(met->mvnb, met->rng_proposal);
+
+  met_ensemble_lhood(met, met->currents);
+
+  for(k=0; k<met->nchains; k++)
+  {
+    sample_values(met->currents[k], &sample);
+    sample_dim(met->currents[k], &dim);
+    prior = pr_log_prob(sample, dim);
+
+    sample_prior_set(met->currents[k], prior);
+    sample_likelihood_set(met->currents[k], met->lhoods[k]);
+    sample_posterior_set(met->currents[k], prior + met->betas[k]*met->lhoods[k]);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_ensemble_lhood
+ *
+ *  Likelihoods of one sample per chain, in a single pass over the data.
+ *
+ *****************************************************************************/
+
+static int met_ensemble_lhood(met_t *met, sample_t **samples){
+
+  int k, dim;
+  precision *values = NULL;
+
+  assert(met);
+  assert(samples);
+
+  sample_dim(samples[0], &dim);
+
+  for(k=0; k<met->nchains; k++)
+  {
+    sample_values(samples[k], &values);
+    memcpy(&met->values[k*dim], values, dim*sizeof(precision));
+  }
+
+  lr_lhood_multi(met->lr, met->values, met->nchains, met->lhoods);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_ensemble_step
+ *
+ *  Step i of every chain of the ensemble. Each chain proposes from its own
+ *  stream; the proposals are evaluated together before each chain accepts
+ *  or rejects its own.
+ *
+ *****************************************************************************/
+
+static int met_ensemble_step(met_t *met, int i){
+
+  int k;
+  precision probability;
+
+  assert(met);
+
+  met->currents[0] = met->current;
+  met->proposeds[0] = met->proposed;
+
+  for(k=0; k<met->nchains; k++)
+  {
+    mvn_block_rng_set(met->mvnb, met->rng_proposals[k]);
+    mvn_block_scale_set(met->mvnb, met->scales[k]);
+    sample_propose_mvnb(met->mvnb, met->currents[k], met->proposeds[k]);
+  }
+  mvn_block_rng_set(met->mvnb, met->rng_proposal);
+  mvn_block_scale_set(met->mvnb, met->scales[0]);
+
+  met_ensemble_lhood(met, met->proposeds);
+
+  for(k=0; k<met->nchains; k++)
+  {
+    probability = sample_evaluate_lhood(met->currents[k], met->proposeds[k],
+                                        met->lhoods[k], met->betas[k]);
+    ch_append_probability(i, probability, met->chains[k]);
+    sample_choose(i, met->chains[k], &met->currents[k], &met->proposeds[k],
+                  met->rng_accepts[k]);
+  }
+
+  met->current = met->currents[0];
+  met->proposed = met->proposeds[0];
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_prefetch_tree
+ *
+ *  Prefetching (Brockwell, J. Comput. Graph. Stat. 15, 246, 2006). The
+ *  next depth steps can only reach 2^depth - 1 distinct proposals: node n
+ *  (heap order) at level j holds a possible state, its proposal adds the
+ *  increment of step j, and its children 2n+1 and 2n+2 continue from the
+ *  proposal (accepted) or the state (rejected). The increments are drawn
+ *  once per level from the proposal stream, as the sequential steps would,
+ *  and all the proposals are evaluated in one pass over the data.
+ *
+ *****************************************************************************/
+
+static int met_prefetch_tree(met_t *met, int depth){
+
+  int d, j, n, dim, nodes;
+  precision *values = NULL;
+  precision *state = NULL, *proposal = NULL, *noise = NULL;
+
+  assert(met);
+  assert(depth > 0 && depth <= met->prefetch);
+
+  sample_dim(met->current, &dim);
+  sample_values(met->current, &values);
+  nodes = (1 << depth) - 1;
+
+  TIMER_start(TIMER_PROPOSAL);
+  for(j=0; j<depth; j++)
+    mvn_block_sample(met->mvnb, met->tree_zero, &met->tree_noise[j*dim]);
+  TIMER_stop(TIMER_PROPOSAL);
+
+  memcpy(met->tree_states, values, dim*sizeof(precision));
+
+  for(j=0; j<depth; j++)
+  {
+    noise = &met->tree_noise[j*dim];
+    for(n=(1 << j)-1; n<(1 << (j+1))-1; n++)
+    {
+      state = &met->tree_states[n*dim];
+      proposal = &met->tree_proposals[n*dim];
+      for(d=0; d<dim; d++) proposal[d] = state[d] + noise[d];
+
+      if(j < depth-1)
+      {
+        memcpy(&met->tree_states[(2*n+1)*dim], proposal, dim*sizeof(precision));
+        memcpy(&met->tree_states[(2*n+2)*dim], state, dim*sizeof(precision));
+      }
+    }
+  }
+
+  lr_lhood_multi(met->lr, met->tree_proposals, nodes, met->tree_lhoods);
+
+  met->tree_depth = depth;
+  met->tree_level = 0;
+  met->tree_node = 0;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_prefetch_step
+ *
+ *  Step i taken down the tree with the uniform of the acceptance stream.
+ *
+ *****************************************************************************/
+
+static int met_prefetch_step(met_t *met, int i){
+
+  int dim, n = met->tree_node;
+  precision probability;
+  precision *values = NULL;
+  sample_t *current = met->current;
+
+  sample_dim(met->proposed, &dim);
+  sample_values(met->proposed, &values);
+  memcpy(values, &met->tree_proposals[n*dim], dim*sizeof(precision));
+
+  probability = sample_evaluate_lhood(met->current, met->proposed, met->tree_lhoods[n], 1.0);
+  ch_append_probability(i, probability, met->chain);
+  sample_choose(i, met->chain, &met->current, &met->proposed, met->rng_accept);
+
+  met->tree_node = (met->current != current) ? 2*n+1 : 2*n+2;
+  met->tree_level++;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_algorithm_from_name
+ *
+ *  Returns 1 if the name matches an algorithm, 0 otherwise.
+ *
+ *****************************************************************************/
+
+int met_algorithm_from_name(const char *name, met_algorithm_enum_t *algorithm){
+
+  int n;
+
+  assert(name);
+  assert(algorithm);
+
+  for(n=0; n<MET_ALGORITHM_MAX; n++)
+  {
+    if(strcmp(name, met_algorithm_names[n]) == 0)
+    {
+      *algorithm = (met_algorithm_enum_t) n;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_algorithm_name
+ *
+ *****************************************************************************/
+
+const char *met_algorithm_name(met_algorithm_enum_t algorithm){
+
+  assert(algorithm < MET_ALGORITHM_MAX);
+
+  return met_algorithm_names[algorithm];
+}
+
+/*****************************************************************************
+ *
+ *  met_log_sum_exp
+ *
+ *****************************************************************************/
+
+static precision met_log_sum_exp(precision *a, int n){
+
+  int k;
+  precision amax = a[0], sum = 0.0;
+
+  for(k=1; k<n; k++) if(a[k] > amax) amax = a[k];
+  for(k=0; k<n; k++) sum += exp(a[k] - amax);
+
+  return amax + log(sum);
+}
+
+/*****************************************************************************
+ *
+ *  met_mtm_step
+ *
+ *  Multiple-try Metropolis (Liu, Liang and Wong, JASA 95, 121, 2000) with
+ *  the symmetric proposal and weights w(y) = pi(y). K candidates y_k are
+ *  drawn around x and one, y, is selected with probability proportional to
+ *  pi(y_k); K-1 reference points are drawn around y and x completes them.
+ *  y is accepted with probability
+ *
+ *    min(1, sum_k pi(y_k) / sum_k pi(x_k)).
+ *
+ *  The references depend on the selection, so each set is evaluated in a
+ *  pass of its own: two reductions per step whatever K.
+ *
+ *****************************************************************************/
+
+static int met_mtm_step(met_t *met, int i){
+
+  int k, dim, sel, K = met->tries;
+  precision u, cum, lnorm, probability;
+  precision *x = NULL, *y = NULL;
+  precision *cand = NULL, *refs = NULL;
+  precision *post = met->tries_posteriors;
+  precision *post_ref = &met->tries_posteriors[K];
+
+  assert(met);
+
+  sample_dim(met->current, &dim);
+  sample_values(met->current, &x);
+  cand = met->tries_values;
+  refs = &met->tries_values[K*dim];
+
+  /* Candidates around x */
+  TIMER_start(TIMER_PROPOSAL);
+  for(k=0; k<K; k++) mvn_block_sample(met->mvnb, x, &cand[k*dim]);
+  TIMER_stop(TIMER_PROPOSAL);
+
+  lr_lhood_multi(met->lr, cand, K, met->tries_lhoods);
+  for(k=0; k<K; k++) post[k] = pr_log_prob(&cand[k*dim], dim) + met->tries_lhoods[k];
+
+  /* Selection, from the acceptance stream when there is one: the proposal
+   * stream gives gaussians only, so neither depends on rng_buffer */
+  lnorm = met_log_sum_exp(post, K);
+  u = (met->rng_accept) ? (precision)ran_stream_uniform(met->rng_accept)
+                        : (precision)ran_serial_uniform();
+  cum = 0.0;
+  for(sel=0; sel<K-1; sel++)
+  {
+    cum += exp(post[sel] - lnorm);
+    if(u < cum) break;
+  }
+  y = &cand[sel*dim];
+
+  /* References around y, completed by x */
+  TIMER_start(TIMER_PROPOSAL);
+  for(k=0; k<K-1; k++) mvn_block_sample(met->mvnb, y, &refs[k*dim]);
+  TIMER_stop(TIMER_PROPOSAL);
+
+  if(K > 1) lr_lhood_multi(met->lr, refs, K-1, &met->tries_lhoods[K]);
+  for(k=0; k<K-1; k++)
+    post_ref[k] = pr_log_prob(&refs[k*dim], dim) + met->tries_lhoods[K+k];
+  sample_posterior(met->current, &post_ref[K-1]);
+
+  /* The selected candidate is the proposal of this step */
+  sample_values(met->proposed, &x);
+  memcpy(x, y, dim*sizeof(precision));
+  sample_evaluate_lhood(met->current, met->proposed, met->tries_lhoods[sel], 1.0);
+
+  probability = exp(lnorm - met_log_sum_exp(post_ref, K));
+  if(probability > 1.0) probability = 1.0;
+
+  ch_append_probability(i, probability, met->chain);
+  sample_choose(i, met->chain, &met->current, &met->proposed, met->rng_accept);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_pt_swap
+ *
+ *  Replica exchange (Swendsen and Wang, PRL 57, 2607, 1986) as step i of
+ *  every rung. Neighbours (k,k+1), from k = 0 or 1 in turn, exchange
+ *  their states with probability
+ *
+ *    min(1, exp((beta_k - beta_k+1) (L_k+1 - L_k)))
+ *
+ *  recorded in both chains as the acceptance of the step. A rung left out
+ *  of the pairs stays where it is.
+ *
+ *****************************************************************************/
+
+static int met_pt_swap(met_t *met, int i){
+
+  int k, c;
+  int swapped[2];
+  precision u, probability;
+  precision lhood[2], prior;
+  precision *values = NULL;
+  sample_t *tmp = NULL;
+
+  assert(met);
+
+  met->currents[0] = met->current;
+  met->proposeds[0] = met->proposed;
+
+  /* Rungs outside the pairs of this turn */
+  k = (i/met->swap_every)%2;
+  if(k == 1)
+  {
+    ch_append_probability(i, 0.0, met->chains[0]);
+    sample_values(met->currents[0], &values);
+    ch_repeat_sample(i, values, met->chains[0]);
+    ch_append_stats(i, 0, met->chains[0]);
+  }
+
+  for(; k<met->nchains; k+=2)
+  {
+    if(k == met->nchains-1)
+    {
+      ch_append_probability(i, 0.0, met->chains[k]);
+      sample_values(met->currents[k], &values);
+      ch_repeat_sample(i, values, met->chains[k]);
+      ch_append_stats(i, 0, met->chains[k]);
+      break;
+    }
+
+    sample_likelihood(met->currents[k], &lhood[0]);
+    sample_likelihood(met->currents[k+1], &lhood[1]);
+
+    probability = exp((met->betas[k] - met->betas[k+1]) * (lhood[1] - lhood[0]));
+    if(probability > 1.0) probability = 1.0;
+
+    u = (met->rng_swap) ? (precision)ran_stream_uniform(met->rng_swap)
+                        : (precision)ran_serial_uniform();
+
+    swapped[0] = swapped[1] = (u <= probability);
+    met->swaps[k] += swapped[0];
+    met->swaps_tried[k]++;
+
+    if(swapped[0])
+    {
+      tmp = met->currents[k];
+      met->currents[k] = met->currents[k+1];
+      met->currents[k+1] = tmp;
+    }
+
+    for(c=0; c<2; c++)
+    {
+      sample_likelihood(met->currents[k+c], &lhood[c]);
+      sample_prior(met->currents[k+c], &prior);
+      sample_posterior_set(met->currents[k+c], prior + met->betas[k+c]*lhood[c]);
+
+      ch_append_probability(i, probability, met->chains[k+c]);
+      sample_values(met->currents[k+c], &values);
+      if(swapped[c])
+        ch_append_sample(i, values, met->chains[k+c]);
+      else
+        ch_repeat_sample(i, values, met->chains[k+c]);
+      ch_append_stats(i, swapped[c], met->chains[k+c]);
+    }
+  }
+
+  met->current = met->currents[0];
+  met->proposed = met->proposeds[0];
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_hmc_step
+ *
+ *  Hamiltonian Monte Carlo (Duane et al., Phys. Lett. B 195, 216, 1987;
+ *  Neal, Handbook of MCMC, ch. 5, 2011). With momentum p ~ N(0, M), M
+ *  diagonal, the trajectory follows L leapfrog steps of size eps
+ *
+ *    p += eps/2 grad log pi(q),  q += eps M^-1 p,  p += eps/2 grad log pi(q)
+ *
+ *  from q = x, and ends at y accepted with probability
+ *
+ *    min(1, exp(log pi(y) - p'M^-1p'/2 - log pi(x) + p M^-1 p/2)).
+ *
+ *  L = 1 is the preconditioned Langevin proposal of mala with its
+ *  asymmetric correction. The gradient at x is kept from the step that
+ *  reached it, so a step costs L passes over the data.
+ *
+ *****************************************************************************/
+
+static int met_hmc_step(met_t *met, int i){
+
+  int d, l, dim;
+  precision eps = met->step_size, scale, z;
+  precision kinetic0, kinetic1;
+  precision posterior0, posterior1 = 0.0, probability;
+  precision *x = NULL, *tmp = NULL;
+  precision *p = met->momentum;
+  precision *g = met->grad_proposed;
+  precision *minv = met->inv_mass;
+  sample_t *current = met->current;
+
+  assert(met);
+
+  sample_dim(met->current, &dim);
+  sample_values(met->current, &x);
+  if(met->mvnb)
+  {
+    mvn_block_scale(met->mvnb, &scale);
+    eps *= scale;
+  }
+
+  /* Momentum, from the proposal stream when there is one */
+  TIMER_start(TIMER_PROPOSAL);
+  for(d=0; d<dim; d++)
+  {
+    z = (met->rng_proposal) ? (precision)ran_stream_gaussian(met->rng_proposal)
+                            : (precision)ran_serial_gaussian();
+    p[d] = z/sqrt(minv[d]);
+  }
+  TIMER_stop(TIMER_PROPOSAL);
+  kinetic0 = met_kinetic(met, p);
+
+  sample_copy_values(met->proposed, x);
+  memcpy(g, met->grad_current, dim*sizeof(precision));
+
+  for(l=0; l<met->leapfrog; l++)
+    posterior1 = met_leapfrog(met, eps, met->proposed, p, g);
+
+  kinetic1 = met_kinetic(met, p);
+  sample_posterior(met->current, &posterior0);
+
+  probability = exp(posterior1 - kinetic1 - posterior0 + kinetic0);
+  if(isnan(probability)) probability = 0.0; /* Diverged trajectory */
+  if(probability > 1.0) probability = 1.0;
+
+  ch_append_probability(i, probability, met->chain);
+  sample_choose(i, met->chain, &met->current, &met->proposed, met->rng_accept);
+
+  /* The gradient follows the state */
+  if(met->current != current)
+  {
+    tmp = met->grad_current;
+    met->grad_current = met->grad_proposed;
+    met->grad_proposed = tmp;
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_mass_update
+ *
+ *  Burn-in adaptation of the diagonal mass matrix in windows doubling from
+ *  MASS_WINDOW_DEFAULT steps: at the end of each, M^-1 becomes the variance
+ *  of the states of the window, shrunk towards 1e-3 as
+ *
+ *    M^-1 = (n var + 5e-3) / (n + 5),
+ *
+ *  and the next window starts afresh, leaving the transient behind.
+ *
+ *****************************************************************************/
+
+static int met_mass_update(met_t *met){
+
+  int d, dim, n;
+  precision delta;
+  precision *x = NULL;
+
+  assert(met);
+
+  sample_dim(met->current, &dim);
+  sample_values(met->current, &x);
+
+  met->mass_n += 1;
+  n = met->mass_n;
+  for(d=0; d<dim; d++)
+  {
+    delta = x[d] - met->mass_mean[d];
+    met->mass_mean[d] += delta/n;
+    met->mass_m2[d] += delta*(x[d] - met->mass_mean[d]);
+  }
+
+  if(n < met->mass_window) return 0;
+
+  for(d=0; d<dim; d++)
+  {
+    met->inv_mass[d] = (met->mass_m2[d]*n/(n-1) + 5.0e-3)/(n + 5);
+    met->mass_mean[d] = 0.0;
+    met->mass_m2[d] = 0.0;
+  }
+  met->mass_n = 0;
+  met->mass_window *= 2;
+
+  /* The step adapted to the old metric starts over */
+  if(met->adapting_step) met_nuts_adapt_restart(met);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_leapfrog
+ *
+ *  One leapfrog step of size eps (negative backwards in time) of the state
+ *  with momentum p and gradient g, all updated in place. The likelihood
+ *  and its gradient come in a single pass over the data. Returns the log
+ *  posterior of the new state, which the state also holds.
+ *
+ *****************************************************************************/
+
+precision met_leapfrog(met_t *met, precision eps, sample_t *state,
+                       precision *p, precision *g){
+
+  int d, dim;
+  precision lhood, prior;
+  precision *q = NULL;
+  precision *minv = met->inv_mass;
+
+  assert(met);
+  assert(state);
+
+  sample_dim(state, &dim);
+  sample_values(state, &q);
+
+  for(d=0; d<dim; d++)
+  {
+    p[d] += 0.5*eps*g[d];
+    q[d] += eps*minv[d]*p[d];
+  }
+  lhood = lr_lhood_grad(met->lr, q, g);
+  prior = pr_log_prob_grad(q, dim, g);
+  for(d=0; d<dim; d++) p[d] += 0.5*eps*g[d];
+
+  sample_prior_set(state, prior);
+  sample_likelihood_set(state, lhood);
+  sample_posterior_set(state, prior + lhood);
+
+  return prior + lhood;
+}
+
+/*****************************************************************************
+ *
+ *  met_kinetic
+ *
+ *  p M^-1 p / 2
+ *
+ *****************************************************************************/
+
+static precision met_kinetic(met_t *met, precision *p){
+
+  int d, dim;
+  precision kinetic = 0.0;
+
+  assert(met);
+
+  sample_dim(met->current, &dim);
+  for(d=0; d<dim; d++) kinetic += p[d]*p[d]*met->inv_mass[d];
+
+  return 0.5*kinetic;
+}
+
+/*****************************************************************************
+ *
+ *  met_uniform
+ *
+ *  From the acceptance stream when there is one, which like the
+ *  gaussian-only proposal stream then gives the same numbers whatever
+ *  rng_buffer.
+ *
+ *****************************************************************************/
+
+static precision met_uniform(met_t *met){
+
+  return (met->rng_accept) ? (precision)ran_stream_uniform(met->rng_accept)
+                           : (precision)ran_serial_uniform();
+}
+
+/*****************************************************************************
+ *
+ *  met_nuts_step
+ *
+ *  No-U-Turn sampler (Hoffman and Gelman, JMLR 15, 1593, 2014) with
+ *  multinomial sampling of the trajectory (Betancourt, arXiv:1701.02434).
+ *  From x with momentum p ~ N(0, M), the trajectory doubles in a random
+ *  direction: the new subtree of 2^j leaves continues from the endpoint
+ *  on that side and, unless it turns back or diverges, is merged, its
+ *  proposal taken with probability min(1, w_subtree / w_tree), where w is
+ *  the sum of exp(-H) over the leaves. Doubling stops when the endpoints
+ *  turn back, at nuts_max_depth, or at a rejected subtree.
+ *
+ *  The subtree is built leaf by leaf (Phan, Pradhan and Jankowiak,
+ *  arXiv:1912.11554): a leaf of even index opens sub-subtrees, whose first
+ *  momentum and momentum sum are kept at checkpoint popcount(n/2), and a
+ *  leaf of odd index closes as many as the ones trailing its index, each
+ *  checked for a U-turn. Only the endpoints, the leaf, the proposals and
+ *  max_depth checkpoints are held, whatever the length of the trajectory.
+ *
+ *  Row i of the chain holds the state drawn from the trajectory, accepted
+ *  if it is not x, with the mean acceptance statistic of the leaves as its
+ *  probability, and the depth and gradients of the step.
+ *
+ *****************************************************************************/
+
+static int met_nuts_step(met_t *met, int i){
+
+  int d, n, k, dim, leaves, side, trailing;
+  int depth = 0, grads = 0, nalpha = 0;
+  int turning = 0, diverged = 0, moved = 0;
+  int idx_min, idx_max;
+  precision eps = met->step_size, dir, z, a;
+  precision h0, h, lw_tree, lw_sub, alpha = 0.0;
+  precision *p_leaf = NULL, *g_leaf = NULL, *p_side = NULL;
+  precision *rho = met->nuts_rho, *rho_sub = met->nuts_rho_sub;
+  precision *ckpt_p = met->nuts_ckpt_p, *ckpt_rho = met->nuts_ckpt_rho;
+  precision *tmp = NULL;
+  sample_t **pool = met->nuts_pool;
+
+  assert(met);
+
+  sample_dim(met->current, &dim);
+  p_leaf = &met->nuts_p[NUTS_LEAF*dim];
+  g_leaf = &met->nuts_g[NUTS_LEAF*dim];
+
+  /* Momentum, from the proposal stream when there is one */
+  TIMER_start(TIMER_PROPOSAL);
+  for(d=0; d<dim; d++)
+  {
+    z = (met->rng_proposal) ? (precision)ran_stream_gaussian(met->rng_proposal)
+                            : (precision)ran_serial_gaussian();
+    rho[d] = z/sqrt(met->inv_mass[d]);
+  }
+  TIMER_stop(TIMER_PROPOSAL);
+
+  /* Both endpoints and the proposal start at x */
+  for(k=NUTS_LEFT; k<=NUTS_RIGHT; k++)
+  {
+    met_nuts_copy(pool[k], met->current);
+    memcpy(&met->nuts_p[k*dim], rho, dim*sizeof(precision));
+    memcpy(&met->nuts_g[k*dim], met->grad_current, dim*sizeof(precision));
+  }
+  met_nuts_copy(met->proposed, met->current);
+  memcpy(met->grad_proposed, met->grad_current, dim*sizeof(precision));
+
+  sample_posterior(met->current, &h0);
+  h0 = -h0 + met_kinetic(met, rho);
+  lw_tree = -h0;
+
+  while(depth < met->max_depth)
+  {
+    dir = (met_uniform(met) < 0.5) ? -1.0 : 1.0;
+    side = (dir > 0.0) ? NUTS_RIGHT : NUTS_LEFT;
+    leaves = 1 << depth;
+    depth++;
+
+    met_nuts_copy(pool[NUTS_LEAF], pool[side]);
+    memcpy(p_leaf, &met->nuts_p[side*dim], dim*sizeof(precision));
+    memcpy(g_leaf, &met->nuts_g[side*dim], dim*sizeof(precision));
+    for(d=0; d<dim; d++) rho_sub[d] = 0.0;
+    lw_sub = -INFINITY;
+
+    for(n=0; n<leaves; n++)
+    {
+      h = -met_leapfrog(met, dir*eps, pool[NUTS_LEAF], p_leaf, g_leaf);
+      h += met_kinetic(met, p_leaf);
+      grads++;
+
+      a = exp(h0 - h);
+      if(isnan(a)) a = 0.0;
+      alpha += (a > 1.0) ? 1.0 : a;
+      nalpha++;
+
+      if(!(h - h0 < NUTS_MAX_DELTA))
+      {
+        diverged = 1;
+        break;
+      }
+
+      /* Leaf drawn in proportion to exp(-H) within the subtree */
+      lw_sub = (lw_sub > -h) ? lw_sub + log1p(exp(-h - lw_sub)) : -h + log1p(exp(lw_sub + h));
+      if(n == 0 || log(met_uniform(met)) < -h - lw_sub)
+      {
+        met_nuts_copy(pool[NUTS_SUBTREE], pool[NUTS_LEAF]);
+        memcpy(&met->nuts_g[NUTS_SUBTREE*dim], g_leaf, dim*sizeof(precision));
+      }
+
+      for(d=0; d<dim; d++) rho_sub[d] += p_leaf[d];
+
+      /* Sub-subtrees opened and closed at leaf n */
+      idx_max = __builtin_popcount(n >> 1);
+      for(trailing=0; (n >> trailing) & 1; trailing++);
+      idx_min = idx_max - trailing + 1;
+
+      if(n%2 == 0)
+      {
+        memcpy(&ckpt_p[idx_max*dim], p_leaf, dim*sizeof(precision));
+        memcpy(&ckpt_rho[idx_max*dim], rho_sub, dim*sizeof(precision));
+        continue;
+      }
+
+      tmp = met->nuts_tmp;
+      for(k=idx_max; k>=idx_min && !turning; k--)
+      {
+        for(d=0; d<dim; d++) tmp[d] = rho_sub[d] - ckpt_rho[k*dim+d] + ckpt_p[k*dim+d];
+        turning = met_nuts_turning(met, &ckpt_p[k*dim], p_leaf, tmp);
+      }
+      if(turning) break;
+    }
+
+    if(diverged || turning) break;
+
+    /* The subtree extends the trajectory on its side */
+    p_side = &met->nuts_p[side*dim];
+    met_nuts_copy(pool[side], pool[NUTS_LEAF]);
+    memcpy(p_side, p_leaf, dim*sizeof(precision));
+    memcpy(&met->nuts_g[side*dim], g_leaf, dim*sizeof(precision));
+
+    if(log(met_uniform(met)) < lw_sub - lw_tree)
+    {
+      met_nuts_copy(met->proposed, pool[NUTS_SUBTREE]);
+      memcpy(met->grad_proposed, &met->nuts_g[NUTS_SUBTREE*dim], dim*sizeof(precision));
+      moved = 1;
+    }
+    lw_tree = (lw_tree > lw_sub) ? lw_tree + log1p(exp(lw_sub - lw_tree))
+                                 : lw_sub + log1p(exp(lw_tree - lw_sub));
+
+    for(d=0; d<dim; d++) rho[d] += rho_sub[d];
+    if(met_nuts_turning(met, &met->nuts_p[NUTS_LEFT*dim], &met->nuts_p[NUTS_RIGHT*dim], rho))
+      break;
+  }
+
+  met->divergences += diverged;
+
+  /* The draw is certain: accepted if it moved, recorded with the mean
+   * acceptance statistic of the trajectory */
+  ch_append_probability(i, moved ? 1.0 : 0.0, met->chain);
+  sample_choose(i, met->chain, &met->current, &met->proposed, met->rng_accept);
+  ch_append_probability(i, alpha/nalpha, met->chain);
+  ch_append_tree(i, depth, grads, met->chain);
+
+  if(moved)
+  {
+    tmp = met->grad_current;
+    met->grad_current = met->grad_proposed;
+    met->grad_proposed = tmp;
+  }
+
+  if(met->adapting_step) met_nuts_adapt(met, alpha/nalpha);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_nuts_turning
+ *
+ *  Generalised U-turn criterion (Betancourt, arXiv:1304.1920) of the
+ *  trajectory with end momenta p_left and p_right and momentum sum rho:
+ *  the velocity at either end no longer points along rho less half of
+ *  each end.
+ *
+ *****************************************************************************/
+
+static int met_nuts_turning(met_t *met, precision *p_left, precision *p_right,
+                            precision *rho){
+
+  int d, dim;
+  precision r, left = 0.0, right = 0.0;
+
+  assert(met);
+
+  sample_dim(met->current, &dim);
+  for(d=0; d<dim; d++)
+  {
+    r = rho[d] - 0.5*(p_left[d] + p_right[d]);
+    left += met->inv_mass[d]*p_left[d]*r;
+    right += met->inv_mass[d]*p_right[d]*r;
+  }
+
+  return (left <= 0.0 || right <= 0.0);
+}
+
+/*****************************************************************************
+ *
+ *  met_nuts_adapt
+ *
+ *  Dual averaging of log eps on the acceptance statistic alpha of the
+ *  step t,
+ *
+ *    hbar = (1 - 1/(t + t0)) hbar + (target - alpha)/(t + t0)
+ *    log eps = mu - sqrt(t)/gamma hbar
+ *    log eps_bar = t^-kappa log eps + (1 - t^-kappa) log eps_bar,
+ *
+ *  eps_bar being the step of the post burn-in chain.
+ *
+ *****************************************************************************/
+
+static int met_nuts_adapt(met_t *met, precision alpha){
+
+  precision eta, log_eps, w;
+
+  assert(met);
+
+  met->da_t += 1;
+  eta = 1.0/(met->da_t + NUTS_T0);
+  met->da_hbar = (1.0 - eta)*met->da_hbar + eta*(met->target - alpha);
+  log_eps = met->da_mu - sqrt((precision)met->da_t)/NUTS_GAMMA*met->da_hbar;
+  w = pow((precision)met->da_t, -NUTS_KAPPA);
+  met->da_log_eps_bar = w*log_eps + (1.0 - w)*met->da_log_eps_bar;
+  met->step_size = exp(log_eps);
+
+  return 0;
+}
+
+static int met_nuts_adapt_restart(met_t *met){
+
+  assert(met);
+
+  met->da_mu = log(10.0*met->step_size);
+  met->da_hbar = 0.0;
+  met->da_log_eps_bar = log(met->step_size);
+  met->da_t = 0;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_nuts_copy
+ *
+ *****************************************************************************/
+
+static int met_nuts_copy(sample_t *dst, sample_t *src){
+
+  precision *values = NULL;
+  precision value;
+
+  assert(dst);
+  assert(src);
+
+  sample_values(src, &values);
+  sample_copy_values(dst, values);
+  sample_prior(src, &value);
+  sample_prior_set(dst, value);
+  sample_likelihood(src, &value);
+  sample_likelihood_set(dst, value);
+  sample_posterior(src, &value);
+  sample_posterior_set(dst, value);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  met_pg_step
+ *
+ *  Polya-Gamma Gibbs sweep (Polson, Scott and Windle, JASA 108, 1339,
+ *  2013). With omega_n ~ PG(1, theta^T x_n), theta given omega is
+ *
+ *    N(P^-1 X^T kappa, P^-1),  P = X^T Omega X + B^-1,  kappa_n = y_n / 2,
+ *
+ *  B the prior covariance. With P = L L^T, theta = L^-T (L^-1 X^T kappa + z)
+ *  for z ~ N(0, I). X^T Omega X comes from the pass over the data that
+ *  ended the previous sweep (or met_init); the pass of this sweep, with
+ *  the new theta, draws the omegas of the next one and gives the
+ *  likelihood of theta. One pass and one Allreduce per sweep.
+ *
+ *****************************************************************************/
+
+static int met_pg_step(met_t *met, int i){
+
+  int d, dim, info;
+  precision prior, lhood;
+  precision *theta = NULL;
+  precision *P = met->pg_xwx;
+
+  assert(met);
+
+  sample_dim(met->current, &dim);
+  sample_values(met->proposed, &theta);
+
+  for(d=0; d<dim; d++) P[d*dim+d] += pr_inv_variance();
+
+  info = POTRF(LAPACK_ROW_MAJOR, 'L', dim, P, dim);
+  if(info != 0) pe_fatal(met->pe, "Polya-Gamma precision not positive definite (%d)\n", info);
+
+  memcpy(theta, met->pg_kappa, dim*sizeof(precision));
+  TRSV(CblasRowMajor, CblasLower, CblasNoTrans, CblasNonUnit, dim, P, dim, theta, 1);
+
+  TIMER_start(TIMER_PROPOSAL);
+  for(d=0; d<dim; d++) theta[d] += (precision)ran_stream_gaussian(met->rng_proposal);
+  TIMER_stop(TIMER_PROPOSAL);
+
+  TRSV(CblasRowMajor, CblasLower, CblasTrans, CblasNonUnit, dim, P, dim, theta, 1);
+
+  lhood = lr_pg_precision(met->lr, theta, met->sweeps++, P);
+  prior = pr_log_prob(theta, dim);
+  sample_prior_set(met->proposed, prior);
+  sample_likelihood_set(met->proposed, lhood);
+  sample_posterior_set(met->proposed, prior + lhood);
+
+  ch_append_probability(i, 1.0, met->chain);
+  sample_choose(i, met->chain, &met->current, &met->proposed, met->rng_accept);
+
+  return 0;
+}
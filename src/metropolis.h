@@ -8,9 +8,28 @@
 #include "multivariate_normal.h"
 #include "logistic_regression.h"
 #include "sample.h"
+#include "inference.h"
 
 typedef struct met_s met_t;
 
+/* Sampling algorithms of mcmc_algorithm: random walk Metropolis,
+ * multiple-try Metropolis with mtm_tries candidates per step, parallel
+ * tempering over a ladder of pt_temperatures chains, or the gradient-based
+ * Metropolis-adjusted Langevin algorithm, Hamiltonian Monte Carlo and the
+ * No-U-Turn sampler, or Gibbs sampling of the Polya-Gamma augmented
+ * logistic regression */
+typedef enum {MET_ALGORITHM_METROPOLIS = 0,
+              MET_ALGORITHM_MTM,
+              MET_ALGORITHM_PT,
+              MET_ALGORITHM_MALA,
+              MET_ALGORITHM_HMC,
+              MET_ALGORITHM_NUTS,
+              MET_ALGORITHM_PG_GIBBS,
+              MET_ALGORITHM_MAX} met_algorithm_enum_t;
+
+int met_algorithm_from_name(const char *name, met_algorithm_enum_t *algorithm);
+const char *met_algorithm_name(met_algorithm_enum_t algorithm);
+
 int met_create(pe_t *pe, ch_t *chain, met_t **pmet);
 int met_free(met_t *met);
 
@@ -22,9 +41,20 @@ int met_init_post_burn(pe_t *pe, met_t *met);
 int met_run(pe_t *pe, met_t *met);
 
 int met_random_init_set(met_t *met, int random_init);
+int met_algorithm_set(met_t *met, met_algorithm_enum_t algorithm);
+int met_swap_every_set(met_t *met, int swap_every);
+int met_prefetch_set(met_t *met, int depth);
+int met_step_size_set(met_t *met, precision step_size);
 int met_chain_set(met_t *met, ch_t *chain);
+int met_chains_set(met_t *met, ch_t **chains);
+int met_infr_set(met_t *met, infr_t *infr);
 
 int met_random_init(met_t *met, int *random_init);
+int met_algorithm(met_t *met, met_algorithm_enum_t *algorithm);
+int met_prefetch(met_t *met, int *depth);
+int met_step_size(met_t *met, precision *step_size);
+int met_inv_mass(met_t *met, precision **inv_mass);
+int met_nchains(met_t *met, int *nchains);
 int met_chain(met_t *met, ch_t **pchain);
 int met_data(met_t *met, data_t **pdata);
 int met_mvnb(met_t *met, mvnb_t **pmvnb);
@@ -33,4 +63,7 @@ int met_dc(met_t *met, dc_t **pdc);
 int met_current(met_t *met, sample_t **pcurrent);
 int met_proposed(met_t *met, sample_t **pproposed);
 
+precision met_leapfrog(met_t *met, precision eps, sample_t *state,
+                       precision *p, precision *g);
+
 #endif // __METROPOLIS_H__
@@ -12,15 +12,43 @@
 #include "ran.h"
 
 struct mvnb_s{
-  precision *covariance;
-  precision *L;
+  pe_t *pe;
+  precision *covariance;  /* Layout depends on cov, see multivariate_normal.h */
+  precision *L;           /* Factor of the covariance, same layout */
+  precision *noise;       /* Normals of the low-rank part */
   int dim;
   precision rwsd_block;
   int tune;
+  mvn_cov_enum_t cov;     /* Structure of the covariance */
+  int band;               /* Off-diagonals kept by MVN_COV_BANDED */
+  int rank;               /* Columns of U with MVN_COV_LOWRANK */
+  int adapt;              /* Adapt the covariance to the chain (burn-in) */
+  int nadapt;             /* States adapted to so far */
+  precision *mean;        /* Their running mean */
+  precision *delta;       /* Work vector of the rank-1 update */
+  precision *d0;          /* Initial diagonal D (lowrank) */
+  precision *m2;          /* Diagonal of the deviations summed so far (lowrank) */
+  precision *sketch;      /* 2*rank rows summarising the deviations (lowrank) */
+  precision *top;         /* Diagonal of the first rank rows of the sketch */
+  precision *work;        /* Banded factor being built, or sketch shrink space */
+  int nsketch;            /* Rows of the sketch in use */
+  precision scale;        /* Step scale on the factor, tuned in burn-in */
+  precision target;       /* Acceptance rate the tuning aims for */
+  int ntune;              /* Steps tuned so far */
+  ran_stream_t *rng;  /* Proposal stream, or NULL for the serial generator */
 };
 
+static const char *mvn_cov_names[MVN_COV_MAX] = {"dense", "diagonal", "banded",
+                                                 "lowrank"};
+
 static int mvn_block_allocate_covariance(mvnb_t *mvnb);
 static int mvn_block_allocate_L(mvnb_t *mvnb);
+static int mvn_block_size(mvnb_t *mvnb);
+static precision mvn_block_gaussian(mvnb_t *mvnb);
+static int mvn_block_cholesky_rank1(mvnb_t *mvnb, precision *v, int sign);
+static int mvn_block_cholesky_banded(mvnb_t *mvnb, precision *L);
+static int mvn_block_adapt_lowrank(mvnb_t *mvnb, int t, precision n);
+static int mvn_block_sketch_shrink(mvnb_t *mvnb);
 
 /*****************************************************************************
  *
@@ -38,9 +66,17 @@ int mvn_block_create(pe_t *pe, mvnb_t **pmvnb){
   assert(mvnb);
   if(mvnb == NULL) pe_fatal(pe, "calloc(mvnb_t) failed\n");
 
+  mvnb->pe = pe;
+
   mvn_block_dim_set(mvnb, DIMX_DEFAULT);
   mvn_block_rwsd_set(mvnb, RWSD_DEFAULT);
   mvn_block_tune_set(mvnb, TUNE_DEFAULT);
+  mvn_cov_from_name(PROPOSAL_COV_DEFAULT, &mvnb->cov);
+  mvn_block_band_set(mvnb, PROPOSAL_COV_BAND_DEFAULT);
+  mvn_block_rank_set(mvnb, PROPOSAL_COV_RANK_DEFAULT);
+  mvn_block_adapt_set(mvnb, ADAPT_COV_DEFAULT);
+  mvn_block_scale_set(mvnb, 1.0);
+  mvn_block_target_set(mvnb, TUNE_TARGET_DEFAULT);
 
   *pmvnb = mvnb;
 
@@ -59,6 +95,14 @@ int mvn_block_free(mvnb_t *mvnb){
 
   mem_free((void**)&mvnb->covariance);
   mem_free((void**)&mvnb->L);
+  mem_free((void**)&mvnb->noise);
+  mem_free((void**)&mvnb->mean);
+  mem_free((void**)&mvnb->delta);
+  mem_free((void**)&mvnb->d0);
+  mem_free((void**)&mvnb->m2);
+  mem_free((void**)&mvnb->sketch);
+  mem_free((void**)&mvnb->top);
+  mem_free((void**)&mvnb->work);
 
   mem_free((void**)&mvnb);
 
@@ -67,7 +111,9 @@ int mvn_block_free(mvnb_t *mvnb){
 
 int mvn_block_init_rt(rt_t *rt, mvnb_t *mvnb){
 
-  int dim, tune;
+  int dim, tune, band, rank, adapt, cov_rt;
+  double target;
+  char cov[BUFSIZ];
 
   assert(rt);
   assert(mvnb);
@@ -85,6 +131,45 @@ int mvn_block_init_rt(rt_t *rt, mvnb_t *mvnb){
     mvn_block_tune_set(mvnb, tune);
   }
 
+  cov_rt = rt_string_parameter(rt, "proposal_cov", cov, BUFSIZ);
+  if(cov_rt)
+  {
+    if(mvn_cov_from_name(cov, &mvnb->cov) == 0)
+    {
+      pe_fatal(mvnb->pe, "Unrecognised proposal_cov \"%s\"\n", cov);
+    }
+  }
+
+  if(rt_int_parameter(rt, "proposal_cov_band", &band))
+  {
+    if(band < 0) pe_fatal(mvnb->pe, "proposal_cov_band must not be negative\n");
+    mvn_block_band_set(mvnb, band);
+  }
+
+  if(rt_int_parameter(rt, "proposal_cov_rank", &rank))
+  {
+    if(rank < 1) pe_fatal(mvnb->pe, "proposal_cov_rank must be positive\n");
+    mvn_block_rank_set(mvnb, rank);
+  }
+
+  if(rt_double_parameter(rt, "tune_target", &target))
+  {
+    if(target <= 0.0 || target >= 1.0) pe_fatal(mvnb->pe, "tune_target must lie in (0,1)\n");
+    mvn_block_target_set(mvnb, target);
+  }
+
+  if(rt_int_parameter(rt, "adapt_cov", &adapt))
+  {
+    mvn_block_adapt_set(mvnb, adapt);
+  }
+
+  /* Off-diagonal band and U are only ever filled by the adaptation */
+  if(cov_rt && !mvnb->adapt &&
+     (mvnb->cov == MVN_COV_BANDED || mvnb->cov == MVN_COV_LOWRANK))
+  {
+    pe_fatal(mvnb->pe, "proposal_cov %s needs adapt_cov 1\n", cov);
+  }
+
   mvn_block_allocate_covariance(mvnb);
   mvn_block_allocate_L(mvnb);
 
@@ -116,15 +201,30 @@ int mvn_block_init(mvnb_t *mvnb){
 
 int mvn_block_init_covariance(mvnb_t *mvnb){
 
-  int i;
+  int i, stride, offset = 0;
 
   assert(mvnb);
 
   /* Generate Covariance Matrix
    */
-   memset(mvnb->covariance, 0, mvnb->dim*mvnb->dim*sizeof(double));
-   /* Copy std on the diagonal */
-   for(i=0; i<mvnb->dim; i++) mvnb->covariance[i*mvnb->dim+i] = mvnb->rwsd_block;
+   memset(mvnb->covariance, 0, mvn_block_size(mvnb)*sizeof(precision));
+
+   /* Copy std on the diagonal; off-diagonal and low-rank terms start at zero */
+   if(mvnb->cov == MVN_COV_DENSE)
+   {
+     stride = mvnb->dim + 1;
+   }
+   else if(mvnb->cov == MVN_COV_BANDED)
+   {
+     stride = mvnb->band + 1;
+     offset = mvnb->band;
+   }
+   else
+   {
+     stride = 1;
+   }
+
+   for(i=0; i<mvnb->dim; i++) mvnb->covariance[i*stride+offset] = mvnb->rwsd_block;
 
   return 0;
 }
@@ -137,10 +237,25 @@ int mvn_block_init_covariance(mvnb_t *mvnb){
 
 int mvn_block_cholesky_decomp(mvnb_t *mvnb){
 
-  int i,j;
+  int i, j, size;
 
   assert(mvnb);
 
+  if(mvnb->cov == MVN_COV_DIAGONAL || mvnb->cov == MVN_COV_LOWRANK)
+  {
+    /* Square root of the diagonal; U is used as it is */
+    size = mvn_block_size(mvnb);
+    for(i=0; i<size; i++) mvnb->L[i] = mvnb->covariance[i];
+    for(i=0; i<mvnb->dim; i++) mvnb->L[i] = sqrt(mvnb->covariance[i]);
+    return 0;
+  }
+
+  if(mvnb->cov == MVN_COV_BANDED)
+  {
+    mvn_block_cholesky_banded(mvnb, mvnb->L);
+    return 0;
+  }
+
   for(i=0; i<mvnb->dim; i++)
     for(j=0; j<mvnb->dim; j++)
       mvnb->L[i*mvnb->dim+j] = mvnb->covariance[i*mvnb->dim+j];
@@ -162,7 +277,8 @@ int mvn_block_cholesky_decomp(mvnb_t *mvnb){
 
 int mvn_block_sample(mvnb_t *mvnb, precision *cur, precision *pro){
 
-  int i;
+  int i, j, k, b, r;
+  precision sum;
 
   assert(mvnb);
   assert(pro);
@@ -171,15 +287,164 @@ int mvn_block_sample(mvnb_t *mvnb, precision *cur, precision *pro){
   int dim = mvnb->dim;
   precision *L = mvnb->L;
 
-  /* Sample from standard normal distribution */
-  for(i=0; i<dim; i++) pro[i] = ran_serial_gaussian();
+  /* Sample from standard normal distribution, scaled by the tuned step
+   * rather than rescaling the factor */
+  for(i=0; i<dim; i++) pro[i] = mvnb->scale*mvn_block_gaussian(mvnb);
+
+  switch(mvnb->cov)
+  {
+    case MVN_COV_DIAGONAL:
+      for(i=0; i<dim; i++) pro[i] = cur[i] + L[i]*pro[i];
+      break;
+
+    case MVN_COV_BANDED:
+      /* Row i of L only reaches back band columns; going backwards
+       * leaves the normals still needed untouched */
+      b = mvnb->band;
+      for(i=dim-1; i>=0; i--)
+      {
+        sum = 0.0;
+        for(j=(i-b > 0 ? i-b : 0); j<=i; j++) sum += L[i*(b+1) + b-(i-j)] * pro[j];
+        pro[i] = sum;
+      }
+      for(i=0; i<dim; i++) pro[i] += cur[i];
+      break;
+
+    case MVN_COV_LOWRANK:
+      /* D^1/2 z + U w has covariance D + U U^T */
+      r = mvnb->rank;
+      for(k=0; k<r; k++) mvnb->noise[k] = mvnb->scale*mvn_block_gaussian(mvnb);
+      for(i=0; i<dim; i++)
+      {
+        sum = L[i]*pro[i];
+        for(k=0; k<r; k++) sum += L[dim + i*r+k] * mvnb->noise[k];
+        pro[i] = cur[i] + sum;
+      }
+      break;
+
+    default:
+      /* Triangular matrix to vector multiplication
+      *  using the cholesky decomposed covariance matrix
+      */
+      TRMV(CblasRowMajor, CblasLower, CblasNoTrans, CblasNonUnit, dim, L, dim, pro, 1);
+
+      for(i=0; i<dim; i++) pro[i] += cur[i];
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  mvn_block_adapt_update
+ *
+ *  Adaptive Metropolis (Haario et al., Bernoulli 7, 223, 2001).
+ *  The t-th state x moves the running mean (Welford) and the covariance
+ *
+ *    S_t = (n_{t-1} S_{t-1} + s_d (t-1)/t d d^T) / n_t,  d = x - mean_{t-1}
+ *
+ *  with s_d = 2.38^2/dim and n_t = dim + t - 1. S is then the scaled
+ *  sample covariance plus the initial covariance, worth dim states, which
+ *  fades as 1/t in place of Haario's eps*I. The factor follows S by a
+ *  rescale and one rank-1 Cholesky update, O(dim^2) (O(dim) diagonal).
+ *  A banded S keeps its band and refactors it, O(dim*band^2); a low-rank
+ *  S takes U from a sketch of the deviations, O(dim*rank).
+ *
+ *****************************************************************************/
+
+int mvn_block_adapt_update(mvnb_t *mvnb, precision *x){
+
+  int i, j, w, dim, t;
+  precision a, b, n;
+
+  assert(mvnb);
+  assert(x);
+
+  dim = mvnb->dim;
+
+  if(mvnb->mean == NULL) mem_malloc_precision(&mvnb->mean, dim);
+  if(mvnb->delta == NULL) mem_malloc_precision(&mvnb->delta, dim);
+
+  t = ++mvnb->nadapt;
+
+  for(i=0; i<dim; i++)
+  {
+    mvnb->delta[i] = (t > 1) ? x[i] - mvnb->mean[i] : 0.0;
+    mvnb->mean[i] = (t > 1) ? mvnb->mean[i] + mvnb->delta[i] / t : x[i];
+  }
+
+  if(t == 1) return 0;
+
+  n = dim + t - 1;
+  a = (n - 1.0) / n;
+  b = (2.38*2.38/dim) * (t - 1.0) / (t * n);
+
+  if(mvnb->cov == MVN_COV_DIAGONAL)
+  {
+    for(i=0; i<dim; i++)
+    {
+      mvnb->covariance[i] = a*mvnb->covariance[i] + b*mvnb->delta[i]*mvnb->delta[i];
+      mvnb->L[i] = sqrt(mvnb->covariance[i]);
+    }
+    return 0;
+  }
+
+  if(mvnb->cov == MVN_COV_BANDED)
+  {
+    /* The band of a positive definite matrix need not be one; the last
+     * good factor is then kept until the band recovers */
+    w = mvnb->band;
+    for(i=0; i<dim; i++)
+      for(j=(i-w > 0 ? i-w : 0); j<=i; j++)
+        mvnb->covariance[i*(w+1) + w-(i-j)] = a*mvnb->covariance[i*(w+1) + w-(i-j)]
+                                            + b*mvnb->delta[i]*mvnb->delta[j];
+
+    if(mvnb->work == NULL) mem_malloc_precision(&mvnb->work, mvn_block_size(mvnb));
+    if(mvn_block_cholesky_banded(mvnb, mvnb->work) == 0)
+      memcpy(mvnb->L, mvnb->work, mvn_block_size(mvnb)*sizeof(precision));
+    return 0;
+  }
+
+  if(mvnb->cov == MVN_COV_LOWRANK) return mvn_block_adapt_lowrank(mvnb, t, n);
+
+  for(i=0; i<dim; i++)
+  {
+    for(j=0; j<dim; j++)
+    {
+      mvnb->covariance[i*dim+j] = a*mvnb->covariance[i*dim+j]
+                                + b*mvnb->delta[i]*mvnb->delta[j];
+    }
+    for(j=0; j<=i; j++) mvnb->L[i*dim+j] *= sqrt(a);
+  }
+
+  for(i=0; i<dim; i++) mvnb->delta[i] *= sqrt(b);
+  mvn_block_cholesky_rank1(mvnb, mvnb->delta, +1);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  mvn_block_tune_update
+ *
+ *  Robbins-Monro on the log of the step scale,
+ *
+ *    log scale += t^-0.6 (alpha - target),
+ *
+ *  after the t-th step, accepted with probability alpha. Proposals are
+ *  drawn as scale * L z, so the factor is never rescaled or recomputed.
+ *
+ *****************************************************************************/
+
+int mvn_block_tune_update(mvnb_t *mvnb, precision alpha){
+
+  precision gain;
 
-  /* Triangular matrix to vector multiplication
-  *  using the cholesky decomposed covariance matrix
-  */
-  TRMV(CblasRowMajor, CblasLower, CblasNoTrans, CblasNonUnit, dim, L, dim, pro, 1);
+  assert(mvnb);
 
-  for(i=0; i<dim; i++) pro[i] += cur[i];
+  mvnb->ntune += 1;
+  gain = pow((precision) mvnb->ntune, -0.6);
+  mvnb->scale *= exp(gain*(alpha - mvnb->target));
 
   return 0;
 }
@@ -211,6 +476,70 @@ int mvn_block_tune_set(mvnb_t *mvnb, int tune){
   return 0;
 }
 
+int mvn_block_cov_set(mvnb_t *mvnb, mvn_cov_enum_t cov){
+
+  assert(mvnb);
+  assert(cov < MVN_COV_MAX);
+
+  mvnb->cov = cov;
+
+  return 0;
+}
+
+int mvn_block_band_set(mvnb_t *mvnb, int band){
+
+  assert(mvnb);
+
+  mvnb->band = band;
+
+  return 0;
+}
+
+int mvn_block_rank_set(mvnb_t *mvnb, int rank){
+
+  assert(mvnb);
+
+  mvnb->rank = rank;
+
+  return 0;
+}
+
+int mvn_block_adapt_set(mvnb_t *mvnb, int adapt){
+
+  assert(mvnb);
+
+  mvnb->adapt = adapt;
+
+  return 0;
+}
+
+int mvn_block_scale_set(mvnb_t *mvnb, precision scale){
+
+  assert(mvnb);
+
+  mvnb->scale = scale;
+
+  return 0;
+}
+
+int mvn_block_target_set(mvnb_t *mvnb, precision target){
+
+  assert(mvnb);
+
+  mvnb->target = target;
+
+  return 0;
+}
+
+int mvn_block_rng_set(mvnb_t *mvnb, ran_stream_t *rng){
+
+  assert(mvnb);
+
+  mvnb->rng = rng;
+
+  return 0;
+}
+
 int mvn_block_dim(mvnb_t *mvnb, int *dim){
 
   assert(mvnb);
@@ -238,6 +567,60 @@ int mvn_block_tune(mvnb_t *mvnb, int *tune){
   return 0;
 }
 
+int mvn_block_cov(mvnb_t *mvnb, mvn_cov_enum_t *cov){
+
+  assert(mvnb);
+
+  *cov = mvnb->cov;
+
+  return 0;
+}
+
+int mvn_block_band(mvnb_t *mvnb, int *band){
+
+  assert(mvnb);
+
+  *band = mvnb->band;
+
+  return 0;
+}
+
+int mvn_block_rank(mvnb_t *mvnb, int *rank){
+
+  assert(mvnb);
+
+  *rank = mvnb->rank;
+
+  return 0;
+}
+
+int mvn_block_adapt(mvnb_t *mvnb, int *adapt){
+
+  assert(mvnb);
+
+  *adapt = mvnb->adapt;
+
+  return 0;
+}
+
+int mvn_block_scale(mvnb_t *mvnb, precision *scale){
+
+  assert(mvnb);
+
+  *scale = mvnb->scale;
+
+  return 0;
+}
+
+int mvn_block_target(mvnb_t *mvnb, precision *target){
+
+  assert(mvnb);
+
+  *target = mvnb->target;
+
+  return 0;
+}
+
 int mvn_block_covariance(mvnb_t *mvnb, precision **covariance){
 
   assert(mvnb);
@@ -260,7 +643,7 @@ static int mvn_block_allocate_covariance(mvnb_t *mvnb){
 
   assert(mvnb);
 
-  mem_malloc_precision(&mvnb->covariance, mvnb->dim*mvnb->dim);
+  mem_malloc_precision(&mvnb->covariance, mvn_block_size(mvnb));
 
   return 0;
 }
@@ -269,7 +652,286 @@ static int mvn_block_allocate_L(mvnb_t *mvnb){
 
    assert(mvnb);
 
-   mem_malloc_precision(&mvnb->L, mvnb->dim*mvnb->dim);
+   mem_malloc_precision(&mvnb->L, mvn_block_size(mvnb));
+   if(mvnb->cov == MVN_COV_LOWRANK) mem_malloc_precision(&mvnb->noise, mvnb->rank);
 
    return 0;
  }
+
+/*****************************************************************************
+ *
+ *  mvn_block_size
+ *
+ *  Number of values stored for the covariance (and its factor).
+ *
+ *****************************************************************************/
+
+static int mvn_block_size(mvnb_t *mvnb){
+
+  assert(mvnb);
+
+  switch(mvnb->cov)
+  {
+    case MVN_COV_DIAGONAL: return mvnb->dim;
+    case MVN_COV_BANDED:   return mvnb->dim*(mvnb->band+1);
+    case MVN_COV_LOWRANK:  return mvnb->dim*(mvnb->rank+1);
+    default:               return mvnb->dim*mvnb->dim;
+  }
+}
+
+/*****************************************************************************
+ *
+ *  mvn_block_gaussian
+ *
+ *  One standard normal from the proposal stream, or the serial generator.
+ *
+ *****************************************************************************/
+
+static precision mvn_block_gaussian(mvnb_t *mvnb){
+
+  if(mvnb->rng) return (precision) ran_stream_gaussian(mvnb->rng);
+
+  return (precision) ran_serial_gaussian();
+}
+
+/*****************************************************************************
+ *
+ *  mvn_cov_from_name
+ *  returns 1 if the name matches a structure, 0 otherwise
+ *
+ *****************************************************************************/
+
+int mvn_cov_from_name(const char *name, mvn_cov_enum_t *cov){
+
+  int n;
+
+  for(n=0; n<MVN_COV_MAX; n++)
+  {
+    if(strcmp(name, mvn_cov_names[n]) == 0)
+    {
+      *cov = (mvn_cov_enum_t) n;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  mvn_cov_name
+ *
+ *****************************************************************************/
+
+const char *mvn_cov_name(mvn_cov_enum_t cov){
+
+  assert(cov < MVN_COV_MAX);
+
+  return mvn_cov_names[cov];
+}
+
+/*****************************************************************************
+ *
+ *  mvn_block_cholesky_rank1
+ *
+ *  Turns the dense factor L of A into the factor of A + sign v v^T in
+ *  O(dim^2), overwriting v. A downdate (sign < 0) must leave A positive
+ *  definite.
+ *
+ *****************************************************************************/
+
+static int mvn_block_cholesky_rank1(mvnb_t *mvnb, precision *v, int sign){
+
+  int i, k, dim;
+  precision r, c, s, Lkk;
+  precision *L = NULL;
+
+  assert(mvnb);
+  assert(v);
+
+  dim = mvnb->dim;
+  L = mvnb->L;
+
+  for(k=0; k<dim; k++)
+  {
+    Lkk = L[k*dim+k];
+    r = sqrt(Lkk*Lkk + sign*v[k]*v[k]);
+    c = r / Lkk;
+    s = v[k] / Lkk;
+    L[k*dim+k] = r;
+
+    for(i=k+1; i<dim; i++)
+    {
+      L[i*dim+k] = (L[i*dim+k] + sign*s*v[i]) / c;
+      v[i] = c*v[i] - s*L[i*dim+k];
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  mvn_block_cholesky_banded
+ *
+ *  Factor of the banded covariance into L (same layout), which keeps the
+ *  band, O(dim*band^2). Row i holds entries (i, i-band) .. (i, i),
+ *  diagonal last. Returns -1 at the first pivot that is not positive.
+ *
+ *****************************************************************************/
+
+static int mvn_block_cholesky_banded(mvnb_t *mvnb, precision *L){
+
+  int i, j, k, b;
+  precision sum;
+
+  assert(mvnb);
+  assert(L);
+
+  b = mvnb->band;
+  for(i=0; i<mvnb->dim; i++)
+  {
+    for(j=(i-b > 0 ? i-b : 0); j<=i; j++)
+    {
+      sum = mvnb->covariance[i*(b+1) + b-(i-j)];
+      for(k=(i-b > 0 ? i-b : 0); k<j; k++)
+        sum -= L[i*(b+1) + b-(i-k)] * L[j*(b+1) + b-(j-k)];
+
+      if(j < i)
+      {
+        L[i*(b+1) + b-(i-j)] = sum / L[j*(b+1) + b];
+      }
+      else
+      {
+        if(sum <= 0.0) return -1;
+        L[i*(b+1) + b] = sqrt(sum);
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  mvn_block_adapt_lowrank
+ *
+ *  D + U U^T after the t-th state, with n = dim + t - 1. The deviations
+ *  sqrt((t-1)/t) d enter a frequent-directions sketch (Liberty, KDD 2013)
+ *  of 2*rank rows, whose first rank rows R satisfy R^T R <= M, the sum of
+ *  d d^T. Then
+ *
+ *    U = sqrt(s_d/n) R^T,  D = (dim*D0 + s_d*(diag M - diag R^T R))/n,
+ *
+ *  so the diagonal of D + U U^T is that of the dense adaptation exactly
+ *  and U carries the leading directions of M.
+ *
+ *****************************************************************************/
+
+static int mvn_block_adapt_lowrank(mvnb_t *mvnb, int t, precision n){
+
+  int i, k, dim, r;
+  precision w, sd, c, m;
+
+  assert(mvnb);
+
+  dim = mvnb->dim;
+  r = mvnb->rank;
+  sd = 2.38*2.38/dim;
+
+  if(mvnb->sketch == NULL)
+  {
+    mem_malloc_precision(&mvnb->d0, dim);
+    mem_malloc_precision(&mvnb->m2, dim);
+    mem_malloc_precision(&mvnb->top, dim);
+    mem_malloc_precision(&mvnb->sketch, 2*r*dim);
+    mem_malloc_precision(&mvnb->work, 4*r*r + 2*r + r*dim);
+    for(i=0; i<dim; i++)
+    {
+      mvnb->d0[i] = mvnb->covariance[i];
+      mvnb->m2[i] = 0.0;
+    }
+    mvnb->nsketch = 0;
+  }
+
+  w = sqrt((t - 1.0) / t);
+  k = mvnb->nsketch++;
+  for(i=0; i<dim; i++)
+  {
+    mvnb->m2[i] += w*w*mvnb->delta[i]*mvnb->delta[i];
+    mvnb->sketch[k*dim+i] = w*mvnb->delta[i];
+  }
+
+  if(mvnb->nsketch == 2*r) mvn_block_sketch_shrink(mvnb);
+
+  /* The first rank rows only change while filling or on a shrink */
+  if(k < r || mvnb->nsketch == r)
+  {
+    for(i=0; i<dim; i++) mvnb->top[i] = 0.0;
+    for(k=0; k<r && k<mvnb->nsketch; k++)
+      for(i=0; i<dim; i++) mvnb->top[i] += mvnb->sketch[k*dim+i]*mvnb->sketch[k*dim+i];
+  }
+
+  c = sqrt(sd / n);
+  for(i=0; i<dim; i++)
+  {
+    m = mvnb->m2[i] - mvnb->top[i];
+    mvnb->covariance[i] = (dim*mvnb->d0[i] + sd*(m > 0.0 ? m : 0.0)) / n;
+    mvnb->L[i] = sqrt(mvnb->covariance[i]);
+    for(k=0; k<r; k++)
+    {
+      mvnb->covariance[dim + i*r+k] = (k < mvnb->nsketch) ? c*mvnb->sketch[k*dim+i] : 0.0;
+      mvnb->L[dim + i*r+k] = mvnb->covariance[dim + i*r+k];
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  mvn_block_sketch_shrink
+ *
+ *  The full sketch B (2*rank rows) is replaced by its rank leading
+ *  directions, each squared singular value lowered by the (rank+1)-th.
+ *  These come from the eigenvectors of the small Gram matrix B B^T,
+ *  O(rank^2*dim); the freed rows take the next deviations.
+ *
+ *****************************************************************************/
+
+static int mvn_block_sketch_shrink(mvnb_t *mvnb){
+
+  int i, j, k, v, dim, r, l;
+  precision shift, s;
+  precision *gram = NULL, *lambda = NULL, *rows = NULL;
+
+  assert(mvnb);
+
+  dim = mvnb->dim;
+  r = mvnb->rank;
+  l = 2*r;
+  gram = mvnb->work;
+  lambda = &mvnb->work[l*l];
+  rows = &mvnb->work[l*l + l];
+
+  SYRK(CblasRowMajor, CblasLower, CblasNoTrans, l, dim, 1.0, mvnb->sketch, dim,
+       0.0, gram, l);
+  /* Eigenvalues ascending, eigenvector v in column v */
+  SYEV(LAPACK_ROW_MAJOR, 'V', 'L', l, gram, l, lambda);
+
+  shift = lambda[l-r-1];
+  for(k=0; k<r; k++)
+  {
+    v = l-1-k;
+    s = (lambda[v] > shift) ? sqrt((lambda[v] - shift) / lambda[v]) : 0.0;
+    for(i=0; i<dim; i++) rows[k*dim+i] = 0.0;
+    for(j=0; j<l; j++)
+      for(i=0; i<dim; i++) rows[k*dim+i] += s*gram[j*l+v]*mvnb->sketch[j*dim+i];
+  }
+
+  for(i=0; i<r*dim; i++) mvnb->sketch[i] = rows[i];
+  for(i=r*dim; i<l*dim; i++) mvnb->sketch[i] = 0.0;
+  mvnb->nsketch = r;
+
+  return 0;
+}
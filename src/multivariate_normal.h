@@ -4,9 +4,23 @@
 #include "definitions.h"
 #include "pe.h"
 #include "runtime.h"
+#include "ran.h"
 
 typedef struct mvnb_s mvnb_t;
 
+/* Structure of the proposal covariance and how it is stored:
+ *   dense     dim*dim row-major matrix, factor lower triangular
+ *   diagonal  dim variances, factor their square roots
+ *   banded    dim rows of band+1 values, entries (i,i-band)..(i,i),
+ *             factor lower banded
+ *   lowrank   D + U U^T as dim values of D followed by U (dim x rank,
+ *             row-major), factor sqrt(D) followed by U */
+typedef enum {MVN_COV_DENSE = 0,
+              MVN_COV_DIAGONAL,
+              MVN_COV_BANDED,
+              MVN_COV_LOWRANK,
+              MVN_COV_MAX} mvn_cov_enum_t;
+
 int mvn_block_create(pe_t *pe, mvnb_t **pmvnb);
 int mvn_block_free(mvnb_t *mvnb);
 
@@ -15,15 +29,33 @@ int mvn_block_init(mvnb_t *mvnb);
 int mvn_block_init_covariance(mvnb_t *mvnb);
 int mvn_block_cholesky_decomp(mvnb_t *mvnb);
 int mvn_block_sample(mvnb_t *mvnb, precision *cur, precision *pro);
+int mvn_block_adapt_update(mvnb_t *mvnb, precision *x);
+int mvn_block_tune_update(mvnb_t *mvnb, precision alpha);
 
 int mvn_block_dim_set(mvnb_t *mvnb, int dim);
 int mvn_block_rwsd_set(mvnb_t *mvnb, precision rwsd);
 int mvn_block_tune_set(mvnb_t *mvnb, int tune);
+int mvn_block_cov_set(mvnb_t *mvnb, mvn_cov_enum_t cov);
+int mvn_block_band_set(mvnb_t *mvnb, int band);
+int mvn_block_rank_set(mvnb_t *mvnb, int rank);
+int mvn_block_adapt_set(mvnb_t *mvnb, int adapt);
+int mvn_block_scale_set(mvnb_t *mvnb, precision scale);
+int mvn_block_target_set(mvnb_t *mvnb, precision target);
+int mvn_block_rng_set(mvnb_t *mvnb, ran_stream_t *rng);
 
 int mvn_block_dim(mvnb_t *mvnb, int *dim);
 int mvn_block_rwsd(mvnb_t *mvnb, precision *rwsd);
 int mvn_block_tune(mvnb_t *mvnb, int *tune);
+int mvn_block_cov(mvnb_t *mvnb, mvn_cov_enum_t *cov);
+int mvn_block_band(mvnb_t *mvnb, int *band);
+int mvn_block_rank(mvnb_t *mvnb, int *rank);
+int mvn_block_adapt(mvnb_t *mvnb, int *adapt);
+int mvn_block_scale(mvnb_t *mvnb, precision *scale);
+int mvn_block_target(mvnb_t *mvnb, precision *target);
 int mvn_block_covariance(mvnb_t *mvnb, precision **covariance);
 int mvn_block_L(mvnb_t *mvnb, precision **L);
 
+int mvn_cov_from_name(const char *name, mvn_cov_enum_t *cov);
+const char *mvn_cov_name(mvn_cov_enum_t cov);
+
 #endif // __MVN_H__
@@ -0,0 +1,10 @@
+#ifndef __POLYA_GAMMA_H__
+#define __POLYA_GAMMA_H__
+
+#include "definitions.h"
+#include "ran.h"
+
+precision pg_draw(precision z, ran_stream_t *rng);
+precision pg_mean(precision z);
+
+#endif // __POLYA_GAMMA_H__
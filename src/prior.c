@@ -32,6 +32,28 @@ precision pr_log_prob(precision *sample, int dim){
   return priorProb;
 }
 
+/* As pr_log_prob, adding d/dx log N(x; 0, sd) = -x/sd^2 to grad */
+precision pr_log_prob_grad(precision *sample, int dim, precision *grad){
+
+  assert(sample);
+  assert(grad);
+
+  int i;
+
+  for(i=0; i<dim; i++)
+  {
+    grad[i] -= sample[i]/((precision)PRIOR_SD*PRIOR_SD);
+  }
+
+  return pr_log_prob(sample, dim);
+}
+
+
+/* 1/sd^2 of each component, the prior precision matrix being diagonal */
+precision pr_inv_variance(void){
+
+  return 1.0/((precision)PRIOR_SD*PRIOR_SD);
+}
 
 static precision pr_normal_prob(precision sample, precision sd){
 
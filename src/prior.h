@@ -4,5 +4,7 @@
 #include "definitions.h"
 
 precision pr_log_prob(precision *sample, int dim);
+precision pr_log_prob_grad(precision *sample, int dim, precision *grad);
+precision pr_inv_variance(void);
 
 #endif // __PRIOR_H__
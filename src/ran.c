@@ -14,7 +14,12 @@
 
 #include <assert.h>
 #include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "definitions.h"
 #include "pe.h"
 #include "ran.h"
 #include "runtime.h"
@@ -28,8 +33,37 @@ struct lecuyer {
 static struct lecuyer p_rng;      /* Parallel generator */
 static struct lecuyer s_rng;      /* Serial generator */
 
+/* A counter-based stream. The key is (seed, chain); the 128-bit counter
+ * is (block index, purpose, 0). Each block gives two uniforms of 53 bits,
+ * so any position is reached without generating the ones before it. */
+
+struct ran_stream_s {
+  uint32_t key[2];                /* Seed and chain */
+  uint32_t purpose;               /* ran_purpose_enum_t */
+  uint64_t pos;                   /* Uniforms drawn so far */
+  uint64_t nblock;                /* Index of the cached block */
+  uint32_t block[4];              /* Cached block */
+  int      cached;                /* Flag for ditto */
+  double   rspare;                /* Spare Gaussian random number */
+  int      ispare;                /* Flag for ditto */
+  int      nbuf;                  /* Size of the buffers, 0 for none */
+  double * ubuf;                  /* Uniforms generated ahead */
+  double * gbuf;                  /* Gaussians generated ahead */
+  int      uleft;                 /* Numbers left in ubuf */
+  int      gleft;                 /* Numbers left in gbuf */
+};
+
+static ran_rng_enum_t rng_type = RAN_RNG_LECUYER;
+static int rng_seed = 7361237;
+static int rng_buffer = 0;
+
+static const char * ran_rng_names[RAN_RNG_MAX] = {"lecuyer", "philox"};
+
 static double ran_gaussian(struct lecuyer *);
 static double ran_lecuyer(struct lecuyer *);
+static double ran_stream_next(ran_stream_t *);
+static void ran_stream_generate(ran_stream_t *, double *, int);
+static void ran_box_muller(double * REST, int);
 
 #define _rmodulus 4.656612873077393e-10
 #define _m        2147483647
@@ -61,6 +95,7 @@ int ran_init_rt(pe_t * pe, rt_t * rt) {
 
   int n;
   int scalar_seed = 7361237;
+  char name[BUFSIZ];
 
   assert(pe);
   assert(rt);
@@ -78,6 +113,37 @@ int ran_init_rt(pe_t * pe, rt_t * rt) {
 
   ran_init_seed(pe, scalar_seed);
 
+  /* Look for "rng" in the user input, or use the default generator. */
+
+  ran_rng_from_name(RNG_DEFAULT, &rng_type);
+  n = rt_string_parameter(rt, "rng", name, BUFSIZ);
+
+  if (n == 0) {
+    pe_info(pe, "[Default] Random number generator: %s\n", RNG_DEFAULT);
+  }
+  else {
+    if (ran_rng_from_name(name, &rng_type) == 0) {
+      pe_fatal(pe, "Unrecognised rng \"%s\"\n", name);
+    }
+    pe_info(pe, "[User   ] Random number generator: %s\n", name);
+  }
+
+  /* Look for "rng_buffer", the numbers a stream generates ahead. */
+
+  rng_buffer = RNG_BUFFER_DEFAULT;
+  n = rt_int_parameter(rt, "rng_buffer", &rng_buffer);
+
+  if (rng_buffer < 0) pe_fatal(pe, "rng_buffer must not be negative\n");
+
+  if (rng_type == RAN_RNG_PHILOX) {
+    if (n == 0) {
+      pe_info(pe, "[Default] Random number buffer: %d\n", rng_buffer);
+    }
+    else {
+      pe_info(pe, "[User   ] Random number buffer: %d\n", rng_buffer);
+    }
+  }
+
   return 0;
 }
 
@@ -85,6 +151,8 @@ int ran_init_seed(pe_t * pe, int scalar_seed) {
 
   assert(pe);
 
+  rng_seed = scalar_seed;
+
   /* Serial generator */
 
   s_rng.ispare = 0;
@@ -108,6 +176,64 @@ int ran_init_seed(pe_t * pe, int scalar_seed) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  ran_rng_from_name
+ *
+ *  Returns 1 if the name matches a generator, 0 otherwise.
+ *
+ *****************************************************************************/
+
+int ran_rng_from_name(const char * name, ran_rng_enum_t * rng) {
+
+  int n;
+
+  assert(name);
+  assert(rng);
+
+  for (n = 0; n < RAN_RNG_MAX; n++) {
+    if (strcmp(name, ran_rng_names[n]) == 0) {
+      *rng = (ran_rng_enum_t) n;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ran_rng_set
+ *  ran_rng
+ *  ran_seed
+ *  ran_buffer
+ *
+ *  The generator selected at run time, the seed in use and the size
+ *  of the stream buffers.
+ *
+ *****************************************************************************/
+
+int ran_rng_set(ran_rng_enum_t rng) {
+
+  assert(rng < RAN_RNG_MAX);
+
+  rng_type = rng;
+
+  return 0;
+}
+
+ran_rng_enum_t ran_rng(void) {
+  return rng_type;
+}
+
+int ran_seed(void) {
+  return rng_seed;
+}
+
+int ran_buffer(void) {
+  return rng_buffer;
+}
+
 /*****************************************************************************
  *
  *  ran_serial_uniform
@@ -213,3 +339,397 @@ static double ran_lecuyer(struct lecuyer * rng) {
 
   return (_rmodulus*rng->rstate[0]);
 }
+
+/*****************************************************************************
+ *
+ *  ran_stream_create
+ *
+ *  A Philox stream for the given seed, chain and purpose. Streams with
+ *  any different key component are independent, and a stream gives the
+ *  same numbers on every rank and thread that creates it.
+ *
+ *****************************************************************************/
+
+int ran_stream_create(int seed, int chain, ran_purpose_enum_t purpose,
+                      ran_stream_t ** pstream) {
+
+  ran_stream_t * stream = NULL;
+
+  assert(pstream);
+  assert(purpose < RAN_PURPOSE_MAX);
+
+  stream = (ran_stream_t *) calloc(1, sizeof(ran_stream_t));
+  assert(stream);
+
+  stream->key[0] = (uint32_t) seed;
+  stream->key[1] = (uint32_t) chain;
+  stream->purpose = (uint32_t) purpose;
+
+  *pstream = stream;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ran_stream_free
+ *
+ *****************************************************************************/
+
+int ran_stream_free(ran_stream_t * stream) {
+
+  assert(stream);
+
+  free(stream->ubuf);
+  free(stream->gbuf);
+  free(stream);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ran_stream_skip
+ *
+ *  Moves the stream n uniforms ahead in O(1). A spare Gaussian and
+ *  any buffered numbers are discarded.
+ *
+ *****************************************************************************/
+
+int ran_stream_skip(ran_stream_t * stream, unsigned long long n) {
+
+  assert(stream);
+
+  stream->pos += n;
+  stream->ispare = 0;
+  stream->uleft = 0;
+  stream->gleft = 0;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ran_stream_reset
+ *
+ *  Turns the stream into that of another chain, at position pos, as if
+ *  created afresh and skipped. One stream object can so serve many keys,
+ *  e.g. one per datapoint, without allocating each.
+ *
+ *****************************************************************************/
+
+int ran_stream_reset(ran_stream_t * stream, int chain, unsigned long long pos) {
+
+  assert(stream);
+
+  stream->key[1] = (uint32_t) chain;
+  stream->cached = 0;
+  ran_stream_skip(stream, pos - stream->pos);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ran_stream_position
+ *
+ *  Number of uniforms generated (drawn, buffered or skipped) by the stream.
+ *
+ *****************************************************************************/
+
+unsigned long long ran_stream_position(ran_stream_t * stream) {
+
+  assert(stream);
+
+  return stream->pos;
+}
+
+/*****************************************************************************
+ *
+ *  ran_stream_buffer_set
+ *
+ *  Numbers are generated n at a time, an even number, by the bulk
+ *  kernels below; single draws then read the buffer. A stream drawn
+ *  for one kind of number gives the same sequence with or without the
+ *  buffer. n = 0 removes the buffer.
+ *
+ *****************************************************************************/
+
+int ran_stream_buffer_set(ran_stream_t * stream, int n) {
+
+  assert(stream);
+  assert(n >= 0);
+
+  free(stream->ubuf);
+  free(stream->gbuf);
+  stream->ubuf = NULL;
+  stream->gbuf = NULL;
+  stream->uleft = 0;
+  stream->gleft = 0;
+
+  stream->nbuf = n + (n & 1);
+
+  if (stream->nbuf > 0) {
+    stream->ubuf = (double *) malloc(stream->nbuf*sizeof(double));
+    stream->gbuf = (double *) malloc(stream->nbuf*sizeof(double));
+    assert(stream->ubuf);
+    assert(stream->gbuf);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ran_stream_uniform
+ *
+ *  Uniform on the open interval (0,1) with 53 random bits.
+ *
+ *****************************************************************************/
+
+double ran_stream_uniform(ran_stream_t * stream) {
+
+  assert(stream);
+
+  if (stream->ubuf) {
+    if (stream->uleft == 0) {
+      ran_stream_generate(stream, stream->ubuf, stream->nbuf);
+      stream->uleft = stream->nbuf;
+    }
+    return stream->ubuf[stream->nbuf - stream->uleft--];
+  }
+
+  return ran_stream_next(stream);
+}
+
+/*****************************************************************************
+ *
+ *  ran_stream_next
+ *
+ *  The next uniform of the stream, from the cached block if it holds it.
+ *
+ *****************************************************************************/
+
+static double ran_stream_next(ran_stream_t * stream) {
+
+  uint32_t ctr[4];
+  uint32_t * b = NULL;
+  uint64_t nblock;
+  int offset;
+
+  assert(stream);
+
+  nblock = stream->pos >> 1;
+  offset = 2*(int)(stream->pos & 1);
+
+  if (stream->cached == 0 || stream->nblock != nblock) {
+    ctr[0] = (uint32_t) nblock;
+    ctr[1] = (uint32_t) (nblock >> 32);
+    ctr[2] = stream->purpose;
+    ctr[3] = 0;
+    ran_philox4x32(ctr, stream->key, stream->block);
+    stream->nblock = nblock;
+    stream->cached = 1;
+  }
+
+  stream->pos += 1;
+  b = stream->block + offset;
+
+  return ((double) (b[0] >> 5)*67108864.0 + (double) (b[1] >> 6) + 0.5)
+    / 9007199254740992.0;
+}
+
+/*****************************************************************************
+ *
+ *  ran_stream_gaussian
+ *
+ *  Unit variance Gaussian by Box-Muller. It takes exactly two uniforms
+ *  per pair, so the position in the stream stays predictable.
+ *
+ *****************************************************************************/
+
+double ran_stream_gaussian(ran_stream_t * stream) {
+
+  double ran1, ran2, r;
+
+  assert(stream);
+
+  if (stream->gbuf) {
+    if (stream->gleft == 0) {
+      ran_stream_generate(stream, stream->gbuf, stream->nbuf);
+      ran_box_muller(stream->gbuf, stream->nbuf/2);
+      stream->gleft = stream->nbuf;
+    }
+    return stream->gbuf[stream->nbuf - stream->gleft--];
+  }
+
+  if (stream->ispare) {
+    stream->ispare = 0;
+    return stream->rspare;
+  }
+
+  ran1 = ran_stream_next(stream);
+  ran2 = ran_stream_next(stream);
+
+  r = sqrt(-2.0*log(ran1));
+  stream->rspare = r*sin(8.0*atan(1.0)*ran2);
+  stream->ispare = 1;
+
+  return r*cos(8.0*atan(1.0)*ran2);
+}
+
+/*****************************************************************************
+ *
+ *  ran_stream_uniform_fill
+ *  ran_stream_gaussian_fill
+ *
+ *  The next n numbers of the stream in r[], the same as n single draws.
+ *  Unbuffered streams fill r[] with the bulk kernels directly.
+ *
+ *****************************************************************************/
+
+int ran_stream_uniform_fill(ran_stream_t * stream, double * r, int n) {
+
+  int i;
+
+  assert(stream);
+  assert(r);
+
+  if (stream->ubuf) {
+    for (i = 0; i < n; i++) r[i] = ran_stream_uniform(stream);
+  }
+  else {
+    ran_stream_generate(stream, r, n);
+  }
+
+  return 0;
+}
+
+int ran_stream_gaussian_fill(ran_stream_t * stream, double * r, int n) {
+
+  int i = 0, m;
+
+  assert(stream);
+  assert(r);
+
+  if (stream->gbuf) {
+    for (i = 0; i < n; i++) r[i] = ran_stream_gaussian(stream);
+    return 0;
+  }
+
+  if (stream->ispare && n > 0) r[i++] = ran_stream_gaussian(stream);
+
+  /* Whole pairs in bulk; an odd one out leaves its partner spare */
+  m = (n - i) & ~1;
+  ran_stream_generate(stream, r + i, m);
+  ran_box_muller(r + i, m/2);
+  i += m;
+
+  if (i < n) r[i] = ran_stream_gaussian(stream);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ran_stream_generate
+ *
+ *  The next n uniforms of the stream. Whole blocks are independent of
+ *  each other, so the loop over them vectorises.
+ *
+ *****************************************************************************/
+
+static void ran_stream_generate(ran_stream_t * stream, double * r, int n) {
+
+  int i = 0, k, nb;
+  uint64_t b0;
+
+  if ((stream->pos & 1) && n > 0) r[i++] = ran_stream_next(stream);
+
+  nb = (n - i)/2;
+  b0 = stream->pos >> 1;
+
+  for (k = 0; k < nb; k++) {
+    uint32_t ctr[4], out[4];
+    uint64_t nblock = b0 + k;
+    ctr[0] = (uint32_t) nblock;
+    ctr[1] = (uint32_t) (nblock >> 32);
+    ctr[2] = stream->purpose;
+    ctr[3] = 0;
+    ran_philox4x32(ctr, stream->key, out);
+    r[i+2*k] = ((double) (out[0] >> 5)*67108864.0 + (double) (out[1] >> 6)
+                + 0.5) / 9007199254740992.0;
+    r[i+2*k+1] = ((double) (out[2] >> 5)*67108864.0 + (double) (out[3] >> 6)
+                  + 0.5) / 9007199254740992.0;
+  }
+
+  stream->pos += 2*nb;
+  i += 2*nb;
+
+  if (i < n) r[i] = ran_stream_next(stream);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  ran_box_muller
+ *
+ *  Turns npairs pairs of uniforms in r[] into Gaussians in place, as
+ *  ran_stream_gaussian does one pair at a time. There is no rejection,
+ *  so the loop has no branches.
+ *
+ *****************************************************************************/
+
+static void ran_box_muller(double * REST r, int npairs) {
+
+  int k;
+  double rad, theta;
+  const double twopi = 8.0*atan(1.0);
+
+  for (k = 0; k < npairs; k++) {
+    rad = sqrt(-2.0*log(r[2*k]));
+    theta = twopi*r[2*k+1];
+    r[2*k] = rad*cos(theta);
+    r[2*k+1] = rad*sin(theta);
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  ran_philox4x32
+ *
+ *  The Philox4x32-10 bijection of a 128-bit counter under a 64-bit key.
+ *
+ *  Salmon et al., Parallel random numbers: as easy as 1, 2, 3,
+ *  Proceedings of SC11, 2011.
+ *
+ *****************************************************************************/
+
+int ran_philox4x32(const unsigned int ctr[4], const unsigned int key[2],
+                   unsigned int out[4]) {
+
+  int n;
+  uint32_t c0, c1, c2, c3, k0, k1;
+  uint64_t p0, p1;
+
+  c0 = ctr[0]; c1 = ctr[1]; c2 = ctr[2]; c3 = ctr[3];
+  k0 = key[0]; k1 = key[1];
+
+  for (n = 0; n < 10; n++) {
+    p0 = (uint64_t) 0xD2511F53 * c0;
+    p1 = (uint64_t) 0xCD9E8D57 * c2;
+    c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+    c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+    c1 = (uint32_t) p1;
+    c3 = (uint32_t) p0;
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+
+  out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+
+  return 0;
+}
@@ -16,13 +16,48 @@
 #include "pe.h"
 #include "runtime.h"
 
+/* Generators selected with the "rng" key. Lecuyer is the serial generator
+ * shared by all draws; philox draws from independent streams. */
+typedef enum {RAN_RNG_LECUYER = 0,
+              RAN_RNG_PHILOX,
+              RAN_RNG_MAX} ran_rng_enum_t;
+
+/* What a stream is drawn for, part of its key */
+typedef enum {RAN_PURPOSE_PROPOSAL = 0,
+              RAN_PURPOSE_ACCEPT,
+              RAN_PURPOSE_SWAP,
+              RAN_PURPOSE_PG,
+              RAN_PURPOSE_MAX} ran_purpose_enum_t;
+
+typedef struct ran_stream_s ran_stream_t;
+
 int ran_init(pe_t * pe);
 int ran_init_rt(pe_t * pe, rt_t * rt);
 int ran_init_seed(pe_t * pe, int scalar_seed);
 
+int ran_rng_from_name(const char * name, ran_rng_enum_t * rng);
+int ran_rng_set(ran_rng_enum_t rng);
+ran_rng_enum_t ran_rng(void);
+int ran_seed(void);
+int ran_buffer(void);
+
 double ran_parallel_gaussian(void);
 double ran_parallel_uniform(void);
 double ran_serial_uniform(void);
 double ran_serial_gaussian(void);
 
+int ran_stream_create(int seed, int chain, ran_purpose_enum_t purpose,
+                      ran_stream_t ** pstream);
+int ran_stream_free(ran_stream_t * stream);
+int ran_stream_skip(ran_stream_t * stream, unsigned long long n);
+int ran_stream_reset(ran_stream_t * stream, int chain, unsigned long long pos);
+unsigned long long ran_stream_position(ran_stream_t * stream);
+int ran_stream_buffer_set(ran_stream_t * stream, int n);
+double ran_stream_uniform(ran_stream_t * stream);
+double ran_stream_gaussian(ran_stream_t * stream);
+int ran_stream_uniform_fill(ran_stream_t * stream, double * r, int n);
+int ran_stream_gaussian_fill(ran_stream_t * stream, double * r, int n);
+int ran_philox4x32(const unsigned int ctr[4], const unsigned int key[2],
+                   unsigned int out[4]);
+
 #endif // __RAN_H__
@@ -181,13 +181,53 @@ precision sample_evaluate_lr(lr_t *lr, sample_t *cur, sample_t *pro){
   return (ratio>1) ? 1: ratio;
 }
 
+/*****************************************************************************
+ *
+ *  sample_evaluate_lhood
+ *
+ *  As sample_evaluate_lr, with the likelihood of the proposal already
+ *  evaluated (e.g. for several chains at once). The posterior is tempered,
+ *  prior + beta * lhood, and beta = 1 is the posterior itself.
+ *
+ *****************************************************************************/
+
+precision sample_evaluate_lhood(sample_t *cur, sample_t *pro, precision lhood,
+                                precision beta){
+
+  precision prior=0.0, posterior=0.0;
+  precision cposterior;
+  int dim;
+  double ratio;
+  precision *values = NULL;
+
+  assert(cur);
+  assert(pro);
+
+  sample_posterior(cur, &cposterior);
+
+  sample_values(pro, &values);
+  sample_dim(pro, &dim);
+
+  prior = pr_log_prob(values, dim);
+  posterior = prior + beta*lhood;
+
+  sample_prior_set(pro, prior);
+  sample_likelihood_set(pro, lhood);
+  sample_posterior_set(pro, posterior);
+
+  ratio = exp(posterior - cposterior);
+
+  return (ratio>1) ? 1: ratio;
+}
+
 /*****************************************************************************
  *
  *  sample_choose
  *
  *****************************************************************************/
 
-void sample_choose(int idx, ch_t *chain, sample_t **pcur, sample_t **ppro){
+void sample_choose(int idx, ch_t *chain, sample_t **pcur, sample_t **ppro,
+                   ran_stream_t *rng){
 
   precision u;
   int accepted = 0;
@@ -207,8 +247,9 @@ void sample_choose(int idx, ch_t *chain, sample_t **pcur, sample_t **ppro){
   ch_probability(chain, &probability);
   ch_outfreq(chain, &outfreq);
 
-  /* to stochastically accept/reject the proposed sample*/
-  u = (precision)ran_serial_uniform();
+  /* to stochastically accept/reject the proposed sample,
+   * from the acceptance stream if there is one */
+  u = (rng) ? (precision)ran_stream_uniform(rng) : (precision)ran_serial_uniform();
 
   if(u <= probability[idx])
   {
@@ -219,7 +260,7 @@ void sample_choose(int idx, ch_t *chain, sample_t **pcur, sample_t **ppro){
     mem_swap_ptrs((void**)&cur, (void**)&pro);
   }else{
     /* add the current sample to the chain */
-    ch_append_sample(idx, cur->values, chain);
+    ch_repeat_sample(idx, cur->values, chain);
   }
 
   ch_append_stats(idx, accepted, chain);
@@ -31,6 +31,9 @@ int sample_posterior(sample_t *sample, precision *posterior);
 int sample_init_zero(sample_t *sample);
 int sample_propose_mvnb(mvnb_t *mvnb, sample_t *cur, sample_t *pro);
 precision sample_evaluate_lr(lr_t *lr, sample_t *cur, sample_t *pro);
-void sample_choose(int idx, ch_t *chain, sample_t **pcur, sample_t **ppro);
+precision sample_evaluate_lhood(sample_t *cur, sample_t *pro, precision lhood,
+                                precision beta);
+void sample_choose(int idx, ch_t *chain, sample_t **pcur, sample_t **ppro,
+                   ran_stream_t *rng);
 
 #endif // __SAMPLE_H
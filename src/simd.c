@@ -0,0 +1,580 @@
+/*****************************************************************************
+ *
+ *  simd.c
+ *
+ *  Host (CPU) likelihood kernels written with explicit vector intrinsics.
+ *
+ *  Each vector kernel evaluates V_LANES datapoints at once: the dot products
+ *  theta^T x_n are accumulated across rows (lane k holds row i+k) and the
+ *  log-sigmoid log(1 + exp(-y_n * dot)) is evaluated in the registers with
+ *  a polynomial exp and a log1p series, so the libm calls are avoided.
+ *
+ *  The instruction set is chosen at run time from cpuid, the kernels are
+ *  compiled with the matching target attribute so that a single binary
+ *  runs on any x86-64 host.
+ *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "simd.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+static const char *simd_isa_names[SIMD_ISA_MAX] = {"scalar", "sse2", "avx2", "avx512"};
+
+typedef precision (*simd_lhood_ft)(precision *REST x, int *REST y,
+                                   precision *REST sample, int size, int dim);
+
+static precision simd_lhood_rows(precision *REST x, int *REST y,
+                                 precision *REST sample, int low, int hi, int dim);
+static precision simd_lhood_scalar(precision *REST x, int *REST y,
+                                   precision *REST sample, int size, int dim);
+
+typedef precision (*simd_log_sigmoid_ft)(precision *REST dot, int size);
+
+static precision simd_log_sigmoid_rows(precision *REST dot, int low, int hi);
+static precision simd_log_sigmoid_scalar(precision *REST dot, int size);
+
+/* Taylor coefficients 1/k! of exp(r), |r| <= ln(2)/2 */
+#define SIMD_EXP_TERMS 14
+static const precision simd_exp_coef[SIMD_EXP_TERMS] = {
+  1.0, 1.0, 1.0/2.0, 1.0/6.0, 1.0/24.0, 1.0/120.0, 1.0/720.0, 1.0/5040.0,
+  1.0/40320.0, 1.0/362880.0, 1.0/3628800.0, 1.0/39916800.0,
+  1.0/479001600.0, 1.0/6227020800.0};
+
+/* Coefficients 1/(2k+1) of log1p(t) = 2s * sum_k s^(2k)/(2k+1), s = t/(2+t) */
+#define SIMD_LOG_TERMS 17
+static const precision simd_log_coef[SIMD_LOG_TERMS] = {
+  1.0, 1.0/3.0, 1.0/5.0, 1.0/7.0, 1.0/9.0, 1.0/11.0, 1.0/13.0, 1.0/15.0,
+  1.0/17.0, 1.0/19.0, 1.0/21.0, 1.0/23.0, 1.0/25.0, 1.0/27.0, 1.0/29.0,
+  1.0/31.0, 1.0/33.0};
+
+#ifdef _FLOAT_
+  #define SIMD_LOG2E    1.44269504088896341f
+  #define SIMD_LN2_HI   0.693359375f
+  #define SIMD_LN2_LO   -2.12194440e-4f
+  #define SIMD_SHIFTER  12582912.0f          /* 1.5 * 2^23 */
+  #define SIMD_EXP_MIN  -87.0f
+  #define SIMD_EXP_BIAS 127
+  #define SIMD_MANT     23
+#else
+  #define SIMD_LOG2E    1.44269504088896341
+  #define SIMD_LN2_HI   6.93147180369123816490e-01
+  #define SIMD_LN2_LO   1.90821492927058770002e-10
+  #define SIMD_SHIFTER  6755399441055744.0   /* 1.5 * 2^52 */
+  #define SIMD_EXP_MIN  -708.0
+  #define SIMD_EXP_BIAS 1023
+  #define SIMD_MANT     52
+#endif
+
+#ifdef SIMD_X86
+
+/*****************************************************************************
+ *
+ *  Per instruction set vector operations
+ *
+ *  GATHER(p, idx, stride) loads p[k*stride] into lane k
+ *  LOADY(p) loads V_LANES integer labels and converts them to precision
+ *  IADD/ISET1/ISHL act on the integer lanes matching the precision width
+ *
+ *****************************************************************************/
+
+#ifdef _FLOAT_
+
+#define V_SSE2_LANES               4
+#define V_SSE2_T                   __m128
+#define V_SSE2_IDX_T               int
+#define V_SSE2_IDX_LOAD(o)         ((o)[1])
+#define V_SSE2_GATHER(p, idx, s)   _mm_set_ps((p)[3*(s)], (p)[2*(s)], (p)[s], (p)[0])
+#define V_SSE2_ZERO()              _mm_setzero_ps()
+#define V_SSE2_SET1(a)             _mm_set1_ps(a)
+#define V_SSE2_ADD(a, b)           _mm_add_ps(a, b)
+#define V_SSE2_SUB(a, b)           _mm_sub_ps(a, b)
+#define V_SSE2_MUL(a, b)           _mm_mul_ps(a, b)
+#define V_SSE2_DIV(a, b)           _mm_div_ps(a, b)
+#define V_SSE2_MAX(a, b)           _mm_max_ps(a, b)
+#define V_SSE2_FMADD(a, b, c)      _mm_add_ps(_mm_mul_ps(a, b), c)
+#define V_SSE2_ABS(a)              _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define V_SSE2_CASTI(a)            _mm_castps_si128(a)
+#define V_SSE2_CASTF(a)            _mm_castsi128_ps(a)
+#define V_SSE2_IADD(a, b)          _mm_add_epi32(a, b)
+#define V_SSE2_ISET1(a)            _mm_set1_epi32(a)
+#define V_SSE2_ISHL(a, n)          _mm_slli_epi32(a, n)
+#define V_SSE2_LOADY(p)            _mm_cvtepi32_ps(_mm_loadu_si128((__m128i const *)(p)))
+#define V_SSE2_STORE(p, a)         _mm_storeu_ps(p, a)
+#define V_SSE2_LOAD(p)             _mm_loadu_ps(p)
+
+#define V_AVX2_LANES               8
+#define V_AVX2_T                   __m256
+#define V_AVX2_IDX_T               __m256i
+#define V_AVX2_IDX_LOAD(o)         _mm256_loadu_si256((__m256i const *)(o))
+#define V_AVX2_GATHER(p, idx, s)   _mm256_i32gather_ps(p, idx, 4)
+#define V_AVX2_ZERO()              _mm256_setzero_ps()
+#define V_AVX2_SET1(a)             _mm256_set1_ps(a)
+#define V_AVX2_ADD(a, b)           _mm256_add_ps(a, b)
+#define V_AVX2_SUB(a, b)           _mm256_sub_ps(a, b)
+#define V_AVX2_MUL(a, b)           _mm256_mul_ps(a, b)
+#define V_AVX2_DIV(a, b)           _mm256_div_ps(a, b)
+#define V_AVX2_MAX(a, b)           _mm256_max_ps(a, b)
+#define V_AVX2_FMADD(a, b, c)      _mm256_fmadd_ps(a, b, c)
+#define V_AVX2_ABS(a)              _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a)
+#define V_AVX2_CASTI(a)            _mm256_castps_si256(a)
+#define V_AVX2_CASTF(a)            _mm256_castsi256_ps(a)
+#define V_AVX2_IADD(a, b)          _mm256_add_epi32(a, b)
+#define V_AVX2_ISET1(a)            _mm256_set1_epi32(a)
+#define V_AVX2_ISHL(a, n)          _mm256_slli_epi32(a, n)
+#define V_AVX2_LOADY(p)            _mm256_cvtepi32_ps(_mm256_loadu_si256((__m256i const *)(p)))
+#define V_AVX2_STORE(p, a)         _mm256_storeu_ps(p, a)
+#define V_AVX2_LOAD(p)             _mm256_loadu_ps(p)
+
+#define V_AVX512_LANES             16
+#define V_AVX512_T                 __m512
+#define V_AVX512_IDX_T             __m512i
+#define V_AVX512_IDX_LOAD(o)       _mm512_loadu_si512((void const *)(o))
+#define V_AVX512_GATHER(p, idx, s) _mm512_i32gather_ps(idx, p, 4)
+#define V_AVX512_ZERO()            _mm512_setzero_ps()
+#define V_AVX512_SET1(a)           _mm512_set1_ps(a)
+#define V_AVX512_ADD(a, b)         _mm512_add_ps(a, b)
+#define V_AVX512_SUB(a, b)         _mm512_sub_ps(a, b)
+#define V_AVX512_MUL(a, b)         _mm512_mul_ps(a, b)
+#define V_AVX512_DIV(a, b)         _mm512_div_ps(a, b)
+#define V_AVX512_MAX(a, b)         _mm512_max_ps(a, b)
+#define V_AVX512_FMADD(a, b, c)    _mm512_fmadd_ps(a, b, c)
+#define V_AVX512_ABS(a)            _mm512_abs_ps(a)
+#define V_AVX512_CASTI(a)          _mm512_castps_si512(a)
+#define V_AVX512_CASTF(a)          _mm512_castsi512_ps(a)
+#define V_AVX512_IADD(a, b)        _mm512_add_epi32(a, b)
+#define V_AVX512_ISET1(a)          _mm512_set1_epi32(a)
+#define V_AVX512_ISHL(a, n)        _mm512_slli_epi32(a, n)
+#define V_AVX512_LOADY(p)          _mm512_cvtepi32_ps(_mm512_loadu_si512((void const *)(p)))
+#define V_AVX512_STORE(p, a)       _mm512_storeu_ps(p, a)
+#define V_AVX512_LOAD(p)           _mm512_loadu_ps(p)
+
+#else
+
+#define V_SSE2_LANES               2
+#define V_SSE2_T                   __m128d
+#define V_SSE2_IDX_T               int
+#define V_SSE2_IDX_LOAD(o)         ((o)[1])
+#define V_SSE2_GATHER(p, idx, s)   _mm_set_pd((p)[s], (p)[0])
+#define V_SSE2_ZERO()              _mm_setzero_pd()
+#define V_SSE2_SET1(a)             _mm_set1_pd(a)
+#define V_SSE2_ADD(a, b)           _mm_add_pd(a, b)
+#define V_SSE2_SUB(a, b)           _mm_sub_pd(a, b)
+#define V_SSE2_MUL(a, b)           _mm_mul_pd(a, b)
+#define V_SSE2_DIV(a, b)           _mm_div_pd(a, b)
+#define V_SSE2_MAX(a, b)           _mm_max_pd(a, b)
+#define V_SSE2_FMADD(a, b, c)      _mm_add_pd(_mm_mul_pd(a, b), c)
+#define V_SSE2_ABS(a)              _mm_andnot_pd(_mm_set1_pd(-0.0), a)
+#define V_SSE2_CASTI(a)            _mm_castpd_si128(a)
+#define V_SSE2_CASTF(a)            _mm_castsi128_pd(a)
+#define V_SSE2_IADD(a, b)          _mm_add_epi64(a, b)
+#define V_SSE2_ISET1(a)            _mm_set1_epi64x(a)
+#define V_SSE2_ISHL(a, n)          _mm_slli_epi64(a, n)
+#define V_SSE2_LOADY(p)            _mm_cvtepi32_pd(_mm_loadl_epi64((__m128i const *)(p)))
+#define V_SSE2_STORE(p, a)         _mm_storeu_pd(p, a)
+#define V_SSE2_LOAD(p)             _mm_loadu_pd(p)
+
+#define V_AVX2_LANES               4
+#define V_AVX2_T                   __m256d
+#define V_AVX2_IDX_T               __m128i
+#define V_AVX2_IDX_LOAD(o)         _mm_loadu_si128((__m128i const *)(o))
+#define V_AVX2_GATHER(p, idx, s)   _mm256_i32gather_pd(p, idx, 8)
+#define V_AVX2_ZERO()              _mm256_setzero_pd()
+#define V_AVX2_SET1(a)             _mm256_set1_pd(a)
+#define V_AVX2_ADD(a, b)           _mm256_add_pd(a, b)
+#define V_AVX2_SUB(a, b)           _mm256_sub_pd(a, b)
+#define V_AVX2_MUL(a, b)           _mm256_mul_pd(a, b)
+#define V_AVX2_DIV(a, b)           _mm256_div_pd(a, b)
+#define V_AVX2_MAX(a, b)           _mm256_max_pd(a, b)
+#define V_AVX2_FMADD(a, b, c)      _mm256_fmadd_pd(a, b, c)
+#define V_AVX2_ABS(a)              _mm256_andnot_pd(_mm256_set1_pd(-0.0), a)
+#define V_AVX2_CASTI(a)            _mm256_castpd_si256(a)
+#define V_AVX2_CASTF(a)            _mm256_castsi256_pd(a)
+#define V_AVX2_IADD(a, b)          _mm256_add_epi64(a, b)
+#define V_AVX2_ISET1(a)            _mm256_set1_epi64x(a)
+#define V_AVX2_ISHL(a, n)          _mm256_slli_epi64(a, n)
+#define V_AVX2_LOADY(p)            _mm256_cvtepi32_pd(_mm_loadu_si128((__m128i const *)(p)))
+#define V_AVX2_STORE(p, a)         _mm256_storeu_pd(p, a)
+#define V_AVX2_LOAD(p)             _mm256_loadu_pd(p)
+
+#define V_AVX512_LANES             8
+#define V_AVX512_T                 __m512d
+#define V_AVX512_IDX_T             __m256i
+#define V_AVX512_IDX_LOAD(o)       _mm256_loadu_si256((__m256i const *)(o))
+#define V_AVX512_GATHER(p, idx, s) _mm512_i32gather_pd(idx, p, 8)
+#define V_AVX512_ZERO()            _mm512_setzero_pd()
+#define V_AVX512_SET1(a)           _mm512_set1_pd(a)
+#define V_AVX512_ADD(a, b)         _mm512_add_pd(a, b)
+#define V_AVX512_SUB(a, b)         _mm512_sub_pd(a, b)
+#define V_AVX512_MUL(a, b)         _mm512_mul_pd(a, b)
+#define V_AVX512_DIV(a, b)         _mm512_div_pd(a, b)
+#define V_AVX512_MAX(a, b)         _mm512_max_pd(a, b)
+#define V_AVX512_FMADD(a, b, c)    _mm512_fmadd_pd(a, b, c)
+#define V_AVX512_ABS(a)            _mm512_abs_pd(a)
+#define V_AVX512_CASTI(a)          _mm512_castpd_si512(a)
+#define V_AVX512_CASTF(a)          _mm512_castsi512_pd(a)
+#define V_AVX512_IADD(a, b)        _mm512_add_epi64(a, b)
+#define V_AVX512_ISET1(a)          _mm512_set1_epi64(a)
+#define V_AVX512_ISHL(a, n)        _mm512_slli_epi64(a, n)
+#define V_AVX512_LOADY(p)          _mm512_cvtepi32_pd(_mm256_loadu_si256((__m256i const *)(p)))
+#define V_AVX512_STORE(p, a)       _mm512_storeu_pd(p, a)
+#define V_AVX512_LOAD(p)           _mm512_loadu_pd(p)
+
+#endif /* _FLOAT_ */
+
+/*****************************************************************************
+ *
+ *  SIMD_SOFTPLUS
+ *
+ *  l = softplus(z) = max(z,0) + log1p(exp(-|z|)) for one vector z.
+ *
+ *  exp(t) = 2^n * exp(r), n = round(t/ln2), evaluated as a polynomial in r
+ *  log1p(e) = 2 atanh(e/(2+e)), evaluated as a series in (e/(2+e))^2
+ *
+ *****************************************************************************/
+
+#define SIMD_SOFTPLUS(ISA, z, l)                                              \
+{                                                                             \
+  int m;                                                                      \
+  V_##ISA##_T t = V_##ISA##_MAX(V_##ISA##_SUB(V_##ISA##_ZERO(),               \
+                                              V_##ISA##_ABS(z)),              \
+                                V_##ISA##_SET1(SIMD_EXP_MIN));                \
+                                                                              \
+  /* exp(t), t <= 0 */                                                        \
+  V_##ISA##_T s = V_##ISA##_FMADD(t, V_##ISA##_SET1(SIMD_LOG2E),              \
+                                  V_##ISA##_SET1(SIMD_SHIFTER));              \
+  V_##ISA##_T n = V_##ISA##_SUB(s, V_##ISA##_SET1(SIMD_SHIFTER));             \
+  V_##ISA##_T r = V_##ISA##_FMADD(n, V_##ISA##_SET1(-SIMD_LN2_HI), t);        \
+  r = V_##ISA##_FMADD(n, V_##ISA##_SET1(-SIMD_LN2_LO), r);                    \
+                                                                              \
+  V_##ISA##_T p = V_##ISA##_SET1(simd_exp_coef[SIMD_EXP_TERMS-1]);            \
+  for(m=SIMD_EXP_TERMS-2; m>=0; m--)                                          \
+    p = V_##ISA##_FMADD(p, r, V_##ISA##_SET1(simd_exp_coef[m]));              \
+                                                                              \
+  V_##ISA##_T e = V_##ISA##_MUL(p, V_##ISA##_CASTF(V_##ISA##_ISHL(            \
+                    V_##ISA##_IADD(V_##ISA##_CASTI(s),                        \
+                                   V_##ISA##_ISET1(SIMD_EXP_BIAS)),           \
+                    SIMD_MANT)));                                             \
+                                                                              \
+  /* log1p(e), 0 < e <= 1 */                                                  \
+  V_##ISA##_T q = V_##ISA##_DIV(e, V_##ISA##_ADD(V_##ISA##_SET1(2.0), e));    \
+  V_##ISA##_T q2 = V_##ISA##_MUL(q, q);                                       \
+  l = V_##ISA##_SET1(simd_log_coef[SIMD_LOG_TERMS-1]);                        \
+  for(m=SIMD_LOG_TERMS-2; m>=0; m--)                                          \
+    l = V_##ISA##_FMADD(l, q2, V_##ISA##_SET1(simd_log_coef[m]));             \
+  l = V_##ISA##_MUL(V_##ISA##_ADD(q, q), l);                                  \
+                                                                              \
+  l = V_##ISA##_ADD(V_##ISA##_MAX(z, V_##ISA##_ZERO()), l);                   \
+}
+
+/*****************************************************************************
+ *
+ *  SIMD_LHOOD_KERNEL
+ *
+ *  Defines simd_lhood_<isa>() for one instruction set, with z = -y_n * dot.
+ *  Rows that do not fill a whole vector are left to the scalar kernel.
+ *
+ *  Also defines simd_log_sigmoid_<isa>(), the same sum over dot products
+ *  evaluated beforehand.
+ *
+ *****************************************************************************/
+
+#define SIMD_LHOOD_KERNEL(ISA, TARGET)                                        \
+__attribute__((target(TARGET)))                                               \
+static precision simd_lhood_##ISA(precision *REST x, int *REST y,             \
+                                  precision *REST sample, int size, int dim){ \
+                                                                              \
+  int i, j, k;                                                                \
+  int blocks = size - size%V_##ISA##_LANES;                                   \
+  int offset[V_##ISA##_LANES];                                                \
+  precision part[V_##ISA##_LANES];                                            \
+  precision lhood = 0.0;                                                      \
+  V_##ISA##_T vlhood = V_##ISA##_ZERO();                                      \
+                                                                              \
+  for(k=0; k<V_##ISA##_LANES; k++) offset[k] = k*dim;                         \
+  V_##ISA##_IDX_T idx = V_##ISA##_IDX_LOAD(offset);                           \
+  (void) idx;                                                                 \
+                                                                              \
+  for(i=0; i<blocks; i+=V_##ISA##_LANES)                                      \
+  {                                                                           \
+    precision *REST mat = &x[i*dim];                                          \
+    V_##ISA##_T dot = V_##ISA##_ZERO();                                       \
+    V_##ISA##_T l;                                                            \
+                                                                              \
+    for(j=0; j<dim; j++)                                                      \
+    {                                                                         \
+      dot = V_##ISA##_FMADD(V_##ISA##_GATHER(&mat[j], idx, dim),              \
+                            V_##ISA##_SET1(sample[j]), dot);                  \
+    }                                                                         \
+                                                                              \
+    if(y) dot = V_##ISA##_MUL(V_##ISA##_LOADY(&y[i]), dot);                   \
+    V_##ISA##_T z = V_##ISA##_SUB(V_##ISA##_ZERO(), dot);                     \
+    SIMD_SOFTPLUS(ISA, z, l);                                                 \
+                                                                              \
+    vlhood = V_##ISA##_SUB(vlhood, l);                                        \
+  }                                                                           \
+                                                                              \
+  V_##ISA##_STORE(part, vlhood);                                              \
+  for(k=0; k<V_##ISA##_LANES; k++) lhood += part[k];                          \
+                                                                              \
+  return lhood + simd_lhood_rows(x, y, sample, blocks, size, dim);            \
+}                                                                             \
+                                                                              \
+__attribute__((target(TARGET)))                                               \
+static precision simd_log_sigmoid_##ISA(precision *REST dot, int size){       \
+                                                                              \
+  int i, k;                                                                   \
+  int blocks = size - size%V_##ISA##_LANES;                                   \
+  precision part[V_##ISA##_LANES];                                            \
+  precision lhood = 0.0;                                                      \
+  V_##ISA##_T vlhood = V_##ISA##_ZERO();                                      \
+                                                                              \
+  for(i=0; i<blocks; i+=V_##ISA##_LANES)                                      \
+  {                                                                           \
+    V_##ISA##_T l;                                                            \
+    V_##ISA##_T z = V_##ISA##_SUB(V_##ISA##_ZERO(), V_##ISA##_LOAD(&dot[i])); \
+    SIMD_SOFTPLUS(ISA, z, l);                                                 \
+                                                                              \
+    vlhood = V_##ISA##_SUB(vlhood, l);                                        \
+  }                                                                           \
+                                                                              \
+  V_##ISA##_STORE(part, vlhood);                                              \
+  for(k=0; k<V_##ISA##_LANES; k++) lhood += part[k];                          \
+                                                                              \
+  return lhood + simd_log_sigmoid_rows(dot, blocks, size);                    \
+}
+
+SIMD_LHOOD_KERNEL(SSE2, "sse2")
+SIMD_LHOOD_KERNEL(AVX2, "avx2,fma")
+SIMD_LHOOD_KERNEL(AVX512, "avx512f")
+
+static simd_lhood_ft simd_lhood_kernels[SIMD_ISA_MAX] = {simd_lhood_scalar,
+                                                         simd_lhood_SSE2,
+                                                         simd_lhood_AVX2,
+                                                         simd_lhood_AVX512};
+static simd_log_sigmoid_ft simd_log_sigmoid_kernels[SIMD_ISA_MAX] = {
+                                                  simd_log_sigmoid_scalar,
+                                                  simd_log_sigmoid_SSE2,
+                                                  simd_log_sigmoid_AVX2,
+                                                  simd_log_sigmoid_AVX512};
+#else
+
+static simd_lhood_ft simd_lhood_kernels[SIMD_ISA_MAX] = {simd_lhood_scalar,
+                                                         NULL, NULL, NULL};
+static simd_log_sigmoid_ft simd_log_sigmoid_kernels[SIMD_ISA_MAX] = {
+                                                  simd_log_sigmoid_scalar,
+                                                  NULL, NULL, NULL};
+#endif /* SIMD_X86 */
+
+/*****************************************************************************
+ *
+ *  simd_isa_detect
+ *
+ *  Most capable instruction set available on this host.
+ *
+ *****************************************************************************/
+
+simd_isa_enum_t simd_isa_detect(void){
+
+  int n;
+
+  for(n=SIMD_ISA_MAX-1; n>SIMD_ISA_SCALAR; n--)
+  {
+    if(simd_isa_supported((simd_isa_enum_t) n)) return (simd_isa_enum_t) n;
+  }
+
+  return SIMD_ISA_SCALAR;
+}
+
+/*****************************************************************************
+ *
+ *  simd_isa_supported
+ *
+ *  Queries cpuid (and the OS support for the wider registers).
+ *
+ *****************************************************************************/
+
+int simd_isa_supported(simd_isa_enum_t isa){
+
+  int supported = 0;
+
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+#endif
+
+  switch(isa)
+  {
+    case SIMD_ISA_SCALAR:
+      supported = 1;
+      break;
+#ifdef SIMD_X86
+    case SIMD_ISA_SSE2:
+      supported = __builtin_cpu_supports("sse2");
+      break;
+    case SIMD_ISA_AVX2:
+      supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+      break;
+    case SIMD_ISA_AVX512:
+      supported = __builtin_cpu_supports("avx512f");
+      break;
+#endif
+    default:
+      supported = 0;
+  }
+
+  return (supported != 0);
+}
+
+/*****************************************************************************
+ *
+ *  simd_isa_from_name
+ *
+ *  Returns 1 if the name matches an instruction set, 0 otherwise.
+ *
+ *****************************************************************************/
+
+int simd_isa_from_name(const char *name, simd_isa_enum_t *isa){
+
+  int n;
+
+  assert(name);
+  assert(isa);
+
+  for(n=0; n<SIMD_ISA_MAX; n++)
+  {
+    if(strcmp(name, simd_isa_names[n]) == 0)
+    {
+      *isa = (simd_isa_enum_t) n;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  simd_isa_name
+ *
+ *****************************************************************************/
+
+const char *simd_isa_name(simd_isa_enum_t isa){
+
+  assert(isa < SIMD_ISA_MAX);
+
+  return simd_isa_names[isa];
+}
+
+/*****************************************************************************
+ *
+ *  simd_lhood
+ *
+ *  Log-likelihood sum_n -log(1 + exp(-y_n * theta^T x_n)) over size rows
+ *  of x, using the kernel of the given instruction set. A NULL y means the
+ *  labels are already folded into x (y_n = 1).
+ *
+ *****************************************************************************/
+
+precision simd_lhood(simd_isa_enum_t isa, precision *REST x, int *REST y,
+                     precision *REST sample, int size, int dim){
+
+  assert(isa < SIMD_ISA_MAX);
+  assert(simd_lhood_kernels[isa]);
+
+  return simd_lhood_kernels[isa](x, y, sample, size, dim);
+}
+
+/*****************************************************************************
+ *
+ *  simd_lhood_scalar
+ *
+ *****************************************************************************/
+
+static precision simd_lhood_scalar(precision *REST x, int *REST y,
+                                   precision *REST sample, int size, int dim){
+
+  return simd_lhood_rows(x, y, sample, 0, size, dim);
+}
+
+/*****************************************************************************
+ *
+ *  simd_lhood_rows
+ *
+ *****************************************************************************/
+
+static precision simd_lhood_rows(precision *REST x, int *REST y,
+                                 precision *REST sample, int low, int hi, int dim){
+
+  int i, j;
+  precision lhood = 0.0;
+
+  for(i=low; i<hi; i++)
+  {
+    precision dot = 0.0;
+    for(j=0; j<dim; j++)
+    {
+      dot += sample[j] * x[i*dim+j];
+    }
+    precision z = (y) ? -(precision)y[i] * dot : -dot;
+    lhood -= ((z > 0.0) ? z : 0.0) + log1p(exp(-fabs(z)));
+  }
+
+  return lhood;
+}
+
+/*****************************************************************************
+ *
+ *  simd_log_sigmoid
+ *
+ *  sum_n -log(1 + exp(-dot_n)) over size dot products already evaluated,
+ *  with the labels folded in, using the kernel of the given instruction set.
+ *
+ *****************************************************************************/
+
+precision simd_log_sigmoid(simd_isa_enum_t isa, precision *REST dot, int size){
+
+  assert(isa < SIMD_ISA_MAX);
+  assert(simd_log_sigmoid_kernels[isa]);
+
+  return simd_log_sigmoid_kernels[isa](dot, size);
+}
+
+/*****************************************************************************
+ *
+ *  simd_log_sigmoid_scalar
+ *
+ *****************************************************************************/
+
+static precision simd_log_sigmoid_scalar(precision *REST dot, int size){
+
+  return simd_log_sigmoid_rows(dot, 0, size);
+}
+
+/*****************************************************************************
+ *
+ *  simd_log_sigmoid_rows
+ *
+ *****************************************************************************/
+
+static precision simd_log_sigmoid_rows(precision *REST dot, int low, int hi){
+
+  int i;
+  precision lhood = 0.0;
+
+  for(i=low; i<hi; i++)
+  {
+    precision z = -dot[i];
+    lhood -= ((z > 0.0) ? z : 0.0) + log1p(exp(-fabs(z)));
+  }
+
+  return lhood;
+}
@@ -0,0 +1,23 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#include "definitions.h"
+
+/* Host instruction sets with a dedicated likelihood kernel, in order of
+ * preference. The scalar kernel is always available. */
+typedef enum {SIMD_ISA_SCALAR = 0,
+              SIMD_ISA_SSE2,
+              SIMD_ISA_AVX2,
+              SIMD_ISA_AVX512,
+              SIMD_ISA_MAX} simd_isa_enum_t;
+
+simd_isa_enum_t simd_isa_detect(void);
+int simd_isa_supported(simd_isa_enum_t isa);
+int simd_isa_from_name(const char *name, simd_isa_enum_t *isa);
+const char *simd_isa_name(simd_isa_enum_t isa);
+
+precision simd_lhood(simd_isa_enum_t isa, precision *REST x, int *REST y,
+                     precision *REST sample, int size, int dim);
+precision simd_log_sigmoid(simd_isa_enum_t isa, precision *REST dot, int size);
+
+#endif // __SIMD_H__
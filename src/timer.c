@@ -51,6 +51,11 @@ static const char * timer_name[] = {"Total",
                                     "Likelihood",
                                     "MatVec Mult Kernel",
                                     "Reduction Kernel",
+                                    "Fused Lhood Kernel",
+                                    "SIMD Lhood Kernel",
+                                    "Lhood and Gradient",
+                                    "Lhood Gradient Kernel",
+                                    "Polya-Gamma Pass",
                                     "Prior",
                                     "Sampler Step",
                                     "Autocorrelation",
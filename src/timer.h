@@ -40,6 +40,11 @@ enum timer_id {TIMER_TOTAL = 0,
                TIMER_LIKELIHOOD,
                TIMER_MATVECMUL,
                TIMER_REDUCE,
+               TIMER_FUSED_LHOOD,
+               TIMER_SIMD_LHOOD,
+               TIMER_LHOOD_GRAD,
+               TIMER_LHOOD_GRAD_KERNEL,
+               TIMER_PG,
                TIMER_PRIOR,
                TIMER_STEP,
                TIMER_AUTOCORRELATION,
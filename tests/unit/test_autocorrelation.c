@@ -11,6 +11,7 @@
 static int test_autocorrelation_rt_default(pe_t *pe);
 static int test_autocorrelation_rt(pe_t *pe);
 static int test_autocorrelation_compute_lagk(pe_t *pe);
+static int test_autocorrelation_compute_fft(pe_t *pe);
 
 int test_autocorrelation_suite(void){
 
@@ -23,6 +24,7 @@ int test_autocorrelation_suite(void){
   test_autocorrelation_rt_default(pe);
   test_autocorrelation_rt(pe);
   test_autocorrelation_compute_lagk(pe);
+  test_autocorrelation_compute_fft(pe);
 
   pe_info(pe, "PASS\t./unit/test_autocorrelation\n");
   pe_free(pe);
@@ -35,6 +37,7 @@ static int test_autocorrelation_rt_default(pe_t *pe){
   int dim, N, maxlag, outfreq;
   precision threshold;
   char outdir[FILENAME_MAX];
+  acr_method_enum_t method;
 
   assert(pe);
 
@@ -64,6 +67,8 @@ static int test_autocorrelation_rt_default(pe_t *pe){
   test_assert(outfreq == 50);
   acr_outdir(acr, outdir);
   test_assert(strcmp(outdir, "../out") == 0);
+  acr_method(acr, &method);
+  test_assert(method == ACR_METHOD_FFT);
 
   acr_free(acr);
 
@@ -172,3 +177,69 @@ static int test_autocorrelation_compute_lagk(pe_t *pe){
 
   return 0;
 }
+
+static int test_autocorrelation_compute_fft(pe_t *pe){
+
+  int i, j, dim, N, maxlag;
+  int maxlag_ref[3];
+  precision lagk_ref[30];
+  precision *samples = NULL;
+  int *maxlag_act = NULL;
+  precision *lagk = NULL;
+
+  assert(pe);
+
+  acr_t *acr = NULL;
+  rt_t *rt = NULL;
+  ch_t *chain = NULL;
+
+  rt_create(pe, &rt);
+  assert(rt);
+  rt_read_input_file(rt, "test.dat");
+
+  ch_create(pe, &chain);
+  assert(chain);
+  ch_init_chain_rt(rt, chain);
+
+  acr_create(pe, chain, &acr);
+  assert(acr);
+  acr_init_rt(rt, chain, acr);
+
+  acr_dim(acr, &dim);
+  acr_N(acr, &N);
+  acr_maxlag(acr, &maxlag);
+  assert(dim*maxlag <= 30);
+
+  /* Slowly varying samples with a different decay per dimension */
+  ch_samples(chain, &samples);
+  for(i=0; i<N; i++)
+  {
+    for(j=0; j<dim; j++)
+    {
+      samples[i*dim+j] = sin(0.2*(j+1)*i) + 0.1*((i*7 + j*3) % 5);
+    }
+  }
+
+  acr_maxlag_act(acr, &maxlag_act);
+  acr_lagk(acr, &lagk);
+
+  acr_method_set(acr, ACR_METHOD_DIRECT);
+  acr_compute(acr);
+  for(j=0; j<dim; j++) maxlag_ref[j] = maxlag_act[j];
+  for(i=0; i<dim*maxlag; i++) lagk_ref[i] = lagk[i];
+
+  /* Same lags and truncation from the FFT */
+  acr_method_set(acr, ACR_METHOD_FFT);
+  acr_compute(acr);
+  for(j=0; j<dim; j++) test_assert(maxlag_act[j] == maxlag_ref[j]);
+  for(i=0; i<dim*maxlag; i++)
+  {
+    test_assert(fabs(lagk[i] - lagk_ref[i]) < 1.0e+03*TEST_PRECISION_TOLERANCE);
+  }
+
+  acr_free(acr);
+  ch_free(chain);
+  rt_free(rt);
+
+  return 0;
+}
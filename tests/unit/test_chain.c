@@ -17,6 +17,9 @@ static int test_chain_chain_rt(pe_t *pe);
 static int test_chain_init_stats(pe_t *pe);
 static int test_chain_burn_append(pe_t *pe);
 static int test_chain_chain_append(pe_t *pe);
+static int test_chain_stream_append(pe_t *pe);
+static int test_chain_weighted_append(pe_t *pe);
+static int test_chain_split_rhat(pe_t *pe);
 
 int test_chain_suite(void){
 
@@ -33,6 +36,9 @@ int test_chain_suite(void){
   test_chain_init_stats(pe);
   test_chain_burn_append(pe);
   test_chain_chain_append(pe);
+  test_chain_stream_append(pe);
+  test_chain_weighted_append(pe);
+  test_chain_split_rhat(pe);
 
   pe_info(pe, "PASS\t./unit/test_chain\n");
   pe_free(pe);
@@ -409,3 +415,165 @@ static int test_chain_chain_append(pe_t *pe){
 
   return 0;
 }
+
+static int test_chain_stream_append(pe_t *pe){
+
+  assert(pe);
+
+  int dim = 3, N = 20, i, j;
+  int block_size, ring_blocks;
+  ch_storage_enum_t storage;
+  char filename[FILENAME_MAX];
+  precision sample[3];
+  precision *samples = NULL;
+
+  rt_t *rt = NULL;
+  ch_t *chain = NULL;
+
+  rt_create(pe, &rt);
+  assert(rt);
+
+  ch_create(pe, &chain);
+  assert(chain);
+
+  ch_storage(chain, &storage);
+  test_assert(storage == CH_STORAGE_MEMORY);
+
+  /* Blocks of 3 samples through a ring of 2, last block partial */
+  ch_dim_set(chain, dim);
+  ch_N_set(chain, N);
+  ch_outdir_set(chain, "./test-out");
+  ch_storage_set(chain, CH_STORAGE_STREAM);
+  ch_block_size_set(chain, 3);
+  ch_ring_blocks_set(chain, 2);
+
+  ch_init_chain_rt(rt, chain);
+
+  ch_block_size(chain, &block_size);
+  test_assert(block_size == 3);
+  ch_ring_blocks(chain, &ring_blocks);
+  test_assert(ring_blocks == 2);
+
+  for(i=0; i<N+1; i++)
+  {
+    for(j=0; j<dim; j++) sample[j] = i + 0.1*j;
+    ch_append_sample(i, sample, chain);
+  }
+
+  ch_flush(chain);
+
+  ch_samples(chain, &samples);
+  test_assert(samples != NULL);
+  for(i=0; i<N+1; i++)
+  {
+    for(j=0; j<dim; j++)
+    {
+      test_assert(fabs(samples[i*dim+j] - (precision)(i + 0.1*j)) < TEST_PRECISION_TOLERANCE);
+    }
+  }
+
+  ch_free(chain);
+  rt_free(rt);
+
+  sprintf(filename, "./test-out/postburn_samples_%d.bin", pe_mpi_rank(pe));
+  remove(filename);
+
+  return 0;
+}
+
+static int test_chain_weighted_append(pe_t *pe){
+
+  assert(pe);
+
+  int dim = 3, N = 3000, i, j, nstates;
+  precision sample[3];
+  precision *samples = NULL;
+  int *weights = NULL;
+
+  rt_t *rt = NULL;
+  ch_t *chain = NULL;
+
+  rt_create(pe, &rt);
+  assert(rt);
+
+  ch_create(pe, &chain);
+  assert(chain);
+
+  ch_dim_set(chain, dim);
+  ch_N_set(chain, N);
+  ch_storage_set(chain, CH_STORAGE_WEIGHTED);
+
+  ch_init_chain_rt(rt, chain);
+
+  /* A new state every third step, past the initial allocation */
+  for(i=0; i<N+1; i++)
+  {
+    for(j=0; j<dim; j++) sample[j] = (i/3) + 0.1*j;
+    if(i%3 == 0)
+      ch_append_sample(i, sample, chain);
+    else
+      ch_repeat_sample(i, sample, chain);
+  }
+
+  ch_nstates(chain, &nstates);
+  test_assert(nstates == N/3 + 1);
+
+  ch_samples(chain, &samples);
+  ch_weights(chain, &weights);
+  test_assert(weights != NULL);
+  for(i=0; i<nstates; i++)
+  {
+    test_assert(weights[i] == ((i < nstates-1) ? 3 : 1));
+    for(j=0; j<dim; j++)
+    {
+      test_assert(fabs(samples[i*dim+j] - (precision)(i + 0.1*j)) < TEST_PRECISION_TOLERANCE);
+    }
+  }
+
+  ch_free(chain);
+  rt_free(rt);
+
+  return 0;
+}
+
+static int test_chain_split_rhat(pe_t *pe){
+
+  assert(pe);
+
+  int dim = 1, N = 4, nchains = 2, c, i;
+  precision rhat;
+
+  rt_t *rt = NULL;
+  ch_t *chains[2] = {NULL, NULL};
+
+  precision samples_ref[2][4] = {{1.0, 2.0, 3.0, 4.0},
+                                 {2.0, 3.0, 4.0, 5.0}
+                                };
+
+  /* Half means 1.5, 3.5, 2.5, 4.5 and within variance 0.5 */
+  precision rhat_ref = sqrt((0.25 + 5.0/3.0) / 0.5);
+
+  rt_create(pe, &rt);
+  assert(rt);
+
+  for(c=0; c<nchains; c++)
+  {
+    ch_create(pe, &chains[c]);
+    assert(chains[c]);
+
+    ch_dim_set(chains[c], dim);
+    ch_N_set(chains[c], N);
+    ch_init_chain_rt(rt, chains[c]);
+    ch_init_stats(0, chains[c]);
+
+    for(i=0; i<N; i++) ch_append_sample(i, &samples_ref[c][i], chains[c]);
+  }
+
+  ch_split_rhat(chains, nchains, &rhat);
+  test_assert(fabs(rhat - rhat_ref) < TEST_PRECISION_TOLERANCE);
+
+  for(c=0; c<nchains; c++) ch_free(chains[c]);
+  rt_free(rt);
+
+  return 0;
+}
@@ -8,6 +8,7 @@
 #include "pe.h"
 #include "runtime.h"
 #include "data_input.h"
+#include "data_binary.h"
 #include "tests.h"
 
 static int test_data_train_rt_default(pe_t *pe);
@@ -16,6 +17,12 @@ static int test_data_train_rt(pe_t *pe);
 static int test_data_test_rt(pe_t *pe);
 static int test_data_train_input_file(pe_t *pe);
 static int test_data_test_input_file(pe_t *pe);
+static int test_data_train_binary_file(pe_t *pe);
+static int test_data_train_shard(pe_t *pe);
+static int test_data_train_wide_file(pe_t *pe);
+static int test_data_read_train_ref(int N, int dim, double *xref, double *yref);
+static int test_data_write_binary(const char *filename, uint32_t dtype,
+                                  int N, int dim, int pad, const double *values);
 
 int test_data_input_suite(void){
 
@@ -31,6 +38,9 @@ int test_data_input_suite(void){
   test_data_test_rt(pe);
   test_data_train_input_file(pe);
   test_data_test_input_file(pe);
+  test_data_train_binary_file(pe);
+  test_data_train_shard(pe);
+  test_data_train_wide_file(pe);
 
   pe_info(pe, "PASS\t./unit/test_data_input\n");
   pe_free(pe);
@@ -269,12 +279,36 @@ static int test_data_train_input_file(pe_t *pe){
   test_assert(1);
   data_init_train_rt(pe, rt, train);
 
+  /* Labels are folded into the training datapoints by default */
+  int fold;
+  data_fold(train, &fold);
+  test_assert(fold == 1);
+
   data_read_file(pe, train);
   data_x(train, &x);
   data_y(train, &y);
 
   int i, j;
 
+  for(i=0; i<N; i++){
+    for(j=0; j<dim; j++){
+        test_assert(fabs(x[i*dim+j] - yref[i]*xref[i*dim+j]) < TEST_PRECISION_TOLERANCE);
+    }
+    test_assert(fabs(y[i] - yref[i]) < TEST_PRECISION_TOLERANCE);
+  }
+
+  data_free(train);
+
+  /* Unfolded datapoints are read as they are */
+  data_create_train(pe, dc, &train);
+  assert(train);
+  data_fold_set(train, 0);
+  data_init_train_rt(pe, rt, train);
+
+  data_read_file(pe, train);
+  data_x(train, &x);
+  data_y(train, &y);
+
   for(i=0; i<N; i++){
     for(j=0; j<dim; j++){
         test_assert(fabs(x[i*dim+j] - xref[i*dim+j]) < TEST_PRECISION_TOLERANCE);
@@ -343,3 +377,307 @@ static int test_data_test_input_file(pe_t *pe){
   dc_free(dc);
   return 0;
 }
+
+static int test_data_train_binary_file(pe_t *pe){
+
+  assert(pe);
+
+  int i, j, n;
+  int dim=3, N=10;
+  data_format_enum_t format;
+  double xref[30], yref[10];
+  precision *x = NULL;
+  int *y = NULL;
+
+  rt_t *rt = NULL;
+  data_t *train = NULL;
+  dc_t *dc = NULL;
+
+  test_data_read_train_ref(N, dim, xref, yref);
+
+  /* Empty input, the format and sizes are set directly */
+  rt_create(pe, &rt);
+  assert(rt);
+
+  dc_create(pe, &dc);
+  assert(dc);
+
+  /* Native layout is mapped, single precision with padded rows is converted */
+  for(n=0; n<2; n++)
+  {
+    if(n == 0)
+    {
+      test_data_write_binary("./test-out/X_train.bin",
+                             (sizeof(precision) == 8) ? DATA_BIN_FLOAT64 : DATA_BIN_FLOAT32,
+                             N, dim, 0, xref);
+    }
+    else
+    {
+      test_data_write_binary("./test-out/X_train.bin", DATA_BIN_FLOAT32, N, dim, 5, xref);
+    }
+    test_data_write_binary("./test-out/Y_train.bin", DATA_BIN_INT32, N, 1, 0, yref);
+
+    data_create_train(pe, dc, &train);
+    assert(train);
+    data_format_set(train, DATA_FORMAT_BINARY);
+    data_fold_set(train, 0);
+    data_N_set(train, N);
+    data_init_train_rt(pe, rt, train);
+
+    data_format(train, &format);
+    test_assert(format == DATA_FORMAT_BINARY);
+
+    data_fx_set(train, "./test-out/X_train.bin");
+    data_fy_set(train, "./test-out/Y_train.bin");
+    data_read_file(pe, train);
+    data_x(train, &x);
+    data_y(train, &y);
+    test_assert(x != NULL);
+    test_assert(y != NULL);
+
+    for(i=0; i<N; i++){
+      for(j=0; j<dim; j++){
+        if(n == 0)
+          test_assert(fabs(x[i*dim+j] - xref[i*dim+j]) < TEST_PRECISION_TOLERANCE);
+        else
+          test_assert(fabs(x[i*dim+j] - (float) xref[i*dim+j]) < TEST_PRECISION_TOLERANCE);
+      }
+      test_assert(y[i] == (int) yref[i]);
+    }
+
+    data_free(train);
+  }
+
+  remove("./test-out/X_train.bin");
+  remove("./test-out/Y_train.bin");
+
+  rt_free(rt);
+  dc_free(dc);
+
+  return 0;
+}
+
+/* Process 1 of 3 holds rows 3 to 5 of the training set */
+static int test_data_train_shard(pe_t *pe){
+
+  assert(pe);
+
+  int i, j, n, low, Nlocal;
+  int dim=3, N=10;
+  double xref[30], yref[10];
+  precision *x = NULL;
+  int *y = NULL;
+
+  rt_t *rt = NULL;
+  data_t *train = NULL;
+  dc_t *dc = NULL;
+
+  test_data_read_train_ref(N, dim, xref, yref);
+
+  rt_create(pe, &rt);
+  assert(rt);
+  rt_read_input_file(rt, "test.dat");
+
+  dc_create(pe, &dc);
+  assert(dc);
+  dc_init_rt(pe, rt, dc);
+  dc_size_set(dc, 3);
+  dc_rank_set(dc, 1);
+  dc_work_set(dc, N);
+  dc_decompose(dc);
+
+  test_data_write_binary("./test-out/X_train.bin",
+                         (sizeof(precision) == 8) ? DATA_BIN_FLOAT64 : DATA_BIN_FLOAT32,
+                         N, dim, 0, xref);
+  test_data_write_binary("./test-out/Y_train.bin", DATA_BIN_INT32, N, 1, 0, yref);
+
+  /* CSV through the line index, then the binary mapping */
+  for(n=0; n<2; n++)
+  {
+    data_create_train(pe, dc, &train);
+    assert(train);
+    data_init_train_rt(pe, rt, train);
+    if(n == 1)
+    {
+      data_format_set(train, DATA_FORMAT_BINARY);
+      data_fx_set(train, "./test-out/X_train.bin");
+      data_fy_set(train, "./test-out/Y_train.bin");
+    }
+
+    data_low(train, &low);
+    test_assert(low == 3);
+    data_Nlocal(train, &Nlocal);
+    test_assert(Nlocal == 3);
+
+    data_read_file(pe, train);
+    data_x(train, &x);
+    data_y(train, &y);
+
+    for(i=0; i<Nlocal; i++){
+      for(j=0; j<dim; j++){
+        test_assert(fabs(x[i*dim+j] - yref[low+i]*xref[(low+i)*dim+j]) < TEST_PRECISION_TOLERANCE);
+      }
+      test_assert(y[i] == (int) yref[low+i]);
+    }
+
+    data_free(train);
+  }
+
+  remove("./test-out/X_train.bin");
+  remove("./test-out/Y_train.bin");
+
+  rt_free(rt);
+  dc_free(dc);
+
+  return 0;
+}
+
+/* Rows far longer than BUFSIZ, parsed by several threads */
+static int test_data_train_wide_file(pe_t *pe){
+
+  assert(pe);
+
+  int i, j;
+  int dim=1500, N=7;
+  double *xref = NULL;
+  precision *x = NULL;
+  int *y = NULL;
+  FILE *fp = NULL;
+
+  rt_t *rt = NULL;
+  data_t *train = NULL;
+  dc_t *dc = NULL;
+
+  xref = (double *) malloc(N*dim*sizeof(double));
+  assert(xref);
+
+  fp = fopen("./test-out/X_wide.csv", "w");
+  assert(fp);
+  fprintf(fp, "# wide\n");
+  for(i=0; i<N; i++)
+  {
+    for(j=0; j<dim; j++)
+    {
+      xref[i*dim+j] = sin(1.0 + i*dim + j) * pow(10.0, (j%41) - 20);
+      fprintf(fp, (j%3 == 0) ? "%.17g" : "%.17e", xref[i*dim+j]);
+      fprintf(fp, "%s", (j < dim-1) ? "," : "");
+    }
+    /* Windows line ending on one row, no newline after the last */
+    if(i == 2) fprintf(fp, "\r\n");
+    else if(i < N-1) fprintf(fp, "\n");
+  }
+  fclose(fp);
+
+  fp = fopen("./test-out/Y_wide.csv", "w");
+  assert(fp);
+  fprintf(fp, "# y0\n");
+  for(i=0; i<N; i++) fprintf(fp, "%s\n", (i%2) ? "1.0000" : "-1.0000");
+  fclose(fp);
+
+  rt_create(pe, &rt);
+  assert(rt);
+
+  dc_create(pe, &dc);
+  assert(dc);
+
+  data_create_train(pe, dc, &train);
+  assert(train);
+  data_fold_set(train, 0);
+  data_nthreads_set(train, 3);
+  data_dimx_set(train, dim);
+  data_N_set(train, N);
+  data_fx_set(train, "./test-out/X_wide.csv");
+  data_fy_set(train, "./test-out/Y_wide.csv");
+  data_init_train_rt(pe, rt, train);
+
+  data_read_file(pe, train);
+  data_x(train, &x);
+  data_y(train, &y);
+
+  for(i=0; i<N; i++){
+    for(j=0; j<dim; j++){
+      test_assert(fabs(x[i*dim+j] - xref[i*dim+j]) <= fabs(xref[i*dim+j])*TEST_PRECISION_TOLERANCE);
+    }
+    test_assert(y[i] == ((i%2) ? 1 : -1));
+  }
+
+  data_free(train);
+  remove("./test-out/X_wide.csv");
+  remove("./test-out/Y_wide.csv");
+  free(xref);
+
+  rt_free(rt);
+  dc_free(dc);
+
+  return 0;
+}
+
+static int test_data_read_train_ref(int N, int dim, double *xref, double *yref){
+
+  int i;
+  char line[BUFSIZ];
+  FILE *fp = NULL;
+
+  fp = fopen("./data/X_train.csv", "r");
+  assert(fp);
+  fgets(line, BUFSIZ, fp);
+  for(i=0; i<N; i++)
+  {
+    fgets(line, BUFSIZ, fp);
+    sscanf(line, "%lf,%lf,%lf", &xref[i*dim], &xref[i*dim+1], &xref[i*dim+2]);
+  }
+  fclose(fp);
+
+  fp = fopen("./data/Y_train.csv", "r");
+  assert(fp);
+  fgets(line, BUFSIZ, fp);
+  for(i=0; i<N; i++)
+  {
+    fgets(line, BUFSIZ, fp);
+    sscanf(line, "%lf", &yref[i]);
+  }
+  fclose(fp);
+
+  return 0;
+}
+
+static int test_data_write_binary(const char *filename, uint32_t dtype,
+                                  int N, int dim, int pad, const double *values){
+
+  int i, j, k;
+  data_bin_header_t header;
+  FILE *fp = NULL;
+
+  memset(&header, 0, sizeof(data_bin_header_t));
+  memcpy(header.magic, DATA_BIN_MAGIC, sizeof(DATA_BIN_MAGIC));
+  header.version = DATA_BIN_VERSION;
+  header.endian = DATA_BIN_ENDIAN;
+  header.dtype = dtype;
+  header.N = N;
+  header.dim = dim;
+  header.stride = (dim + pad) * data_bin_dtype_size[dtype];
+  header.offset = sizeof(data_bin_header_t);
+
+  fp = fopen(filename, "wb");
+  assert(fp);
+  fwrite(&header, sizeof(data_bin_header_t), 1, fp);
+
+  for(i=0; i<N; i++)
+  {
+    for(j=0; j<dim+pad; j++)
+    {
+      double value = (j < dim) ? values[i*dim+j] : 0.0;
+      int32_t ivalue = (int32_t) value;
+      float fvalue = (float) value;
+
+      k = data_bin_dtype_size[dtype];
+      if(dtype == DATA_BIN_INT32) fwrite(&ivalue, k, 1, fp);
+      else if(dtype == DATA_BIN_FLOAT32) fwrite(&fvalue, k, 1, fp);
+      else fwrite(&value, k, 1, fp);
+    }
+  }
+
+  fclose(fp);
+
+  return 0;
+}
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+
+#include "definitions.h"
+#include "pe.h"
+#include "runtime.h"
+#include "chain.h"
+#include "decomposition.h"
+#include "data_input.h"
+#include "logistic_regression.h"
+#include "metropolis.h"
+#include "inference.h"
+#include "tests.h"
+
+/* The two modes sum the same terms in a different order */
+#ifdef _FLOAT_
+  #define INFR_TOLERANCE 1.0e-05
+#else
+  #define INFR_TOLERANCE 1.0e-12
+#endif
+
+/* Blocked sums of a long chain against a scalar reference held in double */
+#ifdef _FLOAT_
+  #define INFR_BLOCK_TOLERANCE 1.0e-04
+#else
+  #define INFR_BLOCK_TOLERANCE 1.0e-12
+#endif
+
+static int test_infr_stream(pe_t *pe, ch_storage_enum_t storage);
+static int test_infr_blocks(pe_t *pe, ch_storage_enum_t storage);
+static int test_infr_chain(pe_t *pe, rt_t *rt, ch_storage_enum_t storage,
+                           ch_t **pchain);
+static int test_infr_predict(pe_t *pe, ch_storage_enum_t storage);
+static int test_infr_reference(pe_t *pe, rt_t *rt, ch_t *chain, double *ref,
+                               double *accuracy);
+
+int test_infr_suite(void){
+
+  pe_t *pe = NULL;
+
+  pe_create(MPI_COMM_WORLD, PE_QUIET, &pe);
+  assert(pe);
+  test_assert(1);
+
+  test_infr_stream(pe, CH_STORAGE_MEMORY);
+  test_infr_stream(pe, CH_STORAGE_WEIGHTED);
+  test_infr_blocks(pe, CH_STORAGE_MEMORY);
+  test_infr_blocks(pe, CH_STORAGE_WEIGHTED);
+  test_infr_predict(pe, CH_STORAGE_MEMORY);
+  test_infr_predict(pe, CH_STORAGE_WEIGHTED);
+
+  pe_info(pe, "PASS\t./unit/test_inference\n");
+  pe_free(pe);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_infr_stream
+ *
+ *  The post burn-in chain is integrated while it is sampled (stream), with
+ *  the run length of each state as its weight, then again from the stored
+ *  chain (batch). Both see the same states for the same number of steps.
+ *
+ *****************************************************************************/
+
+static int test_infr_stream(pe_t *pe, ch_storage_enum_t storage){
+
+  int i, N_test;
+  precision accuracy_stream, accuracy_batch;
+  precision *prob_stream = NULL;
+  precision *prob_batch = NULL;
+  infr_mode_enum_t mode;
+
+  rt_t *rt = NULL;
+  met_t *met = NULL;
+  ch_t *burn = NULL;
+  ch_t *chain = NULL;
+  infr_t *stream = NULL;
+  infr_t *batch = NULL;
+
+  assert(pe);
+
+  rt_create(pe, &rt);
+  assert(rt);
+  rt_read_input_file(rt, "test.dat");
+  rt_int_parameter(rt, "test_N", &N_test);
+
+  ch_create(pe, &burn);
+  ch_init_burn_rt(rt, burn);
+  ch_create(pe, &chain);
+  ch_storage_set(chain, storage);
+  ch_init_chain_rt(rt, chain);
+
+  met_create(pe, burn, &met);
+  met_init_rt(pe, rt, met);
+  met_init(pe, met);
+  met_run(pe, met);
+
+  infr_create(pe, chain, &stream);
+  infr_init_rt(pe, rt, stream);
+  infr_mode_set(stream, INFR_MODE_STREAM);
+  infr_mode(stream, &mode);
+  test_assert(mode == INFR_MODE_STREAM);
+  infr_init(pe, stream);
+  infr_stream_begin(stream);
+
+  met_chain_set(met, chain);
+  met_infr_set(met, stream);
+  met_init_post_burn(pe, met);
+  met_run(pe, met);
+  infr_stream_end(stream);
+  met_infr_set(met, NULL);
+
+  infr_create(pe, chain, &batch);
+  infr_init_rt(pe, rt, batch);
+  infr_init(pe, batch);
+  infr_mc_integration_lr(batch);
+
+  infr_probability(stream, &prob_stream);
+  infr_probability(batch, &prob_batch);
+  test_assert(prob_stream != NULL && prob_batch != NULL);
+
+  for(i=0; i<N_test; i++)
+  {
+    test_assert(prob_batch[i] >= 0.0 && prob_batch[i] <= 1.0);
+    test_assert(fabs(prob_stream[i] - prob_batch[i]) < INFR_TOLERANCE);
+  }
+
+  infr_accuracy(stream, &accuracy_stream);
+  infr_accuracy(batch, &accuracy_batch);
+  test_assert(fabs(accuracy_stream - accuracy_batch) < TEST_PRECISION_TOLERANCE);
+
+  infr_free(batch);
+  infr_free(stream);
+  met_free(met);
+  ch_free(chain);
+  ch_free(burn);
+  rt_free(rt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_infr_blocks
+ *
+ *  Neither the 137 test rows nor the 1300 steps of the chain are a multiple
+ *  of the row and state blocks of the integration. Each probability must
+ *  be the mean of lr_logistic_regression over the steps of the chain,
+ *  whether the chain holds every step or each state with its run length.
+ *
+ *****************************************************************************/
+
+static int test_infr_blocks(pe_t *pe, ch_storage_enum_t storage){
+
+  int i, N_test;
+  double accuracy;
+  double *ref = NULL;
+  precision *probability = NULL;
+
+  rt_t *rt = NULL;
+  ch_t *chain = NULL;
+  infr_t *infr = NULL;
+
+  assert(pe);
+
+  rt_create(pe, &rt);
+  assert(rt);
+  rt_read_input_file(rt, "test_inference.dat");
+  rt_int_parameter(rt, "test_N", &N_test);
+
+  test_infr_chain(pe, rt, storage, &chain);
+
+  ref = (double *) calloc(N_test, sizeof(double));
+  assert(ref);
+  test_infr_reference(pe, rt, chain, ref, &accuracy);
+
+  infr_create(pe, chain, &infr);
+  infr_init_rt(pe, rt, infr);
+  infr_init(pe, infr);
+  infr_mc_integration_lr(infr);
+
+  if(pe_mpi_rank(pe) == 0)
+  {
+    infr_probability(infr, &probability);
+    test_assert(probability != NULL);
+    for(i=0; i<N_test; i++)
+    {
+      test_assert(fabs(probability[i] - ref[i]) < INFR_BLOCK_TOLERANCE);
+    }
+  }
+
+  free(ref);
+  infr_free(infr);
+  ch_free(chain);
+  rt_free(rt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_infr_predict
+ *
+ *  The test rows are split over processes and three threads. The accuracy
+ *  summed over processes and the probabilities gathered on the root must
+ *  be those of the whole test set, held by each process.
+ *
+ *****************************************************************************/
+
+static int test_infr_predict(pe_t *pe, ch_storage_enum_t storage){
+
+  int i, N_test, nthreads, plow, phi;
+  int *tlow = NULL, *thi = NULL;
+  double accuracy_ref;
+  double *ref = NULL;
+  precision accuracy;
+  precision *probability = NULL;
+
+  rt_t *rt = NULL;
+  dc_t *dc = NULL;
+  ch_t *chain = NULL;
+  infr_t *infr = NULL;
+
+  assert(pe);
+
+  rt_create(pe, &rt);
+  assert(rt);
+  rt_read_input_file(rt, "test_inference_shard.dat");
+  rt_int_parameter(rt, "test_N", &N_test);
+
+  test_infr_chain(pe, rt, storage, &chain);
+
+  ref = (double *) calloc(N_test, sizeof(double));
+  assert(ref);
+  test_infr_reference(pe, rt, chain, ref, &accuracy_ref);
+
+  infr_create(pe, chain, &infr);
+  infr_init_rt(pe, rt, infr);
+  infr_init(pe, infr);
+
+  infr_dc(infr, &dc);
+  dc_nthreads(dc, &nthreads);
+  dc_tbound(dc, &tlow, &thi);
+  dc_pbound(dc, &plow, &phi);
+  test_assert(nthreads == 3);
+  test_assert(tlow[0] == plow && thi[nthreads-1] == phi);
+  if(pe_mpi_size(pe) > 1) test_assert(phi - plow < N_test);
+
+  infr_mc_integration_lr(infr);
+
+  infr_accuracy(infr, &accuracy);
+  test_assert(accuracy > 0.0 && accuracy < 1.0);
+  test_assert(fabs(accuracy - accuracy_ref) < TEST_PRECISION_TOLERANCE);
+
+  if(pe_mpi_rank(pe) == 0)
+  {
+    infr_probability(infr, &probability);
+    test_assert(probability != NULL);
+    for(i=0; i<N_test; i++)
+    {
+      test_assert(fabs(probability[i] - ref[i]) < INFR_BLOCK_TOLERANCE);
+    }
+  }
+
+  free(ref);
+  infr_free(infr);
+  ch_free(chain);
+  rt_free(rt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_infr_chain
+ *
+ *  A post burn-in chain that moves to a new state at two steps in three,
+ *  so a weighted chain holds about 2N/3 states with run lengths 1 and 2.
+ *
+ *****************************************************************************/
+
+static int test_infr_chain(pe_t *pe, rt_t *rt, ch_storage_enum_t storage,
+                           ch_t **pchain){
+
+  int k, n, N, dim;
+  int state = 0;
+  precision *sample = NULL;
+  ch_t *chain = NULL;
+
+  assert(pe);
+  assert(rt);
+
+  ch_create(pe, &chain);
+  ch_storage_set(chain, storage);
+  ch_init_chain_rt(rt, chain);
+  ch_N(chain, &N);
+  ch_dim(chain, &dim);
+
+  sample = (precision *) calloc(dim, sizeof(precision));
+  assert(sample);
+
+  for(n=0; n<=N; n++)
+  {
+    if(n > 0 && n % 3 == 1)
+    {
+      ch_repeat_sample(n, sample, chain);
+      continue;
+    }
+    for(k=0; k<dim; k++) sample[k] = 2.0*sin(0.37*state + 1.3*k);
+    ch_append_sample(n, sample, chain);
+    state++;
+  }
+
+  free(sample);
+  *pchain = chain;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_infr_reference
+ *
+ *  The mean over the first N steps of the chain of the probability of
+ *  each row of the whole test set, one state at a time, and the fraction
+ *  of rows whose label it predicts.
+ *
+ *****************************************************************************/
+
+static int test_infr_reference(pe_t *pe, rt_t *rt, ch_t *chain, double *ref,
+                               double *accuracy){
+
+  int i, j, n, N, N_test, N_states, dim;
+  int count, label, correct = 0;
+  int *weights = NULL;
+  int *y = NULL;
+  precision *samples = NULL;
+  precision *x = NULL;
+
+  dc_t *dc = NULL;
+  data_t *test = NULL;
+
+  assert(pe);
+  assert(rt);
+  assert(chain);
+  assert(ref);
+  assert(accuracy);
+
+  dc_create(pe, &dc);
+  data_create_test(pe, dc, &test);
+  data_shard_set(test, 0);
+  data_init_test_rt(pe, rt, test);
+  data_read_file(pe, test);
+  data_N(test, &N_test);
+  data_dimx(test, &dim);
+  data_x(test, &x);
+  data_y(test, &y);
+
+  ch_N(chain, &N);
+  ch_samples(chain, &samples);
+  ch_weights(chain, &weights);
+  ch_nstates(chain, &N_states);
+
+  for(i=0; i<N_test; i++)
+  {
+    ref[i] = 0.0;
+    for(j=0, n=0; j<N_states && n<N; j++, n+=count)
+    {
+      count = (weights) ? weights[j] : 1;
+      if(count > N - n) count = N - n;
+      ref[i] += count*lr_logistic_regression(&samples[j*dim], &x[i*dim], dim);
+    }
+    ref[i] /= N;
+    label = (ref[i] >= 0.5) ? 1 : -1;
+    correct += (label == y[i]) ? 1 : 0;
+  }
+
+  *accuracy = (double)correct / (double)N_test;
+
+  data_free(test);
+  dc_free(dc);
+
+  return 0;
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <math.h>
 
@@ -15,6 +16,11 @@ int test_lr_suite(void){
   int i, j;
   int dimx=3, dimy=1, N=5;
   precision lhood_ref, lhood_test, dot;
+  precision *dot_buffer = NULL;
+  precision lhood_multi[2], lhood_second;
+  precision grad[3], grad_ref[3] = {0.0, 0.0, 0.0};
+  lr_kernel_enum_t kernel;
+  int isa;
 
   pe_t *pe = NULL;
   dc_t *dc = NULL;
@@ -35,6 +41,8 @@ int test_lr_suite(void){
                   -1.0000000000000000};
 
   precision sample[3] = {-10.0000000000000000, 5.0000000000000000, 10.0000000000000000};
+  precision samples[6] = {-10.0, 5.0, 10.0,
+                           1.0, -1.0, 0.5};
   precision *x = (precision*) malloc(dimx * N * sizeof(precision));
   int *y = (int*) malloc(dimy * N * sizeof(int));
 
@@ -63,6 +71,7 @@ int test_lr_suite(void){
   data_N_set(data, N);
   data_x_set(data, x);
   data_y_set(data, y);
+  data_fold_set(data, 0);
 
   /* Copy reference data */
   for(i=0; i<N; i++)
@@ -84,6 +93,10 @@ int test_lr_suite(void){
       dot += sample[j] * x_ref[i*dimx+j];
     }
     lhood_ref -= log(1 + exp(-y_ref[i] * dot));
+    for(j=0; j<dimx; j++)
+    {
+      grad_ref[j] += y_ref[i] * x_ref[i*dimx+j] / (1 + exp(y_ref[i] * dot));
+    }
   }
 
   /* Start likelihood test */
@@ -91,9 +104,81 @@ int test_lr_suite(void){
   assert(lr);
   test_assert(1);
 
+  lr_kernel(lr, &kernel);
+  test_assert(strcmp(lr_kernel_name(kernel), LHOOD_KERNEL_DEFAULT) == 0);
+
+  lr_kernel_set(lr, LR_KERNEL_FUSED);
+  lr_dot(lr, &dot_buffer);
+  test_assert(dot_buffer == NULL);
+
+  lhood_test = lr_lhood(lr, sample);
+  test_assert(fabs(lhood_ref - lhood_test) < TEST_PRECISION_TOLERANCE);
+
+  /* Vectorised host kernels, for every instruction set of this host */
+  lr_kernel_set(lr, LR_KERNEL_SIMD);
+  for(isa=SIMD_ISA_SCALAR; isa<SIMD_ISA_MAX; isa++)
+  {
+    if(!simd_isa_supported((simd_isa_enum_t) isa)) continue;
+    lr_isa_set(lr, (simd_isa_enum_t) isa);
+    lhood_test = lr_lhood(lr, sample);
+    test_assert(fabs(lhood_ref - lhood_test) < fabs(lhood_ref)*TEST_FLOAT_TOLERANCE);
+  }
+
+  /* Two-pass kernel must agree with the fused one */
+  lr_kernel_set(lr, LR_KERNEL_TWO_PASS);
+  lr_dot(lr, &dot_buffer);
+  test_assert(dot_buffer != NULL);
+
+  lhood_test = lr_lhood(lr, sample);
+  test_assert(fabs(lhood_ref - lhood_test) < TEST_PRECISION_TOLERANCE);
+
+  /* Value and gradient in one pass */
+  lhood_test = lr_lhood_grad(lr, sample, grad);
+  test_assert(fabs(lhood_ref - lhood_test) < TEST_PRECISION_TOLERANCE);
+  for(j=0; j<dimx; j++) test_assert(fabs(grad_ref[j] - grad[j]) < TEST_PRECISION_TOLERANCE);
+
+  /* Several samples in one pass agree with one at a time */
+  lr_kernel_set(lr, LR_KERNEL_FUSED);
+  lhood_second = lr_lhood(lr, &samples[dimx]);
+  lr_lhood_multi(lr, samples, 2, lhood_multi);
+  test_assert(fabs(lhood_ref - lhood_multi[0]) < TEST_PRECISION_TOLERANCE);
+  test_assert(fabs(lhood_second - lhood_multi[1]) < TEST_PRECISION_TOLERANCE);
+
+  lr_kernel_set(lr, LR_KERNEL_SIMD);
+  lr_lhood_multi(lr, samples, 2, lhood_multi);
+  test_assert(fabs(lhood_ref - lhood_multi[0]) < fabs(lhood_ref)*TEST_FLOAT_TOLERANCE);
+  test_assert(fabs(lhood_second - lhood_multi[1]) < fabs(lhood_second)*TEST_FLOAT_TOLERANCE);
+
+  /* Labels folded into the datapoints, for every kernel */
+  for(i=0; i<N; i++)
+  {
+    for(j=0; j<dimx; j++)
+    {
+      x[i*dimx+j] = y_ref[i] * x_ref[i*dimx+j];
+    }
+  }
+  data_fold_set(data, 1);
+
+  lr_kernel_set(lr, LR_KERNEL_FUSED);
   lhood_test = lr_lhood(lr, sample);
   test_assert(fabs(lhood_ref - lhood_test) < TEST_PRECISION_TOLERANCE);
 
+  lr_kernel_set(lr, LR_KERNEL_TWO_PASS);
+  lhood_test = lr_lhood(lr, sample);
+  test_assert(fabs(lhood_ref - lhood_test) < TEST_PRECISION_TOLERANCE);
+
+  lr_kernel_set(lr, LR_KERNEL_SIMD);
+  lhood_test = lr_lhood(lr, sample);
+  test_assert(fabs(lhood_ref - lhood_test) < fabs(lhood_ref)*TEST_FLOAT_TOLERANCE);
+
+  lr_lhood_multi(lr, samples, 2, lhood_multi);
+  test_assert(fabs(lhood_ref - lhood_multi[0]) < fabs(lhood_ref)*TEST_FLOAT_TOLERANCE);
+  test_assert(fabs(lhood_second - lhood_multi[1]) < fabs(lhood_second)*TEST_FLOAT_TOLERANCE);
+
+  lhood_test = lr_lhood_grad(lr, sample, grad);
+  test_assert(fabs(lhood_ref - lhood_test) < TEST_PRECISION_TOLERANCE);
+  for(j=0; j<dimx; j++) test_assert(fabs(grad_ref[j] - grad[j]) < TEST_PRECISION_TOLERANCE);
+
   data_free(data);
   lr_lhood_free(lr);
   rt_free(rt);
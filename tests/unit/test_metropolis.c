@@ -9,8 +9,17 @@
 #include "runtime.h"
 #include "metropolis.h"
 #include "prior.h"
+#include "polya_gamma.h"
+#include "ran.h"
 #include "tests.h"
 
+/* Probabilities recomputed from posteriors summed in another order */
+#ifdef _FLOAT_
+  #define MET_TOLERANCE 1.0e-04
+#else
+  #define MET_TOLERANCE 1.0e-10
+#endif
+
 static int test_metropolis_create(pe_t *pe);
 static int test_metropolis_rt_default(pe_t *pe);
 static int test_metropolis_rt(pe_t *pe);
@@ -18,6 +27,18 @@ static int test_metropolis_init_zero(pe_t *pe);
 static int test_metropolis_init_rand(pe_t *pe);
 static int test_metropolist_init_post_burn(pe_t *pe);
 static int test_metropolis_run(pe_t *pe);
+static int test_metropolis_prefetch(pe_t *pe);
+static int test_metropolis_mtm(pe_t *pe);
+static int test_metropolis_pt(pe_t *pe);
+static int test_metropolis_rng_buffer(pe_t *pe, met_algorithm_enum_t algorithm);
+static int test_metropolis_hmc(pe_t *pe);
+static int test_metropolis_leapfrog(met_t *met);
+static int test_metropolis_nuts(pe_t *pe);
+static int test_metropolis_nuts_tree(met_t *met, ch_t *chain);
+static int test_metropolis_turning(precision *minv, int dim, precision *p_left,
+                                   precision *p_right, precision *rho);
+static int test_metropolis_pg_gibbs(pe_t *pe);
+static int test_metropolis_pg_sweep(met_t *met, ch_t *chain);
 
 int test_metropolis_suite(void){
 
@@ -41,6 +62,20 @@ int test_metropolis_suite(void){
   printf("(here)\n");
   test_metropolis_run(pe);
 
+  test_metropolis_prefetch(pe);
+
+  test_metropolis_mtm(pe);
+  test_metropolis_rng_buffer(pe, MET_ALGORITHM_MTM);
+
+  test_metropolis_pt(pe);
+
+  test_metropolis_hmc(pe);
+
+  test_metropolis_nuts(pe);
+  test_metropolis_rng_buffer(pe, MET_ALGORITHM_NUTS);
+
+  test_metropolis_pg_gibbs(pe);
+
   pe_info(pe, "PASS\t./unit/test_metropolis\n");
   pe_free(pe);
 
@@ -195,7 +230,7 @@ static int test_metropolis_rt_default(pe_t *pe)
   test_assert(l_data != NULL);
   test_assert(l_data == data);
   lr_dot(lr, &l_dot);
-  test_assert(l_dot != NULL);
+  test_assert(l_dot == NULL);   /* No default kernel allocates a dot buffer */
 
   met_random_init(met, &rand_init); /* Default random init set to false */
   test_assert(rand_init == 0);
@@ -306,7 +341,7 @@ static int test_metropolis_rt(pe_t *pe)
   test_assert(l_data != NULL);
   test_assert(l_data == data);
   lr_dot(lr, &l_dot);
-  test_assert(l_dot != NULL);
+  test_assert(l_dot == NULL);   /* No default kernel allocates a dot buffer */
 
   met_random_init(met, &rand_init); /* Default random init set to false */
   test_assert(rand_init == 1);
@@ -379,9 +414,10 @@ static int test_metropolis_init_zero(pe_t *pe){
   data_x(data, &x);
   data_y(data, &y);
 
+  /* Training labels are folded into the datapoints */
   for(i=0; i<N; i++){
     for(j=0; j<dim; j++){
-        test_assert(fabs(x[i*dim+j] - xref[i*dim+j]) < TEST_PRECISION_TOLERANCE);
+        test_assert(fabs(x[i*dim+j] - yref[i]*xref[i*dim+j]) < TEST_PRECISION_TOLERANCE);
     }
     test_assert(fabs(y[i] - yref[i]) < TEST_PRECISION_TOLERANCE);
   }
@@ -597,3 +633,975 @@ static int test_metropolis_run(pe_t *pe){
 
   return 0;
 }
+
+static int test_metropolis_prefetch(pe_t *pe){
+
+  assert(pe);
+
+  int i, j, dim, N, depth;
+  precision *samples = NULL, *samples_ref = NULL;
+  int *accepted = NULL, *accepted_ref = NULL;
+
+  rt_t *rt = NULL;
+  met_t *met = NULL, *met_ref = NULL;
+  ch_t *burn = NULL, *burn_ref = NULL;
+
+  rt_create(pe, &rt);
+  assert(rt);
+  rt_read_input_file(rt, "test_prefetch.dat");
+
+  ch_create(pe, &burn);
+  ch_init_burn_rt(rt, burn);
+  ch_create(pe, &burn_ref);
+  ch_init_burn_rt(rt, burn_ref);
+
+  met_create(pe, burn, &met);
+  met_init_rt(pe, rt, met);
+  met_prefetch(met, &depth);
+  test_assert(depth == 3);
+
+  /* Same streams, one step at a time */
+  met_create(pe, burn_ref, &met_ref);
+  met_init_rt(pe, rt, met_ref);
+  met_prefetch_set(met_ref, 0);
+
+  met_init(pe, met);
+  met_run(pe, met);
+  met_init(pe, met_ref);
+  met_run(pe, met_ref);
+
+  ch_dim(burn, &dim);
+  ch_N(burn, &N);
+  ch_samples(burn, &samples);
+  ch_accepted(burn, &accepted);
+  ch_samples(burn_ref, &samples_ref);
+  ch_accepted(burn_ref, &accepted_ref);
+
+  for(i=0; i<N+1; i++)
+  {
+    test_assert(accepted[i] == accepted_ref[i]);
+    for(j=0; j<dim; j++)
+    {
+      test_assert(fabs(samples[i*dim+j] - samples_ref[i*dim+j]) < TEST_PRECISION_TOLERANCE);
+    }
+  }
+
+  met_free(met);
+  met_free(met_ref);
+  ch_free(burn);
+  ch_free(burn_ref);
+  rt_free(rt);
+
+  return 0;
+}
+
+static int test_metropolis_mtm(pe_t *pe){
+
+  assert(pe);
+
+  int i, j, k, dim, N, sel, K = MTM_TRIES_DEFAULT;
+  met_algorithm_enum_t algorithm;
+  precision *samples = NULL;
+  precision *probability = NULL;
+  precision cand[MTM_TRIES_DEFAULT][3], refs[MTM_TRIES_DEFAULT][3];
+  precision lhood[MTM_TRIES_DEFAULT], w[MTM_TRIES_DEFAULT], w_ref[MTM_TRIES_DEFAULT];
+  precision *x = NULL, *y = NULL;
+  precision post, pmax, wsum, wsum_ref, cum, u, p;
+
+  rt_t *rt = NULL;
+  met_t *met = NULL;
+  ch_t *burn = NULL;
+  mvnb_t *mvnb = NULL;
+  lr_t *lr = NULL;
+
+  test_assert(met_algorithm_from_name("mtm", &algorithm));
+  test_assert(algorithm == MET_ALGORITHM_MTM);
+  test_assert(strcmp(met_algorithm_name(MET_ALGORITHM_METROPOLIS), "metropolis") == 0);
+  test_assert(met_algorithm_from_name("unknown", &algorithm) == 0);
+
+  rt_create(pe, &rt);
+  assert(rt);
+  rt_read_input_file(rt, "test.dat");
+
+  ch_create(pe, &burn);
+  ch_init_burn_rt(rt, burn);
+
+  met_create(pe, burn, &met);
+  met_algorithm_set(met, MET_ALGORITHM_MTM);
+  met_init_rt(pe, rt, met);
+  met_algorithm(met, &algorithm);
+  test_assert(algorithm == MET_ALGORITHM_MTM);
+
+  met_init(pe, met);
+  ran_init_seed(pe, ran_seed());
+  met_run(pe, met);
+
+  ch_dim(burn, &dim);
+  ch_N(burn, &N);
+  ch_samples(burn, &samples);
+  ch_probability(burn, &probability);
+  met_mvnb(met, &mvnb);
+  met_lr(met, &lr);
+  assert(dim == 3);
+
+  /* Same serial numbers again: each step redone by hand, K candidates,
+   * selection by weight pi(y_k), K-1 references around the selection
+   * plus x, acceptance against sum pi(y_k) / sum pi(x_k) */
+  ran_init_seed(pe, ran_seed());
+
+  for(i=1; i<N+1; i++)
+  {
+    x = &samples[(i-1)*dim];
+
+    for(k=0; k<K; k++) mvn_block_sample(mvnb, x, cand[k]);
+    lr_lhood_multi(lr, &cand[0][0], K, lhood);
+    for(k=0; k<K; k++) w[k] = pr_log_prob(cand[k], dim) + lhood[k];
+
+    /* Weights relative to the largest of both sets */
+    pmax = w[0];
+    for(k=1; k<K; k++) pmax = (w[k] > pmax) ? w[k] : pmax;
+    wsum = 0.0;
+    for(k=0; k<K; k++)
+    {
+      w[k] = exp(w[k] - pmax);
+      wsum += w[k];
+    }
+
+    u = ran_serial_uniform();
+    cum = 0.0;
+    for(sel=0; sel<K-1; sel++)
+    {
+      cum += w[sel] / wsum;
+      if(u < cum) break;
+    }
+    y = cand[sel];
+
+    for(k=0; k<K-1; k++) mvn_block_sample(mvnb, y, refs[k]);
+    for(j=0; j<dim; j++) refs[K-1][j] = x[j];
+    lr_lhood_multi(lr, &refs[0][0], K, lhood);
+    wsum_ref = 0.0;
+    for(k=0; k<K; k++)
+    {
+      post = pr_log_prob(refs[k], dim) + lhood[k];
+      w_ref[k] = exp(post - pmax);
+      wsum_ref += w_ref[k];
+    }
+
+    p = wsum / wsum_ref;
+    if(p > 1.0) p = 1.0;
+    test_assert(fabs(probability[i] - p) < MET_TOLERANCE);
+
+    /* The step ends on the selected candidate or stays at x */
+    u = ran_serial_uniform();
+    for(j=0; j<dim; j++)
+    {
+      if(u <= probability[i])
+        test_assert(fabs(samples[i*dim+j] - y[j]) < TEST_PRECISION_TOLERANCE);
+      else
+        test_assert(fabs(samples[i*dim+j] - x[j]) < TEST_PRECISION_TOLERANCE);
+    }
+  }
+
+  met_free(met);
+  ch_free(burn);
+  rt_free(rt);
+
+  return 0;
+}
+
+/* The philox streams give the same chain whatever rng_buffer, as long
+ * as no stream is drawn for both uniforms and gaussians */
+
+static int test_metropolis_rng_buffer(pe_t *pe, met_algorithm_enum_t algorithm){
+
+  int i, n, dim, N;
+  const char *input[2] = {"test_rng_buffer_1.dat", "test_rng_buffer_4096.dat"};
+  precision *samples[2] = {NULL, NULL};
+
+  rt_t *rt[2] = {NULL, NULL};
+  met_t *met[2] = {NULL, NULL};
+  ch_t *burn[2] = {NULL, NULL};
+
+  assert(pe);
+
+  for(n=0; n<2; n++)
+  {
+    rt_create(pe, &rt[n]);
+    assert(rt[n]);
+    rt_read_input_file(rt[n], input[n]);
+
+    ch_create(pe, &burn[n]);
+    ch_init_burn_rt(rt[n], burn[n]);
+
+    met_create(pe, burn[n], &met[n]);
+    met_algorithm_set(met[n], algorithm);
+    met_init_rt(pe, rt[n], met[n]);
+    test_assert(ran_buffer() == ((n == 0) ? 1 : 4096));
+
+    met_init(pe, met[n]);
+    met_run(pe, met[n]);
+    ch_samples(burn[n], &samples[n]);
+  }
+
+  ch_dim(burn[0], &dim);
+  ch_N(burn[0], &N);
+  for(i=0; i<(N+1)*dim; i++) test_assert(samples[0][i] == samples[1][i]);
+
+  for(n=0; n<2; n++)
+  {
+    met_free(met[n]);
+    ch_free(burn[n]);
+    rt_free(rt[n]);
+  }
+
+  return 0;
+}
+
+static int test_metropolis_pt(pe_t *pe){
+
+  assert(pe);
+
+  int i, j, k, c, dim, N, nchains, swapped;
+  precision *samples[4] = {NULL, NULL, NULL, NULL};
+  precision *probability[4] = {NULL, NULL, NULL, NULL};
+  int *accepted[4] = {NULL, NULL, NULL, NULL};
+  precision beta[4], lhood[2], p;
+  precision *x = NULL, *y = NULL;
+
+  rt_t *rt = NULL;
+  met_t *met = NULL;
+  lr_t *lr = NULL;
+  ch_t *burns[4] = {NULL, NULL, NULL, NULL};
+
+  rt_create(pe, &rt);
+  assert(rt);
+  rt_read_input_file(rt, "test.dat");
+
+  ch_create(pe, &burns[0]);
+  ch_init_burn_rt(rt, burns[0]);
+
+  met_create(pe, burns[0], &met);
+  met_algorithm_set(met, MET_ALGORITHM_PT);
+  met_init_rt(pe, rt, met);
+  met_nchains(met, &nchains);
+  test_assert(nchains == PT_TEMPERATURES_DEFAULT);
+
+  for(k=1; k<nchains; k++)
+  {
+    ch_create(pe, &burns[k]);
+    ch_id_set(burns[k], k);
+    ch_init_burn_rt(rt, burns[k]);
+  }
+  met_chains_set(met, burns);
+  met_swap_every_set(met, 2);
+
+  met_init(pe, met);
+  met_run(pe, met);
+
+  met_lr(met, &lr);
+  ch_dim(burns[0], &dim);
+  ch_N(burns[0], &N);
+  for(k=0; k<nchains; k++)
+  {
+    ch_samples(burns[k], &samples[k]);
+    ch_probability(burns[k], &probability[k]);
+    ch_accepted(burns[k], &accepted[k]);
+    beta[k] = pow(PT_BETA_MIN_DEFAULT, (double) k/(nchains-1));
+  }
+
+  for(i=1; i<N+1; i++)
+  {
+    if(i%2)
+    {
+      /* Tempered Metropolis: an accepted move had min(1, pi_beta(y)/pi_beta(x)) */
+      for(k=0; k<nchains; k++)
+      {
+        if(accepted[k][i] == accepted[k][i-1]) continue;
+        x = &samples[k][(i-1)*dim];
+        y = &samples[k][i*dim];
+        p = exp(pr_log_prob(y, dim) - pr_log_prob(x, dim)
+                + beta[k]*(lr_lhood(lr, y) - lr_lhood(lr, x)));
+        test_assert(fabs(probability[k][i] - ((p > 1.0) ? 1.0 : p)) < MET_TOLERANCE);
+      }
+      continue;
+    }
+
+    /* Exchange of pairs (k,k+1) from k = 0 or 1 in turn; a rung left out
+     * stays with probability 0 */
+    k = (i/2)%2;
+    if(k == 1)
+    {
+      test_assert(probability[0][i] == 0.0);
+      test_assert(accepted[0][i] == accepted[0][i-1]);
+    }
+
+    for(; k<nchains; k+=2)
+    {
+      if(k == nchains-1)
+      {
+        test_assert(probability[k][i] == 0.0);
+        test_assert(accepted[k][i] == accepted[k][i-1]);
+        break;
+      }
+
+      lhood[0] = lr_lhood(lr, &samples[k][(i-1)*dim]);
+      lhood[1] = lr_lhood(lr, &samples[k+1][(i-1)*dim]);
+      p = exp((beta[k] - beta[k+1])*(lhood[1] - lhood[0]));
+      if(p > 1.0) p = 1.0;
+
+      swapped = accepted[k][i] - accepted[k][i-1];
+      test_assert(accepted[k+1][i] - accepted[k+1][i-1] == swapped);
+
+      for(c=0; c<2; c++)
+      {
+        test_assert(fabs(probability[k+c][i] - p) < MET_TOLERANCE);
+        for(j=0; j<dim; j++)
+        {
+          x = (swapped) ? samples[k+1-c] : samples[k+c];
+          test_assert(fabs(samples[k+c][i*dim+j] - x[(i-1)*dim+j]) < TEST_PRECISION_TOLERANCE);
+        }
+      }
+    }
+  }
+
+  met_free(met);
+  for(k=0; k<nchains; k++) ch_free(burns[k]);
+  rt_free(rt);
+
+  return 0;
+}
+
+static int test_metropolis_hmc(pe_t *pe){
+
+  assert(pe);
+
+  int i, j, n, dim, N;
+  met_algorithm_enum_t algorithm;
+  met_algorithm_enum_t algorithms[2] = {MET_ALGORITHM_MALA, MET_ALGORITHM_HMC};
+  precision step_size;
+  precision *samples = NULL;
+  precision *probability = NULL;
+  precision *inv_mass = NULL;
+  int *accepted = NULL;
+
+  rt_t *rt = NULL;
+  met_t *met = NULL;
+  ch_t *burn = NULL;
+
+  test_assert(met_algorithm_from_name("hmc", &algorithm));
+  test_assert(algorithm == MET_ALGORITHM_HMC);
+  test_assert(strcmp(met_algorithm_name(MET_ALGORITHM_MALA), "mala") == 0);
+
+  rt_create(pe, &rt);
+  assert(rt);
+  rt_read_input_file(rt, "test.dat");
+
+  for(n=0; n<2; n++)
+  {
+    ch_create(pe, &burn);
+    ch_init_burn_rt(rt, burn);
+
+    met_create(pe, burn, &met);
+    met_algorithm_set(met, algorithms[n]);
+    met_init_rt(pe, rt, met);
+    met_step_size(met, &step_size);
+    test_assert(fabs(step_size - HMC_STEP_SIZE_DEFAULT) < TEST_PRECISION_TOLERANCE);
+    met_step_size_set(met, 0.05);
+
+    met_init(pe, met);
+    met_run(pe, met);
+
+    ch_dim(burn, &dim);
+    ch_N(burn, &N);
+    ch_samples(burn, &samples);
+    ch_probability(burn, &probability);
+    ch_accepted(burn, &accepted);
+
+    /* A probability, and a new state only when accepted */
+    for(i=1; i<N+1; i++)
+    {
+      test_assert(probability[i] >= 0.0 && probability[i] <= 1.0);
+      for(j=0; j<dim; j++)
+      {
+        if(accepted[i] == accepted[i-1])
+          test_assert(fabs(samples[i*dim+j] - samples[(i-1)*dim+j]) < TEST_PRECISION_TOLERANCE);
+      }
+    }
+
+    /* The mass matrix stays positive */
+    met_inv_mass(met, &inv_mass);
+    for(j=0; j<dim; j++) test_assert(inv_mass[j] > 0.0);
+
+    test_metropolis_leapfrog(met);
+
+    met_free(met);
+    ch_free(burn);
+  }
+
+  rt_free(rt);
+
+  return 0;
+}
+
+/* From the state the run ended at, the energy error of a trajectory of
+ * fixed length falls as eps^2 (by 4) when eps is halved, and the leapfrog
+ * run back with -p returns to where it started */
+
+static int test_metropolis_leapfrog(met_t *met){
+
+  int d, l, n, dim;
+  int steps[3] = {4, 8, 16};
+  precision t = 0.4, err, err_prev = 0.0;
+  precision h0, h1, posterior;
+  precision *x = NULL, *q = NULL, *minv = NULL;
+  precision *p0 = NULL, *p = NULL, *g0 = NULL, *g = NULL;
+  sample_t *current = NULL;
+  sample_t *state = NULL;
+  lr_t *lr = NULL;
+
+  assert(met);
+
+  met_current(met, &current);
+  met_proposed(met, &state);
+  met_lr(met, &lr);
+  met_inv_mass(met, &minv);
+  sample_dim(current, &dim);
+  sample_values(current, &x);
+
+  p0 = (precision *) malloc(dim*sizeof(precision));
+  p = (precision *) malloc(dim*sizeof(precision));
+  g0 = (precision *) malloc(dim*sizeof(precision));
+  g = (precision *) malloc(dim*sizeof(precision));
+  assert(p0 && p && g0 && g);
+
+  for(d=0; d<dim; d++) p0[d] = 1.0/sqrt(minv[d]);
+  posterior = lr_lhood_grad(lr, x, g0) + pr_log_prob_grad(x, dim, g0);
+  h0 = -posterior;
+  for(d=0; d<dim; d++) h0 += 0.5*p0[d]*p0[d]*minv[d];
+
+  for(n=0; n<3; n++)
+  {
+    sample_copy_values(state, x);
+    memcpy(p, p0, dim*sizeof(precision));
+    memcpy(g, g0, dim*sizeof(precision));
+    for(l=0; l<steps[n]; l++) posterior = met_leapfrog(met, t/steps[n], state, p, g);
+
+    h1 = -posterior;
+    for(d=0; d<dim; d++) h1 += 0.5*p[d]*p[d]*minv[d];
+    err = fabs(h1 - h0);
+    if(n > 0) test_assert(err < 0.3*err_prev);
+    err_prev = err;
+
+    /* Back with -p, then -p again */
+    for(d=0; d<dim; d++) p[d] = -p[d];
+    for(l=0; l<steps[n]; l++) met_leapfrog(met, t/steps[n], state, p, g);
+
+    sample_values(state, &q);
+    for(d=0; d<dim; d++)
+    {
+      test_assert(fabs(q[d] - x[d]) < MET_TOLERANCE);
+      test_assert(fabs(-p[d] - p0[d]) < MET_TOLERANCE);
+      test_assert(fabs(g[d] - g0[d]) < MET_TOLERANCE*fmax(1.0, fabs(g0[d])));
+    }
+  }
+
+  free(p0);
+  free(p);
+  free(g0);
+  free(g);
+
+  return 0;
+}
+
+static int test_metropolis_nuts(pe_t *pe){
+
+  assert(pe);
+
+  int i, j, n, dim, N;
+  met_algorithm_enum_t algorithm;
+  precision step_size;
+  precision *samples = NULL;
+  precision *probability = NULL;
+  int *accepted = NULL;
+  int *depth = NULL, *grads = NULL;
+
+  rt_t *rt = NULL;
+  met_t *met = NULL;
+  ch_t *burn = NULL;
+  ch_t *chain = NULL;
+  ch_t *wide = NULL;
+
+  test_assert(met_algorithm_from_name("nuts", &algorithm));
+  test_assert(algorithm == MET_ALGORITHM_NUTS);
+
+  rt_create(pe, &rt);
+  assert(rt);
+  rt_read_input_file(rt, "test.dat");
+
+  ch_create(pe, &burn);
+  ch_init_burn_rt(rt, burn);
+
+  met_create(pe, burn, &met);
+  met_algorithm_set(met, MET_ALGORITHM_NUTS);
+  met_init_rt(pe, rt, met);
+
+  met_init(pe, met);
+  met_run(pe, met);
+
+  /* Dual averaging moved the step */
+  met_step_size(met, &step_size);
+  test_assert(step_size > 0.0);
+  test_assert(fabs(step_size - HMC_STEP_SIZE_DEFAULT) > TEST_PRECISION_TOLERANCE);
+
+  ch_dim(burn, &dim);
+  ch_N(burn, &N);
+  ch_samples(burn, &samples);
+  ch_probability(burn, &probability);
+  ch_accepted(burn, &accepted);
+  ch_tree(burn, &depth, &grads);
+  test_assert(depth != NULL && grads != NULL);
+
+  for(i=1; i<N+1; i++)
+  {
+    test_assert(probability[i] >= 0.0 && probability[i] <= 1.0);
+    for(j=0; j<dim; j++)
+    {
+      if(accepted[i] == accepted[i-1])
+        test_assert(fabs(samples[i*dim+j] - samples[(i-1)*dim+j]) < TEST_PRECISION_TOLERANCE);
+    }
+
+    /* At most 2^depth - 1 leapfrog steps for depth doublings */
+    test_assert(depth[i] >= 1 && depth[i] <= NUTS_MAX_DEPTH_DEFAULT);
+    test_assert(grads[i] >= 1 && grads[i] <= (1 << depth[i]) - 1);
+  }
+
+  /* Post burn-in at the adapted step, then the same numbers again */
+  ch_create(pe, &chain);
+  ch_init_chain_rt(rt, chain);
+  met_chain_set(met, chain);
+  met_init_post_burn(pe, met);
+  ran_init_seed(pe, ran_seed());
+  met_run(pe, met);
+
+  ran_init_seed(pe, ran_seed());
+  test_metropolis_nuts_tree(met, chain);
+
+  /* A step too large for the first leaf: nothing is merged */
+  ch_create(pe, &wide);
+  ch_init_chain_rt(rt, wide);
+  met_chain_set(met, wide);
+  met_init_post_burn(pe, met);
+  met_step_size_set(met, 1.0e4);
+  ran_init_seed(pe, ran_seed());
+  met_run(pe, met);
+
+  ran_init_seed(pe, ran_seed());
+  test_metropolis_nuts_tree(met, wide);
+
+  ch_N(wide, &N);
+  ch_samples(wide, &samples);
+  ch_accepted(wide, &accepted);
+  ch_tree(wide, &depth, &grads);
+  n = 0;
+  for(i=1; i<N+1; i++)
+  {
+    if(grads[i] > 1) continue;
+    test_assert(depth[i] == 1);
+    test_assert(accepted[i] == accepted[i-1]);
+    for(j=0; j<dim; j++) test_assert(samples[i*dim+j] == samples[(i-1)*dim+j]);
+    n++;
+  }
+  test_assert(n > 0);
+
+  met_free(met);
+  ch_free(burn);
+  ch_free(chain);
+  ch_free(wide);
+  rt_free(rt);
+
+  return 0;
+}
+
+/* Each step of the chain redone by hand with the whole subtree held:
+ * every sub-subtree of 2, 4, ... leaves ending at a leaf is checked for a
+ * U-turn from its stored momenta, a merged subtree moves the proposal
+ * with probability min(1, w_subtree / w_tree). The depth, the gradients
+ * (2^depth - 1 unless the last subtree stopped early), the acceptance
+ * statistic and the state must be those of the chain, and a step that
+ * merged no subtree stays at x. */
+
+static int test_metropolis_nuts_tree(met_t *met, ch_t *chain){
+
+  int i, d, n, m, s, side, dim, N, leaves;
+  int depth, grads, nalpha, merged, moved, turning, diverged;
+  int *accepted = NULL, *depths = NULL, *ngrads = NULL;
+  precision eps, dir, a, h0, h, kinetic, lw_tree, lw_sub, alpha;
+  precision *samples = NULL, *probability = NULL, *minv = NULL;
+  precision *x = NULL, *q = NULL;
+  precision *q_end = NULL, *p_end = NULL, *g_end = NULL;
+  precision *p = NULL, *g = NULL, *rho = NULL, *rho_sub = NULL, *sum = NULL;
+  precision *q_sub = NULL, *q_pro = NULL, *p_leaves = NULL;
+  sample_t *state = NULL;
+  lr_t *lr = NULL;
+
+  assert(met);
+  assert(chain);
+
+  ch_dim(chain, &dim);
+  ch_N(chain, &N);
+  ch_samples(chain, &samples);
+  ch_probability(chain, &probability);
+  ch_accepted(chain, &accepted);
+  ch_tree(chain, &depths, &ngrads);
+  met_step_size(met, &eps);
+  met_inv_mass(met, &minv);
+  met_lr(met, &lr);
+  met_proposed(met, &state);
+
+  q_end = (precision *) malloc(2*dim*sizeof(precision));
+  p_end = (precision *) malloc(2*dim*sizeof(precision));
+  g_end = (precision *) malloc(2*dim*sizeof(precision));
+  p = (precision *) malloc(dim*sizeof(precision));
+  g = (precision *) malloc(dim*sizeof(precision));
+  rho = (precision *) malloc(dim*sizeof(precision));
+  rho_sub = (precision *) malloc(dim*sizeof(precision));
+  sum = (precision *) malloc(dim*sizeof(precision));
+  q_sub = (precision *) malloc(dim*sizeof(precision));
+  q_pro = (precision *) malloc(dim*sizeof(precision));
+  p_leaves = (precision *) malloc((1 << NUTS_MAX_DEPTH_DEFAULT)*dim*sizeof(precision));
+  assert(q_end && p_end && g_end && p && g && rho && rho_sub && sum);
+  assert(q_sub && q_pro && p_leaves);
+
+  for(i=1; i<N+1; i++)
+  {
+    x = &samples[(i-1)*dim];
+    for(d=0; d<dim; d++) rho[d] = (precision)ran_serial_gaussian()/sqrt(minv[d]);
+
+    h0 = -(lr_lhood_grad(lr, x, g) + pr_log_prob_grad(x, dim, g));
+    kinetic = 0.0;
+    for(d=0; d<dim; d++) kinetic += rho[d]*rho[d]*minv[d];
+    h0 += 0.5*kinetic;
+
+    for(s=0; s<2; s++)
+    {
+      memcpy(&q_end[s*dim], x, dim*sizeof(precision));
+      memcpy(&p_end[s*dim], rho, dim*sizeof(precision));
+      memcpy(&g_end[s*dim], g, dim*sizeof(precision));
+    }
+    memcpy(q_pro, x, dim*sizeof(precision));
+
+    depth = 0;
+    grads = 0;
+    nalpha = 0;
+    merged = 0;
+    moved = 0;
+    turning = 0;
+    diverged = 0;
+    alpha = 0.0;
+    lw_tree = -h0;
+
+    while(depth < NUTS_MAX_DEPTH_DEFAULT)
+    {
+      dir = ((precision)ran_serial_uniform() < 0.5) ? -1.0 : 1.0;
+      side = (dir > 0.0) ? 1 : 0;
+      leaves = 1 << depth;
+      depth++;
+
+      sample_copy_values(state, &q_end[side*dim]);
+      memcpy(p, &p_end[side*dim], dim*sizeof(precision));
+      memcpy(g, &g_end[side*dim], dim*sizeof(precision));
+      for(d=0; d<dim; d++) rho_sub[d] = 0.0;
+      lw_sub = -INFINITY;
+
+      for(n=0; n<leaves; n++)
+      {
+        h = -met_leapfrog(met, dir*eps, state, p, g);
+        kinetic = 0.0;
+        for(d=0; d<dim; d++) kinetic += p[d]*p[d]*minv[d];
+        h += 0.5*kinetic;
+        grads++;
+
+        a = exp(h0 - h);
+        if(isnan(a)) a = 0.0;
+        alpha += (a > 1.0) ? 1.0 : a;
+        nalpha++;
+
+        if(!(h - h0 < 1000.0))
+        {
+          diverged = 1;
+          break;
+        }
+
+        lw_sub = (lw_sub > -h) ? lw_sub + log1p(exp(-h - lw_sub)) : -h + log1p(exp(lw_sub + h));
+        sample_values(state, &q);
+        if(n == 0 || log((precision)ran_serial_uniform()) < -h - lw_sub)
+          memcpy(q_sub, q, dim*sizeof(precision));
+
+        memcpy(&p_leaves[n*dim], p, dim*sizeof(precision));
+        for(d=0; d<dim; d++) rho_sub[d] += p[d];
+
+        /* Sub-subtrees of 2^k leaves ending here */
+        for(m=2; m<=n+1 && (n+1)%m == 0 && !turning; m*=2)
+        {
+          for(d=0; d<dim; d++) sum[d] = 0.0;
+          for(s=n+1-m; s<=n; s++)
+            for(d=0; d<dim; d++) sum[d] += p_leaves[s*dim+d];
+          turning = test_metropolis_turning(minv, dim, &p_leaves[(n+1-m)*dim], p, sum);
+        }
+        if(turning) break;
+      }
+
+      if(diverged || turning) break;
+
+      merged++;
+      sample_values(state, &q);
+      memcpy(&q_end[side*dim], q, dim*sizeof(precision));
+      memcpy(&p_end[side*dim], p, dim*sizeof(precision));
+      memcpy(&g_end[side*dim], g, dim*sizeof(precision));
+
+      if(log((precision)ran_serial_uniform()) < lw_sub - lw_tree)
+      {
+        memcpy(q_pro, q_sub, dim*sizeof(precision));
+        moved = 1;
+      }
+      lw_tree = (lw_tree > lw_sub) ? lw_tree + log1p(exp(lw_sub - lw_tree))
+                                   : lw_sub + log1p(exp(lw_tree - lw_sub));
+
+      for(d=0; d<dim; d++) rho[d] += rho_sub[d];
+      if(test_metropolis_turning(minv, dim, &p_end[0], &p_end[dim], rho)) break;
+    }
+
+    /* The uniform of the certain acceptance */
+    ran_serial_uniform();
+
+    test_assert(depths[i] == depth);
+    test_assert(ngrads[i] == grads);
+    if(!diverged && !turning) test_assert(grads == (1 << depth) - 1);
+    test_assert(fabs(probability[i] - alpha/nalpha) < MET_TOLERANCE);
+    test_assert(accepted[i] - accepted[i-1] == moved);
+    if(merged == 0) test_assert(moved == 0);
+    for(d=0; d<dim; d++)
+    {
+      test_assert(fabs(samples[i*dim+d] - q_pro[d]) < MET_TOLERANCE);
+      if(!moved) test_assert(samples[i*dim+d] == x[d]);
+    }
+  }
+
+  free(q_end);
+  free(p_end);
+  free(g_end);
+  free(p);
+  free(g);
+  free(rho);
+  free(rho_sub);
+  free(sum);
+  free(q_sub);
+  free(q_pro);
+  free(p_leaves);
+
+  return 0;
+}
+
+/* The generalised criterion of met_nuts_turning */
+
+static int test_metropolis_turning(precision *minv, int dim, precision *p_left,
+                                   precision *p_right, precision *rho){
+
+  int d;
+  precision r, left = 0.0, right = 0.0;
+
+  for(d=0; d<dim; d++)
+  {
+    r = rho[d] - 0.5*(p_left[d] + p_right[d]);
+    left += minv[d]*p_left[d]*r;
+    right += minv[d]*p_right[d]*r;
+  }
+
+  return (left <= 0.0 || right <= 0.0);
+}
+
+static int test_metropolis_pg_gibbs(pe_t *pe){
+
+  assert(pe);
+
+  int i, j, dim, N;
+  met_algorithm_enum_t algorithm;
+  precision *samples = NULL;
+  precision *probability = NULL;
+  int *accepted = NULL;
+
+  precision prior, lhood, posterior;
+  sample_t *current = NULL;
+  lr_t *lr = NULL;
+
+  rt_t *rt = NULL;
+  met_t *met = NULL;
+  ch_t *burn = NULL;
+
+  test_assert(met_algorithm_from_name("pg_gibbs", &algorithm));
+  test_assert(algorithm == MET_ALGORITHM_PG_GIBBS);
+
+  rt_create(pe, &rt);
+  assert(rt);
+  rt_read_input_file(rt, "test_pg_gibbs.dat");
+
+  ch_create(pe, &burn);
+  ch_init_burn_rt(rt, burn);
+
+  met_create(pe, burn, &met);
+  met_init_rt(pe, rt, met);
+  met_algorithm(met, &algorithm);
+  test_assert(algorithm == MET_ALGORITHM_PG_GIBBS);
+
+  met_init(pe, met);
+  met_run(pe, met);
+
+  ch_dim(burn, &dim);
+  ch_N(burn, &N);
+  ch_samples(burn, &samples);
+  ch_probability(burn, &probability);
+  ch_accepted(burn, &accepted);
+
+  /* Every Gibbs sweep is a fresh draw from the conditional */
+  for(i=1; i<N+1; i++)
+  {
+    test_assert(fabs(probability[i] - 1.0) < TEST_PRECISION_TOLERANCE);
+    test_assert(accepted[i] == accepted[i-1] + 1);
+    for(j=0; j<dim; j++)
+      test_assert(fabs(samples[i*dim+j] - samples[(i-1)*dim+j]) > 0.0);
+  }
+
+  test_metropolis_pg_sweep(met, burn);
+
+  /* The state carries the prior, likelihood and posterior of its theta */
+  met_current(met, &current);
+  met_lr(met, &lr);
+  sample_prior(current, &prior);
+  sample_likelihood(current, &lhood);
+  sample_posterior(current, &posterior);
+  test_assert(fabs(prior - pr_log_prob(&samples[N*dim], dim)) < MET_TOLERANCE*fabs(prior));
+  test_assert(fabs(lhood - lr_lhood(lr, &samples[N*dim])) < MET_TOLERANCE*fabs(lhood));
+  test_assert(fabs(posterior - (prior + lhood)) < MET_TOLERANCE*fabs(posterior));
+
+  met_free(met);
+  ch_free(burn);
+  rt_free(rt);
+
+  return 0;
+}
+
+/* Each sweep redone with its omegas, drawn again from the stream of each
+ * datapoint: the mean P^-1 X^T kappa by Gaussian elimination of the dense
+ * P = X^T Omega X + B^-1, plus L^-T z from a Cholesky factor by hand and
+ * the gaussians of the proposal stream, must be the state of the chain */
+
+static int test_metropolis_pg_sweep(met_t *met, ch_t *chain){
+
+  int i, j, k, n, dim, N, size, fold, random_init;
+  int *y = NULL;
+  precision dot, omega, f;
+  precision *samples = NULL, *x = NULL, *theta = NULL;
+  precision *P = NULL, *L = NULL, *kappa = NULL, *m = NULL, *z = NULL;
+  data_t *data = NULL;
+  ran_stream_t *rng_pg = NULL;
+  ran_stream_t *rng_z = NULL;
+
+  assert(met);
+  assert(chain);
+
+  ch_dim(chain, &dim);
+  ch_N(chain, &N);
+  ch_samples(chain, &samples);
+  met_data(met, &data);
+  data_N(data, &size);
+  data_x(data, &x);
+  data_y(data, &y);
+  data_fold(data, &fold);
+
+  P = (precision *) malloc(dim*dim*sizeof(precision));
+  L = (precision *) malloc(dim*dim*sizeof(precision));
+  kappa = (precision *) malloc(dim*sizeof(precision));
+  m = (precision *) malloc(dim*sizeof(precision));
+  z = (precision *) malloc(dim*sizeof(precision));
+  assert(P && L && kappa && m && z);
+
+  ran_stream_create(ran_seed(), 0, RAN_PURPOSE_PG, &rng_pg);
+  ran_stream_create(ran_seed(), 0, RAN_PURPOSE_PROPOSAL, &rng_z);
+  ran_stream_buffer_set(rng_z, ran_buffer());
+
+  /* A random initial state took the first gaussians of the stream */
+  met_random_init(met, &random_init);
+  if(random_init)
+    for(j=0; j<dim; j++) ran_stream_gaussian(rng_z);
+
+  /* kappa_n = y_n / 2, y_n = 1 once folded into x_n */
+  for(j=0; j<dim; j++) kappa[j] = 0.0;
+  for(n=0; n<size; n++)
+    for(j=0; j<dim; j++) kappa[j] += 0.5*((fold) ? 1.0 : y[n])*x[n*dim+j];
+
+  for(i=1; i<N+1; i++)
+  {
+    theta = &samples[(i-1)*dim];
+
+    for(j=0; j<dim*dim; j++) P[j] = 0.0;
+    for(j=0; j<dim; j++) P[j*dim+j] = pr_inv_variance();
+    for(n=0; n<size; n++)
+    {
+      dot = 0.0;
+      for(j=0; j<dim; j++) dot += theta[j]*x[n*dim+j];
+      ran_stream_reset(rng_pg, n, (unsigned long long)(i-1) << 32);
+      omega = pg_draw(dot, rng_pg);
+      for(j=0; j<dim; j++)
+        for(k=0; k<dim; k++) P[j*dim+k] += omega*x[n*dim+j]*x[n*dim+k];
+    }
+
+    /* P = L L^T */
+    for(j=0; j<dim; j++)
+    {
+      for(k=0; k<=j; k++)
+      {
+        f = P[j*dim+k];
+        for(n=0; n<k; n++) f -= L[j*dim+n]*L[k*dim+n];
+        L[j*dim+k] = (j == k) ? sqrt(f) : f/L[k*dim+k];
+      }
+    }
+
+    /* P m = X^T kappa, without pivoting as P is positive definite */
+    memcpy(m, kappa, dim*sizeof(precision));
+    for(k=0; k<dim; k++)
+    {
+      for(j=k+1; j<dim; j++)
+      {
+        f = P[j*dim+k]/P[k*dim+k];
+        for(n=k; n<dim; n++) P[j*dim+n] -= f*P[k*dim+n];
+        m[j] -= f*m[k];
+      }
+    }
+    for(k=dim-1; k>=0; k--)
+    {
+      for(n=k+1; n<dim; n++) m[k] -= P[k*dim+n]*m[n];
+      m[k] /= P[k*dim+k];
+    }
+
+    /* L^T u = z, added to the mean */
+    for(j=0; j<dim; j++) z[j] = (precision)ran_stream_gaussian(rng_z);
+    for(k=dim-1; k>=0; k--)
+    {
+      for(n=k+1; n<dim; n++) z[k] -= L[n*dim+k]*z[n];
+      z[k] /= L[k*dim+k];
+    }
+
+    for(j=0; j<dim; j++)
+      test_assert(fabs(samples[i*dim+j] - (m[j] + z[j])) < MET_TOLERANCE*fmax(1.0, fabs(m[j])));
+  }
+
+  ran_stream_free(rng_pg);
+  ran_stream_free(rng_z);
+  free(P);
+  free(L);
+  free(kappa);
+  free(m);
+  free(z);
+
+  return 0;
+}
@@ -13,6 +13,10 @@ static int test_mvn_block_check_init_covariance(pe_t *pe);
 static int test_mvn_block_check_cholesky_decomposition(pe_t *pe);
 static int test_mvn_block_check_init(pe_t *pe);
 static int test_mvn_block_check_sample(pe_t *pe);
+static int test_mvn_block_check_structured(pe_t *pe);
+static int test_mvn_block_check_adapt(pe_t *pe);
+static int test_mvn_block_check_adapt_structured(pe_t *pe);
+static int test_mvn_block_check_tune(pe_t *pe);
 
 int test_mvn_suite(void){
 
@@ -28,6 +32,10 @@ int test_mvn_suite(void){
   test_mvn_block_check_cholesky_decomposition(pe);
   test_mvn_block_check_init(pe);
   test_mvn_block_check_sample(pe);
+  test_mvn_block_check_structured(pe);
+  test_mvn_block_check_adapt(pe);
+  test_mvn_block_check_adapt_structured(pe);
+  test_mvn_block_check_tune(pe);
 
   pe_info(pe, "PASS\t./unit/test_multivariate_normal\n");
   pe_free(pe);
@@ -281,5 +289,386 @@ static int test_mvn_block_check_sample(pe_t *pe){
   rt_free(rt);
 
 
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_mvn_block_check_structured
+ *
+ *  Banded and diagonal kernels must factor and sample as the dense kernel
+ *  on the same covariance; low-rank must give D^1/2 z + U w.
+ *
+ *****************************************************************************/
+
+static int test_mvn_block_check_structured(pe_t *pe){
+
+  int dim=4, i, j, b;
+  precision cur[4] = {1.0, -1.0, 0.5, 0.0};
+  precision pro[4], pro_ref[4];
+  precision u_ref[4] = {0.1, 0.2, 0.3, 0.4};
+  precision z[4], w;
+  precision *covariance = NULL, *L = NULL, *L_ref = NULL;
+
+  rt_t *rt = NULL;
+  mvnb_t *dense = NULL, *mvnb = NULL;
+  ran_stream_t *rng = NULL, *rng_ref = NULL;
+
+  rt_create(pe, &rt);
+  ran_stream_create(7361237, 0, RAN_PURPOSE_PROPOSAL, &rng);
+  ran_stream_create(7361237, 0, RAN_PURPOSE_PROPOSAL, &rng_ref);
+
+  /* Tridiagonal covariance, dense and banded */
+  mvn_block_create(pe, &dense);
+  mvn_block_dim_set(dense, dim);
+  mvn_block_init_rt(rt, dense);
+  mvn_block_covariance(dense, &covariance);
+  for(i=0; i<dim; i++)
+    for(j=0; j<dim; j++)
+      covariance[i*dim+j] = (i==j) ? 2.0 : ((abs(i-j)==1) ? 0.5 : 0.0);
+  mvn_block_cholesky_decomp(dense);
+  mvn_block_rng_set(dense, rng_ref);
+
+  b = 1;
+  mvn_block_create(pe, &mvnb);
+  mvn_block_dim_set(mvnb, dim);
+  mvn_block_cov_set(mvnb, MVN_COV_BANDED);
+  mvn_block_band_set(mvnb, b);
+  mvn_block_init_rt(rt, mvnb);
+  mvn_block_covariance(mvnb, &covariance);
+  for(i=0; i<dim; i++)
+  {
+    covariance[i*(b+1)+b] = 2.0;
+    covariance[i*(b+1)] = (i>0) ? 0.5 : 0.0;
+  }
+  mvn_block_cholesky_decomp(mvnb);
+  mvn_block_rng_set(mvnb, rng);
+
+  mvn_block_L(dense, &L_ref);
+  mvn_block_L(mvnb, &L);
+  for(i=0; i<dim; i++)
+    for(j=(i-b > 0 ? i-b : 0); j<=i; j++)
+      test_assert(fabs(L[i*(b+1)+b-(i-j)] - L_ref[i*dim+j]) < TEST_PRECISION_TOLERANCE);
+
+  mvn_block_sample(dense, cur, pro_ref);
+  mvn_block_sample(mvnb, cur, pro);
+  for(i=0; i<dim; i++)
+    test_assert(fabs(pro[i] - pro_ref[i]) < TEST_PRECISION_TOLERANCE);
+
+  mvn_block_free(mvnb);
+  mvn_block_free(dense);
+
+  /* Diagonal against the default dense kernel */
+  mvn_block_create(pe, &dense);
+  mvn_block_dim_set(dense, dim);
+  mvn_block_init_rt(rt, dense);
+  mvn_block_init(dense);
+  mvn_block_rng_set(dense, rng_ref);
+
+  mvn_block_create(pe, &mvnb);
+  mvn_block_dim_set(mvnb, dim);
+  mvn_block_cov_set(mvnb, MVN_COV_DIAGONAL);
+  mvn_block_init_rt(rt, mvnb);
+  mvn_block_init(mvnb);
+  mvn_block_rng_set(mvnb, rng);
+
+  mvn_block_sample(dense, cur, pro_ref);
+  mvn_block_sample(mvnb, cur, pro);
+  for(i=0; i<dim; i++)
+    test_assert(fabs(pro[i] - pro_ref[i]) < TEST_PRECISION_TOLERANCE);
+
+  mvn_block_free(mvnb);
+  mvn_block_free(dense);
+
+  /* Low-rank plus diagonal */
+  mvn_block_create(pe, &mvnb);
+  mvn_block_dim_set(mvnb, dim);
+  mvn_block_cov_set(mvnb, MVN_COV_LOWRANK);
+  mvn_block_rank_set(mvnb, 1);
+  mvn_block_init_rt(rt, mvnb);
+  mvn_block_init(mvnb);
+  mvn_block_covariance(mvnb, &covariance);
+  for(i=0; i<dim; i++) covariance[dim+i] = u_ref[i];
+  mvn_block_cholesky_decomp(mvnb);
+  mvn_block_rng_set(mvnb, rng);
+
+  mvn_block_covariance(mvnb, &covariance);
+  for(i=0; i<dim; i++) z[i] = ran_stream_gaussian(rng_ref);
+  w = ran_stream_gaussian(rng_ref);
+  for(i=0; i<dim; i++) pro_ref[i] = cur[i] + sqrt(covariance[i])*z[i] + u_ref[i]*w;
+
+  mvn_block_sample(mvnb, cur, pro);
+  for(i=0; i<dim; i++)
+    test_assert(fabs(pro[i] - pro_ref[i]) < TEST_PRECISION_TOLERANCE);
+
+  mvn_block_free(mvnb);
+
+  ran_stream_free(rng_ref);
+  ran_stream_free(rng);
+  rt_free(rt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_mvn_block_check_adapt
+ *
+ *  After t states the covariance must be (dim*S0 + s_d*M2)/(dim+t-1),
+ *  with M2 the sum of squared deviations from their mean, and the
+ *  updated factor must still reproduce it.
+ *
+ *****************************************************************************/
+
+static int test_mvn_block_check_adapt(pe_t *pe){
+
+  int dim=3, t=5, i, j, k;
+  precision x[5][3] = {{0.1, 0.2, -0.3}, {1.0, -0.5, 0.2}, {0.4, 0.4, 0.9},
+                       {-0.7, 0.1, 0.3}, {0.2, -1.2, 0.5}};
+  precision mean[3] = {0.0, 0.0, 0.0};
+  precision m2, ref, llt, s0;
+  precision *covariance = NULL, *L = NULL;
+
+  rt_t *rt = NULL;
+  mvnb_t *mvnb = NULL;
+
+  rt_create(pe, &rt);
+
+  mvn_block_create(pe, &mvnb);
+  mvn_block_dim_set(mvnb, dim);
+  mvn_block_adapt_set(mvnb, 1);
+  mvn_block_init_rt(rt, mvnb);
+  mvn_block_init(mvnb);
+  mvn_block_rwsd(mvnb, &s0);
+
+  for(k=0; k<t; k++) mvn_block_adapt_update(mvnb, x[k]);
+
+  for(k=0; k<t; k++)
+    for(i=0; i<dim; i++) mean[i] += x[k][i] / t;
+
+  mvn_block_covariance(mvnb, &covariance);
+  mvn_block_L(mvnb, &L);
+
+  for(i=0; i<dim; i++)
+  {
+    for(j=0; j<dim; j++)
+    {
+      m2 = 0.0;
+      for(k=0; k<t; k++) m2 += (x[k][i] - mean[i]) * (x[k][j] - mean[j]);
+      ref = (dim*((i==j) ? s0 : 0.0) + 2.38*2.38/dim*m2) / (dim + t - 1);
+      test_assert(fabs(covariance[i*dim+j] - ref) < TEST_PRECISION_TOLERANCE);
+
+      llt = 0.0;
+      for(k=0; k<=(i<j ? i : j); k++) llt += L[i*dim+k] * L[j*dim+k];
+      test_assert(fabs(llt - ref) < TEST_PRECISION_TOLERANCE);
+    }
+  }
+
+  mvn_block_free(mvnb);
+  rt_free(rt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_mvn_block_adapt_ref
+ *
+ *  Dense adapted covariance (dim*S0 + s_d*M2)/(dim+t-1) of t states.
+ *
+ *****************************************************************************/
+
+static precision test_mvn_block_adapt_ref(int dim, int t, precision x[][3],
+                                          precision s0, int i, int j){
+
+  int k;
+  precision mi = 0.0, mj = 0.0, m2 = 0.0;
+
+  for(k=0; k<t; k++)
+  {
+    mi += x[k][i] / t;
+    mj += x[k][j] / t;
+  }
+  for(k=0; k<t; k++) m2 += (x[k][i] - mi) * (x[k][j] - mj);
+
+  return (dim*((i==j) ? s0 : 0.0) + 2.38*2.38/dim*m2) / (dim + t - 1);
+}
+
+/*****************************************************************************
+ *
+ *  test_mvn_block_check_adapt_structured
+ *
+ *  Banded: the band follows the dense adaptation and is refactored.
+ *  Low-rank: D + U U^T is the dense adaptation while the deviations fit
+ *  in U, with or without the sketch having been shrunk.
+ *
+ *****************************************************************************/
+
+static int test_mvn_block_check_adapt_structured(pe_t *pe){
+
+  int dim=3, b=1, i, j, k, r;
+  precision x[7][3] = {{0.1, 0.2, -0.3}, {1.0, -0.5, 0.2}, {0.4, 0.4, 0.9},
+                       {-0.7, 0.1, 0.3}, {0.2, -1.2, 0.5}, {0.0, 0.0, 0.0},
+                       {0.0, 0.0, 0.0}};
+  precision v[3] = {0.6, -0.3, 1.2};
+  precision c[7] = {0.5, -1.0, 2.0, 0.3, -0.4, 1.5, 0.0};
+  precision ref, llt, s0;
+  precision *covariance = NULL, *L = NULL;
+
+  rt_t *rt = NULL;
+  mvnb_t *mvnb = NULL;
+
+  rt_create(pe, &rt);
+
+  mvn_block_create(pe, &mvnb);
+  mvn_block_dim_set(mvnb, dim);
+  mvn_block_cov_set(mvnb, MVN_COV_BANDED);
+  mvn_block_band_set(mvnb, b);
+  mvn_block_adapt_set(mvnb, 1);
+  mvn_block_init_rt(rt, mvnb);
+  mvn_block_init(mvnb);
+  mvn_block_rwsd(mvnb, &s0);
+
+  for(k=0; k<5; k++) mvn_block_adapt_update(mvnb, x[k]);
+
+  mvn_block_covariance(mvnb, &covariance);
+  mvn_block_L(mvnb, &L);
+
+  for(i=0; i<dim; i++)
+  {
+    for(j=(i-b > 0 ? i-b : 0); j<=i; j++)
+    {
+      ref = test_mvn_block_adapt_ref(dim, 5, x, s0, i, j);
+      test_assert(fabs(covariance[i*(b+1)+b-(i-j)] - ref) < TEST_PRECISION_TOLERANCE);
+
+      llt = 0.0;
+      for(k=(i-b > 0 ? i-b : 0); k<=j; k++)
+        llt += L[i*(b+1)+b-(i-k)] * L[j*(b+1)+b-(j-k)];
+      test_assert(fabs(llt - ref) < TEST_PRECISION_TOLERANCE);
+    }
+  }
+
+  mvn_block_free(mvnb);
+
+  /* Rank 2 holds the two deviations of three states */
+  r = 2;
+  mvn_block_create(pe, &mvnb);
+  mvn_block_dim_set(mvnb, dim);
+  mvn_block_cov_set(mvnb, MVN_COV_LOWRANK);
+  mvn_block_rank_set(mvnb, r);
+  mvn_block_adapt_set(mvnb, 1);
+  mvn_block_init_rt(rt, mvnb);
+  mvn_block_init(mvnb);
+
+  for(k=0; k<3; k++) mvn_block_adapt_update(mvnb, x[k]);
+
+  mvn_block_covariance(mvnb, &covariance);
+  mvn_block_L(mvnb, &L);
+
+  for(i=0; i<dim; i++)
+  {
+    test_assert(fabs(L[i]*L[i] - covariance[i]) < TEST_PRECISION_TOLERANCE);
+    for(j=0; j<dim; j++)
+    {
+      ref = test_mvn_block_adapt_ref(dim, 3, x, s0, i, j);
+      llt = (i==j) ? covariance[i] : 0.0;
+      for(k=0; k<r; k++) llt += L[dim+i*r+k] * L[dim+j*r+k];
+      test_assert(fabs(llt - ref) < TEST_PRECISION_TOLERANCE);
+    }
+  }
+
+  mvn_block_free(mvnb);
+
+  /* States on a line: rank 1 is exact through every shrink of the sketch */
+  for(k=0; k<7; k++)
+    for(i=0; i<dim; i++) x[k][i] = c[k]*v[i];
+
+  r = 1;
+  mvn_block_create(pe, &mvnb);
+  mvn_block_dim_set(mvnb, dim);
+  mvn_block_cov_set(mvnb, MVN_COV_LOWRANK);
+  mvn_block_rank_set(mvnb, r);
+  mvn_block_adapt_set(mvnb, 1);
+  mvn_block_init_rt(rt, mvnb);
+  mvn_block_init(mvnb);
+
+  for(k=0; k<7; k++) mvn_block_adapt_update(mvnb, x[k]);
+
+  mvn_block_covariance(mvnb, &covariance);
+
+  for(i=0; i<dim; i++)
+  {
+    for(j=0; j<dim; j++)
+    {
+      ref = test_mvn_block_adapt_ref(dim, 7, x, s0, i, j);
+      llt = ((i==j) ? covariance[i] : 0.0) + covariance[dim+i]*covariance[dim+j];
+      test_assert(fabs(llt - ref) < TEST_FLOAT_TOLERANCE);
+    }
+  }
+
+  mvn_block_free(mvnb);
+  rt_free(rt);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_mvn_block_check_tune
+ *
+ *  Acceptance above the target lengthens the step and below shortens it;
+ *  the scale multiplies the displacement of the sample.
+ *
+ *****************************************************************************/
+
+static int test_mvn_block_check_tune(pe_t *pe){
+
+  int dim=3, i;
+  precision cur[3] = {0.5, -0.5, 1.0};
+  precision pro[3], pro_ref[3];
+  precision scale, target;
+
+  rt_t *rt = NULL;
+  mvnb_t *mvnb = NULL;
+  ran_stream_t *rng = NULL, *rng_ref = NULL;
+
+  rt_create(pe, &rt);
+  mvn_block_create(pe, &mvnb);
+  mvn_block_dim_set(mvnb, dim);
+  mvn_block_init_rt(rt, mvnb);
+  mvn_block_init(mvnb);
+
+  mvn_block_target(mvnb, &target);
+  test_assert(fabs(target - 0.234) < TEST_PRECISION_TOLERANCE);
+  mvn_block_scale(mvnb, &scale);
+  test_assert(fabs(scale - 1.0) < TEST_PRECISION_TOLERANCE);
+
+  mvn_block_tune_update(mvnb, 1.0);
+  mvn_block_scale(mvnb, &scale);
+  test_assert(fabs(scale - exp(1.0 - target)) < TEST_PRECISION_TOLERANCE);
+
+  mvn_block_tune_update(mvnb, 0.0);
+  mvn_block_scale(mvnb, &scale);
+  test_assert(fabs(scale - exp(1.0 - target - pow(2.0, -0.6)*target)) < TEST_PRECISION_TOLERANCE);
+
+  ran_stream_create(7361237, 0, RAN_PURPOSE_PROPOSAL, &rng);
+  ran_stream_create(7361237, 0, RAN_PURPOSE_PROPOSAL, &rng_ref);
+
+  mvn_block_scale_set(mvnb, 1.0);
+  mvn_block_rng_set(mvnb, rng_ref);
+  mvn_block_sample(mvnb, cur, pro_ref);
+
+  mvn_block_scale_set(mvnb, 2.0);
+  mvn_block_rng_set(mvnb, rng);
+  mvn_block_sample(mvnb, cur, pro);
+
+  for(i=0; i<dim; i++)
+    test_assert(fabs((pro[i] - cur[i]) - 2.0*(pro_ref[i] - cur[i])) < TEST_PRECISION_TOLERANCE);
+
+  ran_stream_free(rng_ref);
+  ran_stream_free(rng);
+  mvn_block_free(mvnb);
+  rt_free(rt);
+
   return 0;
 }
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+
+#include "definitions.h"
+#include "pe.h"
+#include "ran.h"
+#include "polya_gamma.h"
+#include "tests.h"
+
+#define PG_NSAMPLES 200000
+
+static int test_pg_mean(pe_t *pe);
+static int test_pg_stream(pe_t *pe);
+
+int test_pg_suite(void){
+
+  pe_t *pe = NULL;
+
+  pe_create(MPI_COMM_WORLD, PE_QUIET, &pe);
+  assert(pe);
+  test_assert(1);
+
+  ran_init(pe);
+
+  test_pg_mean(pe);
+  test_pg_stream(pe);
+
+  pe_info(pe, "PASS\t./unit/test_polya_gamma\n");
+  pe_free(pe);
+
+  return 0;
+}
+
+static int test_pg_mean(pe_t *pe){
+
+  int i, n;
+  double sum, sum2, mean, sd;
+  precision omega;
+  precision z[5] = {0.0, 0.5, 2.0, -6.0, 40.0};
+  ran_stream_t *rng = NULL;
+
+  assert(pe);
+
+  /* E omega = tanh(z/2)/(2z), 1/4 at z = 0 */
+  test_assert(fabs(pg_mean(0.0) - 0.25) < TEST_PRECISION_TOLERANCE);
+  test_assert(fabs(pg_mean(2.0) - tanh(1.0)/4.0) < TEST_FLOAT_TOLERANCE);
+  test_assert(fabs(pg_mean(-2.0) - pg_mean(2.0)) < TEST_PRECISION_TOLERANCE);
+
+  ran_stream_create(ran_seed(), 0, RAN_PURPOSE_PG, &rng);
+
+  /* Sample means agree within five standard errors */
+  for(i=0; i<5; i++)
+  {
+    sum = 0.0;
+    sum2 = 0.0;
+    for(n=0; n<PG_NSAMPLES; n++)
+    {
+      omega = pg_draw(z[i], rng);
+      test_assert(omega > 0.0);
+      sum += omega;
+      sum2 += omega*omega;
+    }
+    mean = sum/PG_NSAMPLES;
+    sd = sqrt((sum2/PG_NSAMPLES - mean*mean)/PG_NSAMPLES);
+    test_assert(fabs(mean - pg_mean(z[i])) < 5.0*sd);
+  }
+
+  ran_stream_free(rng);
+
+  return 0;
+}
+
+static int test_pg_stream(pe_t *pe){
+
+  int n;
+  precision omega[4];
+  ran_stream_t *rng = NULL;
+
+  assert(pe);
+
+  ran_stream_create(ran_seed(), 0, RAN_PURPOSE_PG, &rng);
+
+  /* A draw depends only on (datapoint, position), not on what came before */
+  ran_stream_reset(rng, 7, 3ULL << 32);
+  omega[0] = pg_draw(1.5, rng);
+  omega[1] = pg_draw(1.5, rng);
+
+  for(n=0; n<10; n++) pg_draw(-3.0, rng);
+  ran_stream_reset(rng, 7, 3ULL << 32);
+  omega[2] = pg_draw(1.5, rng);
+  test_assert(omega[2] == omega[0]);
+
+  ran_stream_reset(rng, 8, 3ULL << 32);
+  omega[3] = pg_draw(1.5, rng);
+  test_assert(omega[3] != omega[0]);
+  test_assert(omega[1] != omega[0]);
+
+  ran_stream_free(rng);
+
+  return 0;
+}
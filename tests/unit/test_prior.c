@@ -24,6 +24,13 @@ int test_prior_suite(void){
   prior_act = pr_log_prob(sample, dim);
   test_assert(fabs(prior_act - -37.2955920057748003) < TEST_PRECISION_TOLERANCE);
 
+  /* The gradient is added to what is there */
+  precision grad[3] = {1.0, 1.0, 1.0};
+  prior_act = pr_log_prob_grad(sample, dim, grad);
+  test_assert(fabs(prior_act - -37.2955920057748003) < TEST_PRECISION_TOLERANCE);
+  test_assert(fabs(grad[0] - (1.0 + 1.0e-9)) < TEST_PRECISION_TOLERANCE);
+  test_assert(fabs(grad[2] - (1.0 - 1.0e-9)) < TEST_PRECISION_TOLERANCE);
+
   pe_info(pe, "PASS\t./unit/test_prior\n");
   pe_free(pe);
 
@@ -29,6 +29,9 @@
 #define NLARGE         10000000
 #define STAT_TOLERANCE 0.001
 
+static int test_random_philox(void);
+static int test_random_stream(void);
+
 /*****************************************************************************
  *
  *  test_random_suite
@@ -193,8 +196,151 @@ int test_random_suite(void) {
   test_assert(fabs(rvar - 1.0) < STAT_TOLERANCE);
   /*info("(ok)\n");*/
 
+  test_random_philox();
+  test_random_stream();
+
   pe_info(pe, "PASS\t./unit/test_random\n");
   pe_free(pe);
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  test_random_philox
+ *
+ *  Known answers of Philox4x32-10 from the Random123 distribution.
+ *
+ *****************************************************************************/
+
+static int test_random_philox(void) {
+
+  int n;
+  unsigned int out[4];
+  unsigned int ctr0[4] = {0, 0, 0, 0};
+  unsigned int key0[2] = {0, 0};
+  unsigned int ref0[4] = {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+  unsigned int ctr1[4] = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
+  unsigned int key1[2] = {0xffffffff, 0xffffffff};
+  unsigned int ref1[4] = {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd};
+  unsigned int ctr2[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+  unsigned int key2[2] = {0xa4093822, 0x299f31d0};
+  unsigned int ref2[4] = {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1};
+
+  ran_philox4x32(ctr0, key0, out);
+  for (n = 0; n < 4; n++) test_assert(out[n] == ref0[n]);
+
+  ran_philox4x32(ctr1, key1, out);
+  for (n = 0; n < 4; n++) test_assert(out[n] == ref1[n]);
+
+  ran_philox4x32(ctr2, key2, out);
+  for (n = 0; n < 4; n++) test_assert(out[n] == ref2[n]);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  test_random_stream
+ *
+ *  Skip-ahead must land where drawing would, streams differing in any
+ *  key component must differ, and the numbers must have the right
+ *  statistics.
+ *
+ *****************************************************************************/
+
+static int test_random_stream(void) {
+
+  int n;
+  double r, rtot, rvar;
+  double block[16];
+  double gfill[16];
+  ran_stream_t * s1 = NULL;
+  ran_stream_t * s2 = NULL;
+  ran_stream_t * s3 = NULL;
+
+  ran_stream_create(7361237, 0, RAN_PURPOSE_PROPOSAL, &s1);
+  ran_stream_create(7361237, 0, RAN_PURPOSE_PROPOSAL, &s2);
+
+  ran_stream_uniform_fill(s1, block, 16);
+  ran_stream_skip(s2, 13);
+  test_assert(ran_stream_position(s2) == 13);
+  test_assert(ran_stream_uniform(s2) == block[13]);
+  test_assert(ran_stream_uniform(s2) == block[14]);
+
+  ran_stream_free(s2);
+  ran_stream_create(7361237, 1, RAN_PURPOSE_PROPOSAL, &s2);
+  ran_stream_create(7361237, 0, RAN_PURPOSE_ACCEPT, &s3);
+  r = ran_stream_uniform(s2);
+  test_assert(r != block[0]);
+
+  /* A stream reset to another chain is that chain's stream */
+  r = ran_stream_uniform(s2);
+  ran_stream_reset(s2, 0, 13);
+  test_assert(ran_stream_position(s2) == 13);
+  test_assert(ran_stream_uniform(s2) == block[13]);
+  ran_stream_reset(s2, 1, 1);
+  test_assert(ran_stream_uniform(s2) == r);
+  r = ran_stream_uniform(s3);
+  test_assert(r != block[0]);
+
+  ran_stream_free(s3);
+  ran_stream_free(s2);
+  ran_stream_free(s1);
+
+  /* Buffered and bulk draws are the single draws, generated ahead */
+
+  ran_stream_create(7361237, 0, RAN_PURPOSE_PROPOSAL, &s1);
+  ran_stream_create(7361237, 0, RAN_PURPOSE_PROPOSAL, &s2);
+  ran_stream_create(7361237, 0, RAN_PURPOSE_PROPOSAL, &s3);
+  ran_stream_buffer_set(s2, 5);
+
+  for (n = 0; n < 16; n++) block[n] = ran_stream_gaussian(s1);
+  for (n = 0; n < 16; n++) test_assert(ran_stream_gaussian(s2) == block[n]);
+  ran_stream_gaussian(s3);
+  ran_stream_gaussian_fill(s3, gfill, 15);
+  for (n = 0; n < 15; n++) test_assert(gfill[n] == block[n+1]);
+
+  ran_stream_skip(s1, 3);
+  ran_stream_skip(s3, 3);
+  test_assert(ran_stream_position(s1) == 19);
+  test_assert(ran_stream_position(s3) == 19);
+  for (n = 0; n < 16; n++) block[n] = ran_stream_uniform(s1);
+
+  ran_stream_free(s2);
+  ran_stream_create(7361237, 0, RAN_PURPOSE_PROPOSAL, &s2);
+  ran_stream_buffer_set(s2, 6);
+  ran_stream_skip(s2, 19);
+  for (n = 0; n < 16; n++) test_assert(ran_stream_uniform(s2) == block[n]);
+  ran_stream_uniform_fill(s3, gfill, 16);
+  for (n = 0; n < 16; n++) test_assert(gfill[n] == block[n]);
+
+  ran_stream_free(s3);
+  ran_stream_free(s2);
+  ran_stream_free(s1);
+
+  ran_stream_create(7361237, 0, RAN_PURPOSE_PROPOSAL, &s1);
+  ran_stream_buffer_set(s1, 4096);
+
+  rtot = 0.0;
+  for (n = 0; n < NLARGE; n++) {
+    r = ran_stream_uniform(s1);
+    test_assert(r > 0.0 && r < 1.0);
+    rtot += r;
+  }
+  test_assert(fabs(rtot/NLARGE - 0.5) < STAT_TOLERANCE);
+
+  rtot = 0.0;
+  rvar = 0.0;
+  for (n = 0; n < NLARGE; n++) {
+    r = ran_stream_gaussian(s1);
+    rtot += r;
+    rvar += r*r;
+  }
+  test_assert(fabs(rtot/NLARGE - 0.0) < STAT_TOLERANCE);
+  test_assert(fabs(rvar/NLARGE - 1.0) < STAT_TOLERANCE);
+
+  ran_stream_free(s1);
+
+  return 0;
+}
@@ -393,7 +393,7 @@ static int test_sample_choose(pe_t *pe){
   */
   idx = 2;
   ch_append_probability(idx, 0.0, chain); /* sample should be rejected */
-  sample_choose(idx, chain, &cur, &pro);
+  sample_choose(idx, chain, &cur, &pro, NULL);
   test_assert(cur == pcur); /* Check swap did not happen */
   test_assert(pro == ppro); /* Check swap did not happen */
   test_assert(accepted[idx] == 0);
@@ -409,7 +409,7 @@ static int test_sample_choose(pe_t *pe){
   */
   idx = 3;
   ch_append_probability(idx, 1.0, chain); /* sample should be accepted */
-  sample_choose(idx, chain, &cur, &pro);
+  sample_choose(idx, chain, &cur, &pro, NULL);
   test_assert(cur == ppro); /* Check swap */
   test_assert(pro == pcur); /* Check swap */
   test_assert(accepted[idx] == 1);
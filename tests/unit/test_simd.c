@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+
+#include "definitions.h"
+#include "pe.h"
+#include "simd.h"
+#include "tests.h"
+
+static int test_simd_isa(pe_t *pe);
+static int test_simd_lhood(pe_t *pe);
+
+int test_simd_suite(void){
+
+  pe_t *pe = NULL;
+
+  pe_create(MPI_COMM_WORLD, PE_QUIET, &pe);
+  assert(pe);
+  test_assert(1);
+
+  test_simd_isa(pe);
+  test_simd_lhood(pe);
+
+  pe_info(pe, "PASS\t./unit/test_simd\n");
+  pe_free(pe);
+
+  return 0;
+}
+
+static int test_simd_isa(pe_t *pe){
+
+  int n;
+  simd_isa_enum_t isa;
+
+  assert(pe);
+
+  /* Scalar kernel is always there and detection returns a supported set */
+  test_assert(simd_isa_supported(SIMD_ISA_SCALAR));
+  test_assert(simd_isa_supported(simd_isa_detect()));
+
+  for(n=0; n<SIMD_ISA_MAX; n++)
+  {
+    test_assert(simd_isa_from_name(simd_isa_name((simd_isa_enum_t) n), &isa) == 1);
+    test_assert(isa == (simd_isa_enum_t) n);
+  }
+  test_assert(simd_isa_from_name("sse5", &isa) == 0);
+
+  return 0;
+}
+
+static int test_simd_lhood(pe_t *pe){
+
+  int i, j, n, size;
+  int dim = 7, N = 53;
+  precision dot, lhood_ref, lhood_test;
+  precision *x = NULL;
+  precision *xy = NULL;
+  int *y = NULL;
+  precision sample[7] = {0.5, -1.0, 2.0, 0.25, -3.0, 1.5, 40.0};
+
+  assert(pe);
+
+  x = (precision *) malloc(N*dim*sizeof(precision));
+  xy = (precision *) malloc(N*dim*sizeof(precision));
+  y = (int *) malloc(N*sizeof(int));
+  assert(x);
+  assert(xy);
+  assert(y);
+
+  /* The last feature spans both tails of the log-sigmoid */
+  for(i=0; i<N; i++)
+  {
+    for(j=0; j<dim; j++) x[i*dim+j] = sin(1.0 + i*dim + j);
+    x[i*dim+dim-1] = (i - N/2) * 0.5;
+    y[i] = (i%3 == 0) ? 1 : -1;
+    for(j=0; j<dim; j++) xy[i*dim+j] = y[i] * x[i*dim+j];
+  }
+
+  /* Every row count up to N, so the vector and remainder paths both run */
+  for(size=0; size<=N; size++)
+  {
+    lhood_ref = 0.0;
+    for(i=0; i<size; i++)
+    {
+      dot = 0.0;
+      for(j=0; j<dim; j++) dot += sample[j] * x[i*dim+j];
+      lhood_ref -= log1p(exp(-y[i] * dot));
+    }
+
+    for(n=0; n<SIMD_ISA_MAX; n++)
+    {
+      if(!simd_isa_supported((simd_isa_enum_t) n)) continue;
+      lhood_test = simd_lhood((simd_isa_enum_t) n, x, y, sample, size, dim);
+      test_assert(fabs(lhood_ref - lhood_test) <= fabs(lhood_ref)*TEST_FLOAT_TOLERANCE);
+
+      /* Folded labels, no label array */
+      lhood_test = simd_lhood((simd_isa_enum_t) n, xy, NULL, sample, size, dim);
+      test_assert(fabs(lhood_ref - lhood_test) <= fabs(lhood_ref)*TEST_FLOAT_TOLERANCE);
+    }
+  }
+
+  free(x);
+  free(xy);
+  free(y);
+
+  return 0;
+}
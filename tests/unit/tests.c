@@ -60,6 +60,9 @@ int tests_create() {
   test_metropolis_suite();
   test_autocorrelation_suite();
   test_decomposition_suite();
+  test_simd_suite();
+  test_pg_suite();
+  test_infr_suite();
 
   return 0;
 }
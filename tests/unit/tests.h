@@ -42,5 +42,8 @@ int test_sample_suite(void);
 int test_metropolis_suite(void);
 int test_autocorrelation_suite(void);
 int test_decomposition_suite(void);
+int test_simd_suite(void);
+int test_pg_suite(void);
+int test_infr_suite(void);
 
 #endif